@@ -0,0 +1,375 @@
+#include "CloudNotifier.h"
+
+#include "Log.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace
+{
+    std::chrono::milliseconds const c_RequestTimeout = std::chrono::seconds(5);
+    // How long to wait after the first press of a burst for the rest of it, so that they all go in one request
+    std::chrono::milliseconds const c_BatchWindow = std::chrono::milliseconds(200);
+    size_t const c_MaxBatchSize = 64;
+    std::chrono::milliseconds const c_InitialBackoff = std::chrono::seconds(1);
+    std::chrono::milliseconds const c_MaxBackoff = std::chrono::minutes(5);
+
+    // Remember: the address is stored little endian but displayed big endian
+    std::string FormatAddress(Flic::ButtonAddress const& buttonAddress)
+    {
+        char text[3 * Flic::ButtonAddress::c_AddressLength];
+        snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X",
+            buttonAddress.addr[5], buttonAddress.addr[4], buttonAddress.addr[3],
+            buttonAddress.addr[2], buttonAddress.addr[1], buttonAddress.addr[0]);
+        return text;
+    }
+
+    std::string FormatSpoolLine(Cloud::Press const& press)
+    {
+        return FormatAddress(press.buttonAddress) + " " + std::to_string(press.time) + "\n";
+    }
+
+    bool ParseSpoolLine(std::string const& line, Cloud::Press& press)
+    {
+        unsigned int bytes[Flic::ButtonAddress::c_AddressLength];
+        long long time = 0;
+        if (sscanf(line.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x %lld", &bytes[5], &bytes[4], &bytes[3], &bytes[2], &bytes[1], &bytes[0], &time) != 7)
+        {
+            return false;
+        }
+
+        for (int byteIndex = 0; byteIndex < Flic::ButtonAddress::c_AddressLength; ++byteIndex)
+        {
+            press.buttonAddress.addr[byteIndex] = static_cast<uint8_t>(bytes[byteIndex]);
+        }
+        press.time = time;
+        return true;
+    }
+
+    bool WriteAll(int fileHandle, std::string const& data)
+    {
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t const result = write(fileHandle, data.data() + written, data.size() - written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            written += static_cast<size_t>(result);
+        }
+
+        return true;
+    }
+}
+
+namespace Cloud
+{
+    Notifier::Notifier(std::string const& url, std::string const& spoolPath)
+        : m_Url(url)
+        , m_SpoolPath(spoolPath)
+        , m_Queue(c_QueueCapacity)
+        , m_Client(c_RequestTimeout)
+    {
+    }
+
+    Notifier::~Notifier()
+    {
+        Stop();
+
+        if (m_WakeHandle >= 0)
+        {
+            close(m_WakeHandle);
+        }
+    }
+
+    bool Notifier::Start()
+    {
+        if (m_Running)
+        {
+            return true;
+        }
+
+        if (!m_Client.SetUrl(m_Url))
+        {
+            return false;
+        }
+
+        if (m_WakeHandle < 0)
+        {
+            m_WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_WakeHandle < 0)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to create notifier wake descriptor [%s]", strerror(errno));
+                return false;
+            }
+        }
+
+        m_Running = true;
+        m_Thread = std::thread(&Notifier::Run, this);
+        return true;
+    }
+
+    void Notifier::Stop()
+    {
+        if (!m_Thread.joinable())
+        {
+            return;
+        }
+
+        m_Running = false;
+        uint64_t const wake = 1;
+        write(m_WakeHandle, &wake, sizeof(wake));
+        m_Thread.join();
+    }
+
+    bool Notifier::Notify(Flic::ButtonAddress const& buttonAddress)
+    {
+        auto const now = std::chrono::system_clock::now().time_since_epoch();
+        Press const press = { buttonAddress, std::chrono::duration_cast<std::chrono::milliseconds>(now).count() };
+        if (!m_Queue.TryPush(press))
+        {
+            ++m_DroppedCount;
+            Metrics::Global().notificationsDropped.Increment();
+            return false;
+        }
+
+        // A non-blocking eventfd write; if the counter were somehow saturated the worker is awake anyway
+        if (m_WakeHandle >= 0)
+        {
+            uint64_t const wake = 1;
+            write(m_WakeHandle, &wake, sizeof(wake));
+        }
+
+        return true;
+    }
+
+    uint64_t Notifier::DeliveredCount() const
+    {
+        return m_DeliveredCount;
+    }
+
+    uint64_t Notifier::DroppedCount() const
+    {
+        return m_DroppedCount;
+    }
+
+    void Notifier::Run()
+    {
+        LoadSpool();
+
+        auto const c_Never = std::chrono::steady_clock::time_point::max();
+        auto nextAttempt = m_Pending.empty() ? c_Never : std::chrono::steady_clock::now();
+        std::chrono::milliseconds backoff = c_InitialBackoff;
+
+        while (m_Running)
+        {
+            WaitForWork(nextAttempt);
+
+            bool const wasIdle = m_Pending.empty();
+            if (DrainQueue() && wasIdle)
+            {
+                nextAttempt = std::chrono::steady_clock::now() + c_BatchWindow;
+            }
+
+            auto const now = std::chrono::steady_clock::now();
+            if (m_Pending.empty() || now < nextAttempt || !m_Running)
+            {
+                continue;
+            }
+
+            if (Deliver())
+            {
+                backoff = c_InitialBackoff;
+                nextAttempt = m_Pending.empty() ? c_Never : now;
+            }
+            else
+            {
+                // Keep hold of what couldn't be delivered in case we don't get another chance
+                AppendSpool();
+                nextAttempt = now + backoff;
+                backoff = std::min(backoff * 2, c_MaxBackoff);
+                DOORBELLPI_LOG(LOG_NOTICE, "Cloud notification failed, %zu press(es) pending, retrying in %lld ms",
+                    m_Pending.size(), static_cast<long long>((nextAttempt - now) / std::chrono::milliseconds(1)));
+            }
+        }
+
+        DrainQueue();
+        AppendSpool();
+        m_Client.Close();
+    }
+
+    void Notifier::WaitForWork(std::chrono::steady_clock::time_point const deadline)
+    {
+        int timeout = -1;
+        if (deadline != std::chrono::steady_clock::time_point::max())
+        {
+            // Round up, so that we never wake just before the deadline and spin
+            auto const remaining = deadline - std::chrono::steady_clock::now();
+            timeout = static_cast<int>(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(remaining).count()));
+        }
+
+        pollfd pollEntry = { m_WakeHandle, POLLIN, 0 };
+        if (poll(&pollEntry, 1, timeout) > 0)
+        {
+            uint64_t wakes = 0;
+            read(m_WakeHandle, &wakes, sizeof(wakes));
+        }
+    }
+
+    bool Notifier::DrainQueue()
+    {
+        bool drained = false;
+        Press press;
+        while (m_Queue.TryPop(press))
+        {
+            m_Pending.push_back(press);
+            drained = true;
+        }
+
+        return drained;
+    }
+
+    bool Notifier::Deliver()
+    {
+        size_t const batchSize = std::min(m_Pending.size(), c_MaxBatchSize);
+
+        std::string body = "{\"presses\":[";
+        for (size_t pressIndex = 0; pressIndex < batchSize; ++pressIndex)
+        {
+            Press const& press = m_Pending[pressIndex];
+            body += pressIndex == 0 ? "{" : ",{";
+            body += "\"button\":\"" + FormatAddress(press.buttonAddress) + "\",";
+            body += "\"time\":" + std::to_string(press.time) + "}";
+        }
+        body += "]}";
+
+        int const status = m_Client.Post("application/json", body);
+        if (status >= 200 && status < 300)
+        {
+            m_DeliveredCount += batchSize;
+            Metrics::Global().notificationsDelivered.Increment(batchSize);
+        }
+        else if (status >= 400 && status < 500 && status != 408 && status != 429)
+        {
+            // Sending the same thing again won't change the answer
+            DOORBELLPI_LOG(LOG_ERR, "Cloud service rejected %zu press(es) with status %d", batchSize, status);
+        }
+        else
+        {
+            return false;
+        }
+
+        m_Pending.erase(m_Pending.begin(), m_Pending.begin() + static_cast<std::ptrdiff_t>(batchSize));
+        if (m_SpooledCount > 0)
+        {
+            m_SpooledCount -= std::min(m_SpooledCount, batchSize);
+            RewriteSpool();
+        }
+
+        return true;
+    }
+
+    void Notifier::LoadSpool()
+    {
+        std::ifstream file(m_SpoolPath);
+        if (!file)
+        {
+            return;
+        }
+
+        std::string line;
+        size_t discarded = 0;
+        Press press;
+        while (std::getline(file, line))
+        {
+            // A line cut short by a crash is the only thing expected here
+            if (ParseSpoolLine(line, press))
+            {
+                m_Pending.push_back(press);
+            }
+            else
+            {
+                ++discarded;
+            }
+        }
+
+        m_SpooledCount = m_Pending.size();
+        DOORBELLPI_LOG(LOG_NOTICE, "Loaded %zu undelivered press(es) from '%s', discarded %zu", m_Pending.size(), m_SpoolPath.c_str(), discarded);
+    }
+
+    void Notifier::AppendSpool()
+    {
+        if (m_SpooledCount == m_Pending.size())
+        {
+            return;
+        }
+
+        std::string lines;
+        for (size_t pressIndex = m_SpooledCount; pressIndex < m_Pending.size(); ++pressIndex)
+        {
+            lines += FormatSpoolLine(m_Pending[pressIndex]);
+        }
+
+        int const fileHandle = open(m_SpoolPath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fileHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to open spool '%s' [%s]", m_SpoolPath.c_str(), strerror(errno));
+            return;
+        }
+
+        if (WriteAll(fileHandle, lines) && fsync(fileHandle) == 0)
+        {
+            m_SpooledCount = m_Pending.size();
+        }
+        else
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to write spool '%s' [%s]", m_SpoolPath.c_str(), strerror(errno));
+        }
+        close(fileHandle);
+    }
+
+    void Notifier::RewriteSpool()
+    {
+        if (m_SpooledCount == 0)
+        {
+            unlink(m_SpoolPath.c_str());
+            return;
+        }
+
+        // Written aside and renamed over the original, so a crash leaves one complete spool or the other
+        std::string lines;
+        for (size_t pressIndex = 0; pressIndex < m_SpooledCount; ++pressIndex)
+        {
+            lines += FormatSpoolLine(m_Pending[pressIndex]);
+        }
+
+        std::string const temporaryPath = m_SpoolPath + ".tmp";
+        int const fileHandle = open(temporaryPath.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+        if (fileHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to open spool '%s' [%s]", temporaryPath.c_str(), strerror(errno));
+            return;
+        }
+
+        bool const written = WriteAll(fileHandle, lines) && fsync(fileHandle) == 0;
+        close(fileHandle);
+        if (!written || rename(temporaryPath.c_str(), m_SpoolPath.c_str()) != 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to rewrite spool '%s' [%s]", m_SpoolPath.c_str(), strerror(errno));
+            unlink(temporaryPath.c_str());
+        }
+    }
+}
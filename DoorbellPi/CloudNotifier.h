@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+#include "FlicButtonAddress.h"
+#include "HttpClient.h"
+#include "SpscQueue.h"
+
+namespace Cloud
+{
+    struct Press
+    {
+        Flic::ButtonAddress buttonAddress;
+        // Wall clock time, in milliseconds since the Unix epoch
+        int64_t time;
+    };
+
+    // Tells the cloud service about presses without ever holding up the event loop. Notify() only pushes onto a lock
+    // free queue; a worker thread batches whatever has queued up into one POST over a kept alive connection, retries
+    // failures with exponential backoff and spools undelivered presses to disk so that they survive a restart
+    class Notifier
+    {
+    public:
+        Notifier(std::string const& url, std::string const& spoolPath);
+        ~Notifier();
+
+        Notifier(Notifier const&) = delete;
+        Notifier& operator=(Notifier const&) = delete;
+
+        bool Start();
+        // Flushes anything undelivered to the spool
+        void Stop();
+
+        // Only to be called from one thread (the Doorbell's ring thread). Never blocks; if the queue is full the press is dropped
+        bool Notify(Flic::ButtonAddress const& buttonAddress);
+
+        uint64_t DeliveredCount() const;
+        uint64_t DroppedCount() const;
+
+    private:
+        static size_t const c_QueueCapacity = 256;
+
+        void Run();
+        void WaitForWork(std::chrono::steady_clock::time_point const deadline);
+        bool DrainQueue();
+        bool Deliver();
+        void LoadSpool();
+        void AppendSpool();
+        void RewriteSpool();
+
+        std::string const m_Url;
+        std::string const m_SpoolPath;
+        SpscQueue<Press> m_Queue;
+        int m_WakeHandle = -1;
+        std::thread m_Thread;
+        std::atomic<bool> m_Running{ false };
+        std::atomic<uint64_t> m_DeliveredCount{ 0 };
+        std::atomic<uint64_t> m_DroppedCount{ 0 };
+
+        // Only touched by the worker thread. The first m_SpooledCount pending presses are already in the spool
+        HttpClient m_Client;
+        std::deque<Press> m_Pending;
+        size_t m_SpooledCount = 0;
+    };
+}
@@ -0,0 +1,571 @@
+#include "Config.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fstream>
+#include <limits>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace
+{
+    // Long enough for an editor to finish saving
+    std::chrono::milliseconds const c_SettleTime = std::chrono::milliseconds(200);
+    // Durations are added to steady_clock time points, so are kept well clear of overflowing them
+    std::chrono::milliseconds const c_MaxDuration = std::chrono::hours(24);
+    // About 800 MB a file
+    long const c_MaxJournalRecords = 16 * 1024 * 1024;
+
+    std::string Trim(std::string const& text)
+    {
+        size_t const start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos)
+        {
+            return std::string();
+        }
+
+        size_t const end = text.find_last_not_of(" \t\r\n");
+        return text.substr(start, end - start + 1);
+    }
+
+    std::vector<std::string> Split(std::string const& text)
+    {
+        std::vector<std::string> words;
+        size_t start = text.find_first_not_of(" \t,");
+        while (start != std::string::npos)
+        {
+            size_t const end = text.find_first_of(" \t,", start);
+            words.push_back(text.substr(start, end - start));
+            start = text.find_first_not_of(" \t,", end);
+        }
+        return words;
+    }
+
+    bool ParseNumber(std::string const& text, long const minimum, long const maximum, long& value)
+    {
+        if (text.empty())
+        {
+            return false;
+        }
+
+        char* end = nullptr;
+        errno = 0;
+        value = strtol(text.c_str(), &end, 10);
+        return errno == 0 && *end == '\0' && value >= minimum && value <= maximum;
+    }
+
+    // Also rejects anything that wouldn't fit in the setting
+    template<typename Number>
+    bool ParseNumber(std::string const& text, long const minimum, long const maximum, Number& value)
+    {
+        long parsed = 0;
+        if (!ParseNumber(text, minimum, maximum, parsed)
+            || (parsed < 0 && !std::numeric_limits<Number>::is_signed)
+            || (parsed > 0 && static_cast<unsigned long>(parsed) > static_cast<unsigned long>(std::numeric_limits<Number>::max())))
+        {
+            return false;
+        }
+
+        value = static_cast<Number>(parsed);
+        return true;
+    }
+
+    bool ParseMilliseconds(std::string const& text, std::chrono::milliseconds const maximum, std::chrono::milliseconds& value)
+    {
+        long milliseconds = 0;
+        if (!ParseNumber(text, 0, static_cast<long>(maximum.count()), milliseconds))
+        {
+            return false;
+        }
+
+        value = std::chrono::milliseconds(milliseconds);
+        return true;
+    }
+
+    // HH:MM
+    bool ParseTimeOfDay(std::string const& text, std::chrono::minutes& value)
+    {
+        size_t const separator = text.find(':');
+        long hours = 0;
+        long minutes = 0;
+        if (separator == std::string::npos
+            || !ParseNumber(text.substr(0, separator), 0, 23, hours)
+            || !ParseNumber(text.substr(separator + 1), 0, 59, minutes))
+        {
+            return false;
+        }
+
+        value = std::chrono::hours(hours) + std::chrono::minutes(minutes);
+        return true;
+    }
+
+    // Displayed big endian, stored little endian
+    bool ParseAddress(std::string const& text, Flic::ButtonAddress& address)
+    {
+        unsigned int bytes[Flic::ButtonAddress::c_AddressLength];
+        char trailing = 0;
+        if (sscanf(text.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[5], &bytes[4], &bytes[3], &bytes[2], &bytes[1], &bytes[0], &trailing) != Flic::ButtonAddress::c_AddressLength)
+        {
+            return false;
+        }
+
+        for (int index = 0; index < Flic::ButtonAddress::c_AddressLength; ++index)
+        {
+            address.addr[index] = static_cast<uint8_t>(bytes[index]);
+        }
+        return true;
+    }
+
+    bool ParseLatencyMode(std::string const& text, FlicClientProtocol::LatencyMode& mode)
+    {
+        if (text == "normal")
+        {
+            mode = FlicClientProtocol::NormalLatency;
+        }
+        else if (text == "low")
+        {
+            mode = FlicClientProtocol::LowLatency;
+        }
+        else if (text == "high")
+        {
+            mode = FlicClientProtocol::HighLatency;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseSwitch(std::string const& text, bool& value)
+    {
+        if (text == "on")
+        {
+            value = true;
+        }
+        else if (text == "off")
+        {
+            value = false;
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    bool ParseSetting(std::string const& key, std::string const& value, Config::Settings& settings)
+    {
+        if (key == "gpio_chip")
+        {
+            settings.gpioChipPath = value;
+            return !value.empty();
+        }
+        if (key == "cloud_service")
+        {
+            settings.cloudServiceUrl = value;
+            return !value.empty();
+        }
+        if (key == "notification_spool")
+        {
+            settings.notificationSpoolPath = value;
+            return !value.empty();
+        }
+        if (key == "metrics_socket")
+        {
+            settings.metricsSocketPath = value;
+            return !value.empty();
+        }
+        if (key == "flicd")
+        {
+            // host:port
+            size_t const separator = value.rfind(':');
+            if (separator == std::string::npos || separator == 0)
+            {
+                return false;
+            }
+            settings.flicdHost = value.substr(0, separator);
+            return ParseNumber(value.substr(separator + 1), 1, 65535, settings.flicdPort);
+        }
+        if (key == "journal")
+        {
+            settings.journalPath = value;
+            return true;
+        }
+        if (key == "journal_records")
+        {
+            return ParseNumber(value, 1, c_MaxJournalRecords, settings.journalRecords);
+        }
+        if (key == "journal_files")
+        {
+            return ParseNumber(value, 1, 100, settings.journalFiles);
+        }
+        if (key == "real_time")
+        {
+            return ParseSwitch(value, settings.realTime);
+        }
+        if (key == "real_time_priority")
+        {
+            return ParseNumber(value, 1, 99, settings.realTimePriority);
+        }
+        if (key == "ring_cpu")
+        {
+            return ParseNumber(value, -1, CPU_SETSIZE - 1, settings.ringCpu);
+        }
+        if (key == "ring_patterns")
+        {
+            settings.ringPatternsPath = value;
+            return !value.empty();
+        }
+        if (key == "output_ms")
+        {
+            // A strike is a step of the built in patterns, so is bounded as a parsed step is
+            return ParseMilliseconds(value, std::chrono::minutes(1), settings.outputDuration) && settings.outputDuration.count() > 0;
+        }
+        if (key == "ring_cooldown_ms")
+        {
+            return ParseMilliseconds(value, c_MaxDuration, settings.ringCooldown);
+        }
+        if (key == "escalation_presses")
+        {
+            return ParseNumber(value, 1, 1000, settings.escalationPresses);
+        }
+        if (key == "flicd_ping_interval_ms")
+        {
+            return ParseMilliseconds(value, c_MaxDuration, settings.flicdPingInterval) && settings.flicdPingInterval.count() > 0;
+        }
+        if (key == "flicd_max_missed_pings")
+        {
+            return ParseNumber(value, 1, 1000, settings.flicdMaxMissedPings);
+        }
+        if (key == "day_start")
+        {
+            return ParseTimeOfDay(value, settings.latencySchedule.dayStart);
+        }
+        if (key == "day_end")
+        {
+            return ParseTimeOfDay(value, settings.latencySchedule.dayEnd);
+        }
+        if (key == "active_ms")
+        {
+            return ParseMilliseconds(value, c_MaxDuration, settings.latencySchedule.activeTime);
+        }
+        return false;
+    }
+
+    bool ParseButtonSetting(std::string const& key, std::string const& value, Config::Button& button)
+    {
+        if (key == "outputs")
+        {
+            button.outputPins.clear();
+            for (std::string const& word : Split(value))
+            {
+                int pin = 0;
+                if (!ParseNumber(word, 0, 63, pin))
+                {
+                    return false;
+                }
+                button.outputPins.push_back(pin);
+            }
+            return !button.outputPins.empty();
+        }
+        if (key == "pattern")
+        {
+            button.pattern = value;
+            return !value.empty();
+        }
+        if (key == "escalation")
+        {
+            button.escalationPattern = value;
+            return true;
+        }
+        if (key == "latency")
+        {
+            // Day, night and active
+            std::vector<std::string> const words = Split(value);
+            return words.size() == 3
+                && ParseLatencyMode(words[0], button.latency.day)
+                && ParseLatencyMode(words[1], button.latency.night)
+                && ParseLatencyMode(words[2], button.latency.active);
+        }
+        if (key == "group")
+        {
+            return ParseNumber(value, 0, INT_MAX, button.latency.group);
+        }
+        return false;
+    }
+
+    Config::Button DefaultButton()
+    {
+        uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0x73, 0xDA, 0xE4, 0x80 };
+        Config::Button button;
+        button.address = Flic::ButtonAddress(address);
+        button.outputPins = { 23 };
+        button.pattern = "Classic";
+        button.escalationPattern = "Classic";
+        button.latency.group = 1;
+        return button;
+    }
+
+    bool ReadFile(std::string const& path, Config::Settings& settings)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to open settings '%s'", path.c_str());
+            return false;
+        }
+
+        std::vector<Config::Button> buttons;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+            line = Trim(line.substr(0, line.find('#')));
+            if (line.empty())
+            {
+                continue;
+            }
+
+            if (line.front() == '[')
+            {
+                static std::string const c_ButtonSection = "button ";
+                std::string const section = line.back() == ']' ? Trim(line.substr(1, line.size() - 2)) : std::string();
+                buttons.emplace_back();
+                if (section.compare(0, c_ButtonSection.size(), c_ButtonSection) != 0
+                    || !ParseAddress(Trim(section.substr(c_ButtonSection.size())), buttons.back().address))
+                {
+                    DOORBELLPI_LOG(LOG_ERR, "Invalid section on line %d of '%s'", lineNumber, path.c_str());
+                    return false;
+                }
+                continue;
+            }
+
+            size_t const separator = line.find('=');
+            std::string const key = separator != std::string::npos ? Trim(line.substr(0, separator)) : std::string();
+            std::string const value = separator != std::string::npos ? Trim(line.substr(separator + 1)) : std::string();
+            bool const valid = buttons.empty() ? ParseSetting(key, value, settings) : ParseButtonSetting(key, value, buttons.back());
+            if (!valid)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Invalid setting on line %d of '%s'", lineNumber, path.c_str());
+                return false;
+            }
+        }
+
+        if (!buttons.empty())
+        {
+            settings.buttons = std::move(buttons);
+        }
+        return true;
+    }
+}
+
+namespace Config
+{
+    bool Load(std::string const& path, Settings& settings)
+    {
+        Settings loaded;
+        loaded.buttons.push_back(DefaultButton());
+        if (access(path.c_str(), F_OK) != 0)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "No settings at '%s', using the built in ones", path.c_str());
+        }
+        else if (!ReadFile(path, loaded))
+        {
+            return false;
+        }
+
+        loaded.patterns["Once"] = Rings::Compile(Rings::Once(loaded.outputDuration), "Once");
+        loaded.patterns["Classic"] = Rings::Compile(Rings::Classic(loaded.outputDuration), "Classic");
+        if (access(loaded.ringPatternsPath.c_str(), F_OK) == 0 && !Rings::LoadLibrary(loaded.ringPatternsPath, loaded.patterns))
+        {
+            return false;
+        }
+
+        std::unordered_map<Flic::ButtonAddress, bool> seen;
+        for (Button const& button : loaded.buttons)
+        {
+            if (!seen.emplace(button.address, true).second)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "A button appears twice in '%s'", path.c_str());
+                return false;
+            }
+
+            if (button.outputPins.empty() || button.pattern.empty())
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Every button in '%s' needs outputs and a pattern", path.c_str());
+                return false;
+            }
+
+            for (std::string const& pattern : { button.pattern, button.escalationPattern })
+            {
+                if (!pattern.empty() && loaded.patterns.count(pattern) == 0)
+                {
+                    DOORBELLPI_LOG(LOG_ERR, "Unknown ring pattern '%s' in '%s'", pattern.c_str(), path.c_str());
+                    return false;
+                }
+            }
+        }
+
+        settings = std::move(loaded);
+        return true;
+    }
+
+    bool NeedsRestart(Settings const& running, Settings const& loaded)
+    {
+        bool needsRestart = false;
+        auto const check = [&needsRestart](bool const changed, char const* name)
+        {
+            if (changed)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Changing %s needs a restart", name);
+                needsRestart = true;
+            }
+        };
+
+        check(running.gpioChipPath != loaded.gpioChipPath, "gpio_chip");
+        check(running.cloudServiceUrl != loaded.cloudServiceUrl, "cloud_service");
+        check(running.notificationSpoolPath != loaded.notificationSpoolPath, "notification_spool");
+        check(running.metricsSocketPath != loaded.metricsSocketPath, "metrics_socket");
+        check(running.flicdHost != loaded.flicdHost || running.flicdPort != loaded.flicdPort, "flicd");
+        check(running.journalPath != loaded.journalPath || running.journalRecords != loaded.journalRecords || running.journalFiles != loaded.journalFiles, "journal");
+        check(running.realTime != loaded.realTime || running.realTimePriority != loaded.realTimePriority || running.ringCpu != loaded.ringCpu, "real_time");
+
+        bool buttonsChanged = running.buttons.size() != loaded.buttons.size();
+        for (size_t index = 0; !buttonsChanged && index < running.buttons.size(); ++index)
+        {
+            buttonsChanged = running.buttons[index].address != loaded.buttons[index].address
+                || running.buttons[index].outputPins != loaded.buttons[index].outputPins;
+        }
+        check(buttonsChanged, "the buttons or their outputs");
+
+        return needsRestart;
+    }
+
+    std::unordered_map<Flic::ButtonAddress, ButtonAction> ButtonActions(Settings const& settings)
+    {
+        std::unordered_map<Flic::ButtonAddress, ButtonAction> actions;
+        for (Button const& button : settings.buttons)
+        {
+            ButtonAction action{ button.outputPins, settings.patterns.at(button.pattern), settings.ringCooldown };
+            if (!button.escalationPattern.empty())
+            {
+                action.escalation = settings.patterns.at(button.escalationPattern);
+                action.escalationPresses = settings.escalationPresses;
+            }
+            actions.emplace(button.address, std::move(action));
+        }
+        return actions;
+    }
+
+    Watcher::Watcher(EventLoop& eventLoop)
+        : m_EventLoop(eventLoop)
+    {
+    }
+
+    Watcher::~Watcher()
+    {
+        if (m_SettleTimer != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_SettleTimer);
+        }
+
+        if (m_Handle != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.RemoveDescriptor(m_Handle);
+            close(m_Handle);
+        }
+    }
+
+    bool Watcher::Watch(std::vector<std::string> const& paths, ChangeHandler handler)
+    {
+        if (m_Handle == EventLoop::c_InvalidHandle)
+        {
+            m_Handle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (m_Handle < 0)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to create inotify descriptor [%s]", strerror(errno));
+                return false;
+            }
+
+            m_SettleTimer = m_EventLoop.CreateTimer([this]()
+            {
+                // A copy, as the handler may well replace itself
+                ChangeHandler const handler = m_Handler;
+                if (handler)
+                {
+                    handler();
+                }
+            });
+            if (m_SettleTimer == EventLoop::c_InvalidHandle || !m_EventLoop.AddDescriptor(m_Handle, EPOLLIN, [this](uint32_t) { OnReadable(); }))
+            {
+                return false;
+            }
+        }
+
+        RemoveWatches();
+        m_Handler = std::move(handler);
+
+        bool watching = true;
+        for (std::string const& path : paths)
+        {
+            size_t const separator = path.rfind('/');
+            std::string const directory = separator == std::string::npos ? "." : separator == 0 ? "/" : path.substr(0, separator);
+            std::string const name = separator == std::string::npos ? path : path.substr(separator + 1);
+
+            int const watch = inotify_add_watch(m_Handle, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+            if (watch < 0)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Failed to watch '%s' [%s]", directory.c_str(), strerror(errno));
+                watching = false;
+                continue;
+            }
+            m_Watches[watch].insert(name);
+        }
+        return watching;
+    }
+
+    void Watcher::OnReadable()
+    {
+        alignas(inotify_event) char buffer[4096];
+        bool changed = false;
+        ssize_t length = 0;
+        while ((length = read(m_Handle, buffer, sizeof(buffer))) > 0)
+        {
+            for (char const* next = buffer; next < buffer + length;)
+            {
+                inotify_event const* const event = reinterpret_cast<inotify_event const*>(next);
+                next += sizeof(inotify_event) + event->len;
+
+                auto const watch = m_Watches.find(event->wd);
+                if (watch != m_Watches.end() && event->len > 0 && watch->second.count(event->name) != 0)
+                {
+                    changed = true;
+                }
+            }
+        }
+
+        // Restarted by every change, so a burst of them is reported once it's over
+        if (changed)
+        {
+            m_EventLoop.ArmTimer(m_SettleTimer, c_SettleTime);
+        }
+    }
+
+    void Watcher::RemoveWatches()
+    {
+        for (auto const& watch : m_Watches)
+        {
+            inotify_rm_watch(m_Handle, watch.first);
+        }
+        m_Watches.clear();
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Doorbell.h"
+#include "EventLoop.h"
+#include "FlicButtonAddress.h"
+#include "FlicLatencyPolicy.h"
+#include "Rings.h"
+
+namespace Config
+{
+    struct Button
+    {
+        Flic::ButtonAddress address;
+        std::vector<int> outputPins;
+        std::string pattern;
+        // Empty for none
+        std::string escalationPattern;
+        Flic::LatencyPolicy::ButtonModes latency;
+    };
+
+    // Everything the daemon is configured with. A snapshot: it's loaded whole, checked, and never changed afterwards;
+    // a reload loads another one alongside it
+    struct Settings
+    {
+        // These are only read at startup, and changing them needs a restart
+        std::string gpioChipPath = "/dev/gpiochip0";
+        std::string cloudServiceUrl = "http://192.168.0.17:8888";
+        std::string notificationSpoolPath = "/var/spool/doorbellpi/presses";
+        std::string metricsSocketPath = "/run/doorbellpi/metrics.sock";
+        std::string flicdHost = "localhost";
+        int flicdPort = 5551;
+        // Empty for no press journal. About 12 MB a file
+        std::string journalPath = "/var/lib/doorbellpi/presses.journal";
+        size_t journalRecords = 262144;
+        size_t journalFiles = 4;
+        // Locks memory and plays rings under SCHED_FIFO on a core of their own; see RealTime.h
+        bool realTime = false;
+        int realTimePriority = 50;
+        // -1 for the last core
+        int ringCpu = -1;
+        // The buttons themselves, and their output pins, are fixed. What they do isn't
+        std::vector<Button> buttons;
+
+        // The rest can change on a reload
+        std::string ringPatternsPath = "/etc/doorbellpi/rings.conf";
+        // The strike length of the built in Once and Classic patterns
+        std::chrono::milliseconds outputDuration = std::chrono::milliseconds(20);
+        std::chrono::milliseconds ringCooldown = std::chrono::seconds(10);
+        uint32_t escalationPresses = 3;
+        // A wedged flicd is given up on after about six seconds
+        std::chrono::milliseconds flicdPingInterval = std::chrono::seconds(2);
+        uint32_t flicdMaxMissedPings = 3;
+        Flic::LatencyPolicy::Schedule latencySchedule;
+
+        // The built in patterns, overridden or added to by the patterns file
+        Rings::Library patterns;
+    };
+
+    // Reads "key = value" lines, ignoring blank lines and # comments, with a [button XX:XX:XX:XX:XX:XX] section for
+    // each button. Anything left out keeps its built in value; buttons in the file replace the built in one. If the
+    // file doesn't exist the built in settings are used. Returns false, leaving settings alone, if the file or the
+    // ring patterns can't be read or anything in them is invalid
+    bool Load(std::string const& path, Settings& settings);
+
+    // Returns true, having logged each one, if anything differs that can only change by restarting
+    bool NeedsRestart(Settings const& running, Settings const& loaded);
+
+    // What each button does, for Doorbell::AddButton and Doorbell::Reconfigure. Every pattern was checked on loading
+    std::unordered_map<Flic::ButtonAddress, ButtonAction> ButtonActions(Settings const& settings);
+
+    // Calls back on the event loop shortly after any of the files is written, replaced or removed. It watches their
+    // directories rather than the files themselves, so it follows editors that save by renaming a new file over the
+    // old one, and changes close together are reported once
+    class Watcher
+    {
+    public:
+        using ChangeHandler = std::function<void()>;
+
+        explicit Watcher(EventLoop& eventLoop);
+        ~Watcher();
+
+        Watcher(Watcher const&) = delete;
+        Watcher& operator=(Watcher const&) = delete;
+
+        // Replaces whatever was being watched. Can be called from the handler
+        bool Watch(std::vector<std::string> const& paths, ChangeHandler handler);
+
+    private:
+        void OnReadable();
+        void RemoveWatches();
+
+        EventLoop& m_EventLoop;
+        int m_Handle = EventLoop::c_InvalidHandle;
+        int m_SettleTimer = EventLoop::c_InvalidHandle;
+        // Watch descriptor to the names of the files watched in that directory
+        std::map<int, std::set<std::string>> m_Watches;
+        ChangeHandler m_Handler;
+    };
+}
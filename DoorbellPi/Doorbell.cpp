@@ -0,0 +1,427 @@
+#include "Doorbell.h"
+
+#include "FlicCodec.h"
+#include "Log.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+Doorbell::Doorbell(Gpio::Backend& gpio)
+    : m_Gpio(gpio)
+    , m_Actions(std::make_unique<Actions>())
+{
+}
+
+Doorbell::~Doorbell()
+{
+    Stop();
+
+    if (m_WakeHandle >= 0)
+    {
+        m_RingLoop.RemoveDescriptor(m_WakeHandle);
+        close(m_WakeHandle);
+    }
+}
+
+Flic::ConnectionId Doorbell::AddButton(Flic::ButtonAddress const& buttonAddress, ButtonAction action)
+{
+    if (m_Running)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Buttons can only be added before starting");
+        return Flic::c_InvalidConnectionId;
+    }
+
+    Gpio::LineMask const outputLines = m_Gpio.MaskFor(action.outputPins);
+    if (outputLines == 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "None of the button's output pins were requested");
+        return Flic::c_InvalidConnectionId;
+    }
+
+    // Buttons that drive the same set of outputs share a player, so they can't talk over each other. All of a
+    // button's outputs change together in a single write
+    Output& output = m_Outputs[outputLines];
+    if (!output.player)
+    {
+        output.player = std::make_unique<Rings::Player>(m_RingLoop, m_Gpio, outputLines);
+        output.pendingEscalation = Flic::c_InvalidConnectionId;
+        output.player->SetFinishedObserver([this, &output]() { OnRingFinished(output); });
+    }
+
+    Flic::ConnectionId const connectionId = m_Buttons.Add(buttonAddress, Button{ &output, std::chrono::steady_clock::time_point(), 0, false });
+    if (connectionId != Flic::c_InvalidConnectionId)
+    {
+        auto actions = std::make_unique<Actions>(m_Actions.Current());
+        actions->resize(std::max<size_t>(actions->size(), connectionId));
+        (*actions)[connectionId - 1] = std::move(action);
+        m_Actions.Publish(std::move(actions));
+    }
+    return connectionId;
+}
+
+void Doorbell::SetRingHandler(RingHandler handler)
+{
+    m_RingHandler = std::move(handler);
+}
+
+Flic::ConnectionId Doorbell::FindButton(Flic::ButtonAddress const& buttonAddress) const
+{
+    return m_Buttons.Find(buttonAddress);
+}
+
+bool Doorbell::Reconfigure(std::unordered_map<Flic::ButtonAddress, ButtonAction> const& actions)
+{
+    if (actions.size() != m_Buttons.Size())
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Buttons can't be added or removed while running");
+        return false;
+    }
+
+    Actions const& current = m_Actions.Current();
+    auto replacement = std::make_unique<Actions>(current.size());
+    for (auto const& entry : actions)
+    {
+        Flic::ConnectionId const connectionId = m_Buttons.Find(entry.first);
+        if (connectionId == Flic::c_InvalidConnectionId)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Buttons can't be added or removed while running");
+            return false;
+        }
+
+        if (m_Gpio.MaskFor(entry.second.outputPins) != m_Gpio.MaskFor(current[connectionId - 1].outputPins))
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Output pins of channel %u can't be changed while running", connectionId);
+            return false;
+        }
+
+        (*replacement)[connectionId - 1] = entry.second;
+    }
+
+    m_Actions.Publish(std::move(replacement));
+    return true;
+}
+
+bool Doorbell::Start()
+{
+    if (m_Running)
+    {
+        return true;
+    }
+
+    if (m_WakeHandle < 0)
+    {
+        m_WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_WakeHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to create ring wake descriptor [%s]", strerror(errno));
+            return false;
+        }
+
+        if (!m_RingLoop.AddDescriptor(m_WakeHandle, EPOLLIN, [this](uint32_t) { DrainQueue(); }))
+        {
+            return false;
+        }
+    }
+
+    // conn_ids are dense, so one slot per button is one per possible conn_id. The queue holds at most one entry per
+    // button, so it never fills
+    size_t const buttons = m_Actions.Current().size();
+    m_Queue = std::make_unique<SpscQueue<Press>>(buttons);
+    m_PendingPresses = std::vector<std::atomic<uint32_t>>(buttons + 1);
+
+    m_Running = true;
+    m_Thread = std::thread(&Doorbell::Run, this);
+    return true;
+}
+
+void Doorbell::Stop()
+{
+    if (!m_Thread.joinable())
+    {
+        return;
+    }
+
+    m_Running = false;
+    uint64_t const wake = 1;
+    write(m_WakeHandle, &wake, sizeof(wake));
+    m_Thread.join();
+}
+
+void Doorbell::SetJournal(Journal::Writer* journal)
+{
+    m_Journal = journal;
+}
+
+void Doorbell::SetRealTime(RealTime::ThreadPolicy const& policy)
+{
+    m_RealTime = policy;
+}
+
+void Doorbell::OnPress(Flic::ConnectionId const connectionId, std::chrono::steady_clock::time_point const readableTime, uint32_t const timeDiff)
+{
+    if (!m_Queue)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Ignoring press on channel %u before starting", connectionId);
+        return;
+    }
+
+    if (connectionId == Flic::c_InvalidConnectionId || connectionId >= m_PendingPresses.size())
+    {
+        Metrics::Global().pressesUnknownChannel.Increment();
+        DOORBELLPI_LOG(LOG_NOTICE, "Ignoring press from unknown channel %u", connectionId);
+        return;
+    }
+
+    // Only the first of a run of presses is queued; the ring thread picks up the rest from the count
+    if (m_PendingPresses[connectionId].fetch_add(1, std::memory_order_acq_rel) != 0)
+    {
+        return;
+    }
+
+    // One entry per button at most, so there's always room. This is called as the press is decoded
+    auto const decodedTime = m_Journal != nullptr ? std::chrono::steady_clock::now() : readableTime;
+    if (!m_Queue->TryPush(Press{ connectionId, timeDiff, readableTime, decodedTime }))
+    {
+        m_PendingPresses[connectionId].store(0, std::memory_order_release);
+        DOORBELLPI_LOG(LOG_ERR, "Ring queue is full, dropping press on channel %u", connectionId);
+        return;
+    }
+
+    size_t const depth = m_Queue->SizeApprox();
+    if (depth > m_MaxQueueDepth.load(std::memory_order_relaxed))
+    {
+        m_MaxQueueDepth.store(depth, std::memory_order_relaxed);
+        Metrics::Global().ringQueueDepthMax.Set(static_cast<int64_t>(depth));
+    }
+
+    if (m_WakeHandle >= 0)
+    {
+        uint64_t const wake = 1;
+        write(m_WakeHandle, &wake, sizeof(wake));
+    }
+}
+
+size_t Doorbell::MaxQueueDepth() const
+{
+    return m_MaxQueueDepth.load(std::memory_order_relaxed);
+}
+
+void Doorbell::Run()
+{
+    if (m_RealTime.priority > 0 || m_RealTime.cpu >= 0)
+    {
+        Metrics::Global().ringThreadRealTime.Set(RealTime::ApplyToThread(m_RealTime, "ring") ? 1 : 0);
+    }
+
+    // Anything queued before a stop is still handled; the ring it starts is cut short when the players go
+    DrainQueue();
+    if (m_Running)
+    {
+        m_RingLoop.Run();
+    }
+}
+
+void Doorbell::DrainQueue()
+{
+    uint64_t wakes = 0;
+    while (read(m_WakeHandle, &wakes, sizeof(wakes)) == sizeof(wakes))
+    {
+    }
+
+    {
+        RcuSnapshot<Actions>::ReadGuard const actions(m_Actions);
+        m_GuardedActions = &*actions;
+        Press press;
+        while (m_Queue->TryPop(press))
+        {
+            uint32_t const presses = m_PendingPresses[press.connectionId].exchange(0, std::memory_order_acq_rel);
+            HandlePresses(*actions, press, presses);
+        }
+        m_GuardedActions = nullptr;
+    }
+
+    if (!m_Running)
+    {
+        m_RingLoop.Stop();
+    }
+}
+
+void Doorbell::HandlePresses(Actions const& actions, Press const& press, uint32_t const presses)
+{
+    Metrics::Daemon& metrics = Metrics::Global();
+    Button* const button = m_Buttons.Find(press.connectionId);
+    if (button == nullptr || press.connectionId > actions.size())
+    {
+        metrics.pressesUnknownChannel.Increment(presses);
+        DOORBELLPI_LOG(LOG_NOTICE, "Ignoring press from unknown channel %u", press.connectionId);
+        return;
+    }
+
+    // The first press may start a ring; everything after it is folded into that ring or the one before
+    ButtonAction const& action = actions[press.connectionId - 1];
+    auto const now = std::chrono::steady_clock::now();
+    bool const cooling = button->lastRing != std::chrono::steady_clock::time_point() && now - button->lastRing < action.cooldown;
+    bool rang = false;
+    if (!cooling && !button->output->player->IsPlaying())
+    {
+        // #ToDo: Select ring based upon time of day/night
+        rang = StartRing(press.connectionId, action, *button, false, press.readableTime);
+    }
+
+    Journal::Outcome const outcome = rang ? Journal::Outcome::Rang : cooling ? Journal::Outcome::Cooldown : Journal::Outcome::Busy;
+    // A ring is timed to when it started playing, as StartRing took it, rather than to when the press was handled
+    Record(press.connectionId, outcome, &press, presses, rang ? action.pattern.get() : nullptr, rang ? button->lastRing : now);
+
+    uint32_t const folded = rang ? presses - 1 : presses;
+    if (folded == 0)
+    {
+        return;
+    }
+
+    if (cooling)
+    {
+        metrics.pressesCooldown.Increment(folded);
+    }
+    else
+    {
+        metrics.pressesBusy.Increment(folded);
+    }
+    DOORBELLPI_LOG(LOG_INFO, "Folding %u presses on channel %u into the ring before", folded, press.connectionId);
+
+    button->foldedPresses += folded;
+    if (action.escalation && !button->escalated && button->foldedPresses >= action.escalationPresses)
+    {
+        button->escalated = true;
+        if (button->output->player->IsPlaying())
+        {
+            button->output->pendingEscalation = press.connectionId;
+        }
+        else
+        {
+            StartRing(press.connectionId, action, *button, true, std::chrono::steady_clock::time_point());
+        }
+    }
+}
+
+bool Doorbell::StartRing(Flic::ConnectionId const connectionId, ButtonAction const& action, Button& button, bool const escalation, std::chrono::steady_clock::time_point const readableTime)
+{
+    Metrics::Daemon& metrics = Metrics::Global();
+    if (readableTime != std::chrono::steady_clock::time_point())
+    {
+        metrics.readableToScheduled.Record(std::chrono::steady_clock::now() - readableTime);
+    }
+
+    if (!button.output->player->Play(escalation ? action.escalation : action.pattern, readableTime))
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Failed to start a ring on channel %u", connectionId);
+        return false;
+    }
+
+    // An escalation restarts the cooldown but can't escalate again
+    button.lastRing = std::chrono::steady_clock::now();
+    button.foldedPresses = 0;
+    button.escalated = escalation;
+    if (escalation)
+    {
+        Record(connectionId, Journal::Outcome::Escalated, nullptr, 0, action.escalation.get(), button.lastRing);
+        metrics.ringsEscalated.Increment();
+        DOORBELLPI_LOG(LOG_NOTICE, "Escalating the ring on channel %u", connectionId);
+        return true;
+    }
+
+    metrics.rings.Increment();
+    if (m_RingHandler)
+    {
+        Flic::ButtonAddress const* const buttonAddress = m_Buttons.FindAddress(connectionId);
+        if (buttonAddress != nullptr)
+        {
+            m_RingHandler(*buttonAddress);
+        }
+    }
+
+    return true;
+}
+
+void Doorbell::OnRingFinished(Output& output)
+{
+    Flic::ConnectionId const connectionId = output.pendingEscalation;
+    output.pendingEscalation = Flic::c_InvalidConnectionId;
+
+    if (connectionId == Flic::c_InvalidConnectionId)
+    {
+        return;
+    }
+
+    // The escalation is whatever the button has now, which may have changed since it was due. A ring that couldn't
+    // be started, or took no time, finishes inside DrainQueue's guard, whose actions are used rather than taking
+    // another
+    if (m_GuardedActions != nullptr)
+    {
+        StartEscalation(*m_GuardedActions, connectionId);
+        return;
+    }
+
+    RcuSnapshot<Actions>::ReadGuard const actions(m_Actions);
+    StartEscalation(*actions, connectionId);
+}
+
+void Doorbell::StartEscalation(Actions const& actions, Flic::ConnectionId const connectionId)
+{
+    Button* const button = m_Buttons.Find(connectionId);
+    if (button != nullptr && connectionId <= actions.size() && actions[connectionId - 1].escalation)
+    {
+        StartRing(connectionId, actions[connectionId - 1], *button, true, std::chrono::steady_clock::time_point());
+    }
+}
+
+void Doorbell::Record(Flic::ConnectionId const connectionId, Journal::Outcome const outcome, Press const* press, uint32_t const presses, Rings::Timeline const* pattern, std::chrono::steady_clock::time_point const scheduledTime)
+{
+    if (m_Journal == nullptr)
+    {
+        return;
+    }
+
+    // Saturating, so a latency too long to fit is still obviously long
+    auto const nanoseconds = [](std::chrono::steady_clock::duration const duration)
+    {
+        int64_t const count = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        return static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(count, 0), UINT32_MAX));
+    };
+
+    // The journal is in wall clock time, so the steady time the press was read is carried over to it
+    auto const now = std::chrono::steady_clock::now();
+    auto const readableTime = press != nullptr ? press->readableTime : scheduledTime;
+    auto const wallTime = std::chrono::system_clock::now() - std::chrono::duration_cast<std::chrono::system_clock::duration>(now - readableTime);
+
+    Journal::Record record = {};
+    record.time = std::chrono::duration_cast<std::chrono::microseconds>(wallTime.time_since_epoch()).count();
+    Flic::ButtonAddress const* const buttonAddress = m_Buttons.FindAddress(connectionId);
+    if (buttonAddress != nullptr)
+    {
+        memcpy(record.buttonAddress, buttonAddress->addr, sizeof(record.buttonAddress));
+    }
+    record.clickType = FlicClientProtocol::ButtonDown;
+    record.outcome = outcome;
+    record.presses = presses;
+    if (press != nullptr)
+    {
+        record.timeDiff = press->timeDiff;
+        record.decodeLatency = nanoseconds(press->decodedTime - press->readableTime);
+        record.ringLatency = pattern != nullptr ? nanoseconds(scheduledTime - press->readableTime) : 0;
+    }
+    if (pattern != nullptr)
+    {
+        Journal::SetPattern(record, pattern->name);
+    }
+
+    if (!m_Journal->Append(record))
+    {
+        Metrics::Global().journalFailures.Increment();
+    }
+}
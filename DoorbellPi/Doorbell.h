@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "EventLoop.h"
+#include "FlicChannelTable.h"
+#include "Gpio.h"
+#include "Journal.h"
+#include "RcuSnapshot.h"
+#include "RealTime.h"
+#include "Rings.h"
+#include "SpscQueue.h"
+
+// What pressing a particular button does
+struct ButtonAction
+{
+    std::vector<int> outputPins;
+    std::shared_ptr<Rings::Timeline const> pattern;
+    // Presses within this long of a ring starting, or while it's still playing, are folded into it
+    std::chrono::milliseconds cooldown;
+    // Optional. Once escalationPresses presses have been folded into a ring, this plays straight after it, once
+    std::shared_ptr<Rings::Timeline const> escalation = nullptr;
+    uint32_t escalationPresses = 3;
+};
+
+// Routes presses from any number of buttons to their actions, and plays the rings on a thread of its own so that
+// they keep time whatever the event loop is doing. OnPress only bumps the button's count of pending presses and, if
+// it was zero, pushes the button onto a lock free queue, so however fast a button is mashed the queue never holds
+// more than one entry per button. The ring thread applies the cooldown, folds extra presses into the ring already
+// playing and escalates when there are enough of them. The lookup from conn_id to action is O(1), so the cost of
+// handling a press doesn't depend on how many buttons are configured. The actions are an immutable snapshot that can
+// be replaced while running, without a lock on the ring thread or cutting short a ring that's already playing
+class Doorbell
+{
+public:
+    // Called on the ring thread once a ring (but not an escalation) has started, so must not block
+    using RingHandler = std::function<void(Flic::ButtonAddress const& buttonAddress)>;
+
+    explicit Doorbell(Gpio::Backend& gpio);
+    ~Doorbell();
+
+    Doorbell(Doorbell const&) = delete;
+    Doorbell& operator=(Doorbell const&) = delete;
+
+    // Returns the conn_id to create the button's channel with, or c_InvalidConnectionId if it was already added or
+    // none of its output pins were requested from the GPIO backend. Buttons can only be added before starting
+    Flic::ConnectionId AddButton(Flic::ButtonAddress const& buttonAddress, ButtonAction action);
+
+    void SetRingHandler(RingHandler handler);
+
+    // c_InvalidConnectionId if the button hasn't been added
+    Flic::ConnectionId FindButton(Flic::ButtonAddress const& buttonAddress) const;
+
+    // Replaces every button's action at once. Only the patterns, cooldowns and escalations can change while running:
+    // returns false, and keeps the actions as they were, if the buttons aren't the ones already added or any of
+    // their output pins differ. Only to be called from the thread that added the buttons
+    bool Reconfigure(std::unordered_map<Flic::ButtonAddress, ButtonAction> const& actions);
+
+    // Has to be called after any signals are blocked, as it starts the ring thread. The queue between the event loop
+    // and the ring thread is sized for the buttons added by then, and presses before starting are ignored
+    bool Start();
+    // Any ring in progress is cut short
+    void Stop();
+
+    // Optional, and only before starting. Every batch of presses the ring thread handles, and every escalation, is
+    // appended to it from the ring thread
+    void SetJournal(Journal::Writer* journal);
+
+    // Optional, and only before starting. The ring thread applies it to itself as it starts
+    void SetRealTime(RealTime::ThreadPolicy const& policy);
+
+    // Only to be called from one thread (the event loop). readableTime is when the press arrived, for measuring how
+    // long it took to ring, and timeDiff how old flicd said it was
+    void OnPress(Flic::ConnectionId const connectionId, std::chrono::steady_clock::time_point const readableTime, uint32_t const timeDiff = 0);
+
+    // The most presses that have been waiting for the ring thread at once
+    size_t MaxQueueDepth() const;
+
+private:
+    struct Press
+    {
+        Flic::ConnectionId connectionId;
+        uint32_t timeDiff;
+        std::chrono::steady_clock::time_point readableTime;
+        std::chrono::steady_clock::time_point decodedTime;
+    };
+
+    struct Output
+    {
+        std::unique_ptr<Rings::Player> player;
+        // The button whose escalation is waiting for the current ring to finish
+        Flic::ConnectionId pendingEscalation;
+    };
+
+    // Indexed by conn_id - 1
+    using Actions = std::vector<ButtonAction>;
+
+    // Only touched by the ring thread once started
+    struct Button
+    {
+        Output* output;
+        std::chrono::steady_clock::time_point lastRing;
+        // Presses folded into the current ring, and whether it has escalated yet
+        uint32_t foldedPresses;
+        bool escalated;
+    };
+
+    // All on the ring thread
+    void Run();
+    void DrainQueue();
+    void HandlePresses(Actions const& actions, Press const& press, uint32_t const presses);
+    bool StartRing(Flic::ConnectionId const connectionId, ButtonAction const& action, Button& button, bool const escalation, std::chrono::steady_clock::time_point const readableTime);
+    void Record(Flic::ConnectionId const connectionId, Journal::Outcome const outcome, Press const* press, uint32_t const presses, Rings::Timeline const* pattern, std::chrono::steady_clock::time_point const scheduledTime);
+    void OnRingFinished(Output& output);
+    void StartEscalation(Actions const& actions, Flic::ConnectionId const connectionId);
+
+    Gpio::Backend& m_Gpio;
+    // Declared before the players, which use it, so that it outlives them
+    EventLoop m_RingLoop;
+    Flic::ChannelTable<Button> m_Buttons;
+    std::map<Gpio::LineMask, Output> m_Outputs;
+    RingHandler m_RingHandler;
+    Journal::Writer* m_Journal = nullptr;
+    RealTime::ThreadPolicy m_RealTime;
+    // Written by the thread that adds the buttons, read by the ring thread
+    RcuSnapshot<Actions> m_Actions;
+    // The ring thread's view of the actions while DrainQueue holds its guard. A ring can finish inside that guard,
+    // and guards can't be nested
+    Actions const* m_GuardedActions = nullptr;
+
+    // Shared between the event loop and the ring thread, and only replaced while the ring thread isn't running.
+    // Pending presses are indexed by conn_id
+    std::unique_ptr<SpscQueue<Press>> m_Queue;
+    std::vector<std::atomic<uint32_t>> m_PendingPresses;
+    std::atomic<size_t> m_MaxQueueDepth{ 0 };
+    std::atomic<bool> m_Running{ false };
+    int m_WakeHandle = -1;
+    std::thread m_Thread;
+};
@@ -0,0 +1,237 @@
+#include "EventLoop.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace
+{
+    int const c_MaxEventsPerWait = 16;
+}
+
+EventLoop::EventLoop()
+{
+    m_EpollHandle = epoll_create1(EPOLL_CLOEXEC);
+    if (m_EpollHandle < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to create epoll instance [%s]", strerror(errno));
+        m_EpollHandle = c_InvalidHandle;
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    for (auto const& entry : m_Handlers)
+    {
+        epoll_ctl(m_EpollHandle, EPOLL_CTL_DEL, entry.first, nullptr);
+    }
+    m_Handlers.clear();
+
+    if (m_SignalHandle != c_InvalidHandle)
+    {
+        close(m_SignalHandle);
+    }
+
+    if (m_EpollHandle != c_InvalidHandle)
+    {
+        close(m_EpollHandle);
+    }
+}
+
+bool EventLoop::IsValid() const
+{
+    return m_EpollHandle != c_InvalidHandle;
+}
+
+bool EventLoop::AddDescriptor(int fileDescriptor, uint32_t events, ReadyHandler handler)
+{
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fileDescriptor;
+
+    int const operation = m_Handlers.count(fileDescriptor) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(m_EpollHandle, operation, fileDescriptor, &event) < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to watch descriptor %d [%s]", fileDescriptor, strerror(errno));
+        return false;
+    }
+
+    m_Handlers[fileDescriptor] = std::make_shared<ReadyHandler>(std::move(handler));
+    return true;
+}
+
+void EventLoop::RemoveDescriptor(int fileDescriptor)
+{
+    auto const handler = m_Handlers.find(fileDescriptor);
+    if (handler != m_Handlers.end())
+    {
+        epoll_ctl(m_EpollHandle, EPOLL_CTL_DEL, fileDescriptor, nullptr);
+        m_Handlers.erase(handler);
+    }
+}
+
+int EventLoop::CreateTimer(TimerHandler handler)
+{
+    int const timerHandle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerHandle < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to create timer [%s]", strerror(errno));
+        return c_InvalidHandle;
+    }
+
+    bool const added = AddDescriptor(timerHandle, EPOLLIN, [timerHandle, handler](uint32_t)
+    {
+        // Drain the expiry count, otherwise the descriptor stays readable
+        uint64_t expirations = 0;
+        if (read(timerHandle, &expirations, sizeof(expirations)) == sizeof(expirations))
+        {
+            handler();
+        }
+    });
+
+    if (!added)
+    {
+        close(timerHandle);
+        return c_InvalidHandle;
+    }
+
+    return timerHandle;
+}
+
+bool EventLoop::ArmTimer(int timerHandle, std::chrono::nanoseconds delay)
+{
+    // A zero it_value would disarm the timer, so round an immediate expiry up to the smallest interval
+    if (delay.count() <= 0)
+    {
+        delay = std::chrono::nanoseconds(1);
+    }
+
+    itimerspec timerSpec;
+    memset(&timerSpec, 0, sizeof(timerSpec));
+    timerSpec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(delay).count();
+    timerSpec.it_value.tv_nsec = (delay % std::chrono::seconds(1)).count();
+
+    return timerfd_settime(timerHandle, 0, &timerSpec, nullptr) == 0;
+}
+
+bool EventLoop::ArmTimerAt(int timerHandle, std::chrono::steady_clock::time_point deadline)
+{
+    // steady_clock is CLOCK_MONOTONIC, which the timers are created on. A deadline that has already passed fires
+    // immediately, but zero would disarm the timer
+    std::chrono::nanoseconds sinceEpoch = deadline.time_since_epoch();
+    if (sinceEpoch.count() <= 0)
+    {
+        sinceEpoch = std::chrono::nanoseconds(1);
+    }
+
+    itimerspec timerSpec;
+    memset(&timerSpec, 0, sizeof(timerSpec));
+    timerSpec.it_value.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch).count();
+    timerSpec.it_value.tv_nsec = (sinceEpoch % std::chrono::seconds(1)).count();
+
+    return timerfd_settime(timerHandle, TFD_TIMER_ABSTIME, &timerSpec, nullptr) == 0;
+}
+
+bool EventLoop::DisarmTimer(int timerHandle)
+{
+    itimerspec timerSpec;
+    memset(&timerSpec, 0, sizeof(timerSpec));
+
+    return timerfd_settime(timerHandle, 0, &timerSpec, nullptr) == 0;
+}
+
+void EventLoop::DestroyTimer(int timerHandle)
+{
+    RemoveDescriptor(timerHandle);
+    close(timerHandle);
+}
+
+bool EventLoop::HandleSignals(std::initializer_list<int> signalNumbers, SignalHandler handler)
+{
+    sigset_t signalMask;
+    sigemptyset(&signalMask);
+    for (int const signalNumber : signalNumbers)
+    {
+        sigaddset(&signalMask, signalNumber);
+    }
+
+    if (sigprocmask(SIG_BLOCK, &signalMask, nullptr) < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to block signals [%s]", strerror(errno));
+        return false;
+    }
+
+    int const signalHandle = signalfd(m_SignalHandle, &signalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalHandle < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to create signal descriptor [%s]", strerror(errno));
+        return false;
+    }
+
+    m_SignalHandler = std::move(handler);
+    if (m_SignalHandle == c_InvalidHandle)
+    {
+        m_SignalHandle = signalHandle;
+        return AddDescriptor(m_SignalHandle, EPOLLIN, [this](uint32_t) { OnSignalReady(); });
+    }
+
+    return true;
+}
+
+void EventLoop::Run()
+{
+    epoll_event events[c_MaxEventsPerWait];
+
+    m_Running = true;
+    while (m_Running)
+    {
+        int const eventCount = epoll_wait(m_EpollHandle, events, c_MaxEventsPerWait, -1);
+        if (eventCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            DOORBELLPI_LOG(LOG_ERR, "Failed waiting for events [%s]", strerror(errno));
+            break;
+        }
+
+        for (int eventIndex = 0; eventIndex < eventCount && m_Running; ++eventIndex)
+        {
+            auto const handler = m_Handlers.find(events[eventIndex].data.fd);
+            if (handler == m_Handlers.end())
+            {
+                // Removed by an earlier handler in this batch
+                continue;
+            }
+
+            std::shared_ptr<ReadyHandler> const keepAlive = handler->second;
+            (*keepAlive)(events[eventIndex].events);
+        }
+    }
+}
+
+void EventLoop::Stop()
+{
+    m_Running = false;
+}
+
+void EventLoop::OnSignalReady()
+{
+    signalfd_siginfo signalInfo;
+    while (read(m_SignalHandle, &signalInfo, sizeof(signalInfo)) == sizeof(signalInfo))
+    {
+        if (m_SignalHandler)
+        {
+            m_SignalHandler(static_cast<int>(signalInfo.ssi_signo));
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+
+// Single threaded epoll based event loop. File descriptors, timers (timerfd) and signals (signalfd) are all
+// multiplexed through one epoll instance so that no handler ever has to block waiting for another.
+class EventLoop
+{
+public:
+    using ReadyHandler = std::function<void(uint32_t events)>;
+    using TimerHandler = std::function<void()>;
+    using SignalHandler = std::function<void(int signalNumber)>;
+
+    static int const c_InvalidHandle = -1;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(EventLoop const&) = delete;
+    EventLoop& operator=(EventLoop const&) = delete;
+
+    bool IsValid() const;
+
+    // Watch a file descriptor. The handler is called with the epoll event mask whenever the descriptor is ready
+    bool AddDescriptor(int fileDescriptor, uint32_t events, ReadyHandler handler);
+    void RemoveDescriptor(int fileDescriptor);
+
+    // Timers are created once and then armed/disarmed as required. Returns c_InvalidHandle on failure
+    int CreateTimer(TimerHandler handler);
+    bool ArmTimer(int timerHandle, std::chrono::nanoseconds delay);
+    bool ArmTimerAt(int timerHandle, std::chrono::steady_clock::time_point deadline);
+    bool DisarmTimer(int timerHandle);
+    void DestroyTimer(int timerHandle);
+
+    // Route the given signals through the loop rather than asynchronous signal handlers. The signals are blocked
+    // for the calling thread, so this should be called before any other threads are started. Calling it again
+    // replaces both the set of signals and the handler
+    bool HandleSignals(std::initializer_list<int> signalNumbers, SignalHandler handler);
+
+    // Dispatch events until Stop() is called
+    void Run();
+    void Stop();
+
+private:
+    void OnSignalReady();
+
+    int m_EpollHandle = c_InvalidHandle;
+    int m_SignalHandle = c_InvalidHandle;
+    bool m_Running = false;
+    SignalHandler m_SignalHandler;
+    // Handlers are shared so that one can safely remove itself (or another) while it is being dispatched
+    std::unordered_map<int, std::shared_ptr<ReadyHandler>> m_Handlers;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Flic
+{
+    struct ButtonAddress 
+    {
+        static int const c_AddressLength = 6;
+        uint8_t addr[c_AddressLength];
+
+        ButtonAddress() 
+        {
+            memset(addr, 0, c_AddressLength);
+        }
+
+        ButtonAddress(const ButtonAddress& o) 
+        {
+            *this = o;
+        }
+
+        ButtonAddress(const uint8_t* a) 
+        {
+            *this = a;
+        }
+
+        ButtonAddress& operator=(const ButtonAddress& o) 
+        {
+            memcpy(addr, o.addr, c_AddressLength);
+            return *this;
+        }
+        ButtonAddress& operator=(const uint8_t* a) 
+        {
+            memcpy(addr, a, c_AddressLength);
+            return *this;
+        }
+
+        bool operator==(const ButtonAddress& o) const { return memcmp(addr, o.addr, c_AddressLength) == 0; }
+        bool operator!=(const ButtonAddress& o) const { return memcmp(addr, o.addr, c_AddressLength) != 0; }
+    };
+}
+
+namespace std
+{
+    template<>
+    struct hash<Flic::ButtonAddress>
+    {
+        size_t operator()(Flic::ButtonAddress const& address) const
+        {
+            // The six address bytes fit in one integer, then a multiplicative hash spreads them across the buckets
+            uint64_t packed = 0;
+            memcpy(&packed, address.addr, Flic::ButtonAddress::c_AddressLength);
+            uint64_t const mixed = packed * 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(mixed ^ (mixed >> 32));
+        }
+    };
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "FlicButtonAddress.h"
+
+namespace Flic
+{
+    // The conn_id used by flicd to identify a connection channel. Zero is never handed out
+    using ConnectionId = uint32_t;
+    static ConnectionId const c_InvalidConnectionId = 0;
+
+    // Allocates connection ids for buttons and maps them back to a per-button value. Ids are kept dense (freed ids
+    // are reused first), so looking up the value for an incoming event is a single vector index whatever the number
+    // of buttons, and looking up by address is one hash
+    template<typename Value>
+    class ChannelTable
+    {
+    public:
+        // Returns c_InvalidConnectionId if the button is already in the table
+        ConnectionId Add(ButtonAddress const& address, Value value)
+        {
+            if (m_ByAddress.count(address) != 0)
+            {
+                return c_InvalidConnectionId;
+            }
+
+            size_t slotIndex = m_Slots.size();
+            if (!m_FreeSlots.empty())
+            {
+                slotIndex = m_FreeSlots.back();
+                m_FreeSlots.pop_back();
+                m_Slots[slotIndex] = Slot{ true, address, std::move(value) };
+            }
+            else
+            {
+                m_Slots.push_back(Slot{ true, address, std::move(value) });
+            }
+
+            ConnectionId const connectionId = static_cast<ConnectionId>(slotIndex + 1);
+            m_ByAddress.emplace(address, connectionId);
+            return connectionId;
+        }
+
+        bool Remove(ConnectionId const connectionId)
+        {
+            Slot* const slot = FindSlot(connectionId);
+            if (slot == nullptr)
+            {
+                return false;
+            }
+
+            m_ByAddress.erase(slot->address);
+            *slot = Slot();
+            m_FreeSlots.push_back(connectionId - 1);
+            return true;
+        }
+
+        Value* Find(ConnectionId const connectionId)
+        {
+            Slot* const slot = FindSlot(connectionId);
+            return slot != nullptr ? &slot->value : nullptr;
+        }
+
+        Value const* Find(ConnectionId const connectionId) const
+        {
+            return const_cast<ChannelTable*>(this)->Find(connectionId);
+        }
+
+        ConnectionId Find(ButtonAddress const& address) const
+        {
+            auto const entry = m_ByAddress.find(address);
+            return entry != m_ByAddress.end() ? entry->second : c_InvalidConnectionId;
+        }
+
+        ButtonAddress const* FindAddress(ConnectionId const connectionId) const
+        {
+            Slot const* const slot = const_cast<ChannelTable*>(this)->FindSlot(connectionId);
+            return slot != nullptr ? &slot->address : nullptr;
+        }
+
+        // Calls function(ConnectionId, ButtonAddress const&, Value&) for every button
+        template<typename Function>
+        void ForEach(Function function)
+        {
+            for (size_t slotIndex = 0; slotIndex < m_Slots.size(); ++slotIndex)
+            {
+                if (m_Slots[slotIndex].used)
+                {
+                    function(static_cast<ConnectionId>(slotIndex + 1), m_Slots[slotIndex].address, m_Slots[slotIndex].value);
+                }
+            }
+        }
+
+        size_t Size() const
+        {
+            return m_ByAddress.size();
+        }
+
+    private:
+        struct Slot
+        {
+            bool used = false;
+            ButtonAddress address;
+            Value value = Value();
+        };
+
+        Slot* FindSlot(ConnectionId const connectionId)
+        {
+            size_t const slotIndex = static_cast<size_t>(connectionId) - 1;
+            if (connectionId == c_InvalidConnectionId || slotIndex >= m_Slots.size() || !m_Slots[slotIndex].used)
+            {
+                return nullptr;
+            }
+            return &m_Slots[slotIndex];
+        }
+
+        std::vector<Slot> m_Slots;
+        std::vector<size_t> m_FreeSlots;
+        std::unordered_map<ButtonAddress, ConnectionId> m_ByAddress;
+    };
+}
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+#include "FlicPacketReader.h"
+#include "external/flic/client_protocol_packets.h"
+
+namespace Flic
+{
+    // Compile time mapping between the flicd protocol opcodes and the packed structs in client_protocol_packets.h.
+    // Packets are validated against the wire size from the protocol specification before they are looked at, and
+    // decoding is a reinterpret in place on little endian hosts, or a copy and byte swap on big endian ones.
+    namespace Codec
+    {
+        enum class DispatchResult
+        {
+            Handled,
+            UnknownOpcode,
+            Truncated
+        };
+
+        template<uint8_t Opcode>
+        using EventTag = std::integral_constant<uint8_t, Opcode>;
+
+        // Events: opcode -> struct and the size of its fixed part on the wire
+        template<uint8_t Opcode>
+        struct Event;
+
+#define FLIC_CODEC_EVENT(opcode, type, wireSize) \
+        template<> \
+        struct Event<opcode> \
+        { \
+            using Type = FlicClientProtocol::type; \
+            static constexpr size_t c_WireSize = wireSize; \
+            static_assert(sizeof(Type) == c_WireSize, #type " does not match its wire size"); \
+        }
+
+        FLIC_CODEC_EVENT(EVT_ADVERTISEMENT_PACKET_OPCODE, EvtAdvertisementPacket, 31);
+        FLIC_CODEC_EVENT(EVT_CREATE_CONNECTION_CHANNEL_RESPONSE_OPCODE, EvtCreateConnectionChannelResponse, 7);
+        FLIC_CODEC_EVENT(EVT_CONNECTION_STATUS_CHANGED_OPCODE, EvtConnectionStatusChanged, 7);
+        FLIC_CODEC_EVENT(EVT_CONNECTION_CHANNEL_REMOVED_OPCODE, EvtConnectionChannelRemoved, 6);
+        FLIC_CODEC_EVENT(EVT_BUTTON_UP_OR_DOWN_OPCODE, EvtButtonEvent, 11);
+        FLIC_CODEC_EVENT(EVT_BUTTON_CLICK_OR_HOLD_OPCODE, EvtButtonEvent, 11);
+        FLIC_CODEC_EVENT(EVT_BUTTON_SINGLE_OR_DOUBLE_CLICK_OPCODE, EvtButtonEvent, 11);
+        FLIC_CODEC_EVENT(EVT_BUTTON_SINGLE_OR_DOUBLE_CLICK_OR_HOLD_OPCODE, EvtButtonEvent, 11);
+        FLIC_CODEC_EVENT(EVT_NEW_VERIFIED_BUTTON_OPCODE, EvtNewVerifiedButton, 7);
+        FLIC_CODEC_EVENT(EVT_GET_INFO_RESPONSE_OPCODE, EvtGetInfoResponse, 16);
+        FLIC_CODEC_EVENT(EVT_NO_SPACE_FOR_NEW_CONNECTION_OPCODE, EvtNoSpaceForNewConnection, 2);
+        FLIC_CODEC_EVENT(EVT_GOT_SPACE_FOR_NEW_CONNECTION_OPCODE, EvtGotSpaceForNewConnection, 2);
+        FLIC_CODEC_EVENT(EVT_BLUETOOTH_CONTROLLER_STATE_CHANGE_OPCODE, EvtBluetoothControllerStateChange, 2);
+        FLIC_CODEC_EVENT(EVT_PING_RESPONSE_OPCODE, EvtPingResponse, 5);
+        FLIC_CODEC_EVENT(EVT_GET_BUTTON_INFO_RESPONSE_OPCODE, EvtGetButtonInfoResponse, 40);
+        FLIC_CODEC_EVENT(EVT_SCAN_WIZARD_FOUND_PRIVATE_BUTTON_OPCODE, EvtScanWizardFoundPrivateButton, 5);
+        FLIC_CODEC_EVENT(EVT_SCAN_WIZARD_FOUND_PUBLIC_BUTTON_OPCODE, EvtScanWizardFoundPublicButton, 28);
+        FLIC_CODEC_EVENT(EVT_SCAN_WIZARD_BUTTON_CONNECTED_OPCODE, EvtScanWizardButtonConnected, 5);
+        FLIC_CODEC_EVENT(EVT_SCAN_WIZARD_COMPLETED_OPCODE, EvtScanWizardCompleted, 6);
+        FLIC_CODEC_EVENT(EVT_BUTTON_DELETED_OPCODE, EvtButtonDeleted, 8);
+        FLIC_CODEC_EVENT(EVT_BATTERY_STATUS_OPCODE, EvtBatteryStatus, 14);
+
+#undef FLIC_CODEC_EVENT
+
+        static constexpr size_t c_EventOpcodeCount = EVT_BATTERY_STATUS_OPCODE + 1;
+        static constexpr size_t c_LatencyModeCount = FlicClientProtocol::HighLatency + 1;
+
+        // Commands: struct -> opcode and the size on the wire
+        template<typename Type>
+        struct Command;
+
+#define FLIC_CODEC_COMMAND(opcode, type, wireSize) \
+        template<> \
+        struct Command<FlicClientProtocol::type> \
+        { \
+            static constexpr uint8_t c_Opcode = opcode; \
+            static constexpr size_t c_WireSize = wireSize; \
+            static_assert(sizeof(FlicClientProtocol::type) == c_WireSize, #type " does not match its wire size"); \
+        }
+
+        FLIC_CODEC_COMMAND(CMD_GET_INFO_OPCODE, CmdGetInfo, 1);
+        FLIC_CODEC_COMMAND(CMD_CREATE_SCANNER_OPCODE, CmdCreateScanner, 5);
+        FLIC_CODEC_COMMAND(CMD_REMOVE_SCANNER_OPCODE, CmdRemoveScanner, 5);
+        FLIC_CODEC_COMMAND(CMD_CREATE_CONNECTION_CHANNEL_OPCODE, CmdCreateConnectionChannel, 14);
+        FLIC_CODEC_COMMAND(CMD_REMOVE_CONNECTION_CHANNEL_OPCODE, CmdRemoveConnectionChannel, 5);
+        FLIC_CODEC_COMMAND(CMD_FORCE_DISCONNECT_OPCODE, CmdForceDisconnect, 7);
+        FLIC_CODEC_COMMAND(CMD_CHANGE_MODE_PARAMETERS_OPCODE, CmdChangeModeParameters, 8);
+        FLIC_CODEC_COMMAND(CMD_PING_OPCODE, CmdPing, 5);
+        FLIC_CODEC_COMMAND(CMD_GET_BUTTON_INFO_OPCODE, CmdGetButtonInfo, 7);
+        FLIC_CODEC_COMMAND(CMD_CREATE_SCAN_WIZARD_OPCODE, CmdCreateScanWizard, 5);
+        FLIC_CODEC_COMMAND(CMD_CANCEL_SCAN_WIZARD_OPCODE, CmdCancelScanWizard, 5);
+        FLIC_CODEC_COMMAND(CMD_DELETE_BUTTON_OPCODE, CmdDeleteButton, 7);
+        FLIC_CODEC_COMMAND(CMD_CREATE_BATTERY_STATUS_LISTENER_OPCODE, CmdCreateBatteryStatusListener, 11);
+        FLIC_CODEC_COMMAND(CMD_REMOVE_BATTERY_STATUS_LISTENER_OPCODE, CmdRemoveBatteryStatusListener, 5);
+
+#undef FLIC_CODEC_COMMAND
+
+        static constexpr bool c_IsLittleEndianHost = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+        // Byte swapping of the multi-byte fields, only used on big endian hosts. Single byte structs need nothing.
+        // Fields are packed, so they are swapped by value rather than through references
+        inline uint16_t Swapped(uint16_t value) { return __builtin_bswap16(value); }
+        inline int16_t Swapped(int16_t value) { return static_cast<int16_t>(__builtin_bswap16(static_cast<uint16_t>(value))); }
+        inline uint32_t Swapped(uint32_t value) { return __builtin_bswap32(value); }
+        inline int64_t Swapped(int64_t value) { return static_cast<int64_t>(__builtin_bswap64(static_cast<uint64_t>(value))); }
+
+        template<typename Type>
+        void SwapFields(Type&) {}
+
+        inline void SwapFields(FlicClientProtocol::EvtAdvertisementPacket& packet) { packet.scan_id = Swapped(packet.scan_id); }
+        inline void SwapFields(FlicClientProtocol::EvtCreateConnectionChannelResponse& packet) { packet.base.conn_id = Swapped(packet.base.conn_id); }
+        inline void SwapFields(FlicClientProtocol::EvtConnectionStatusChanged& packet) { packet.base.conn_id = Swapped(packet.base.conn_id); }
+        inline void SwapFields(FlicClientProtocol::EvtConnectionChannelRemoved& packet) { packet.base.conn_id = Swapped(packet.base.conn_id); }
+        inline void SwapFields(FlicClientProtocol::EvtButtonEvent& packet) { packet.base.conn_id = Swapped(packet.base.conn_id); packet.time_diff = Swapped(packet.time_diff); }
+        inline void SwapFields(FlicClientProtocol::EvtGetInfoResponse& packet) { packet.max_concurrently_connected_buttons = Swapped(packet.max_concurrently_connected_buttons); packet.nb_verified_buttons = Swapped(packet.nb_verified_buttons); }
+        inline void SwapFields(FlicClientProtocol::EvtPingResponse& packet) { packet.ping_id = Swapped(packet.ping_id); }
+        inline void SwapFields(FlicClientProtocol::EvtScanWizardFoundPrivateButton& packet) { packet.base.scan_wizard_id = Swapped(packet.base.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::EvtScanWizardFoundPublicButton& packet) { packet.base.scan_wizard_id = Swapped(packet.base.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::EvtScanWizardButtonConnected& packet) { packet.base.scan_wizard_id = Swapped(packet.base.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::EvtScanWizardCompleted& packet) { packet.base.scan_wizard_id = Swapped(packet.base.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::EvtBatteryStatus& packet) { packet.listener_id = Swapped(packet.listener_id); packet.timestamp = Swapped(packet.timestamp); }
+
+        inline void SwapFields(FlicClientProtocol::CmdCreateScanner& packet) { packet.scan_id = Swapped(packet.scan_id); }
+        inline void SwapFields(FlicClientProtocol::CmdRemoveScanner& packet) { packet.scan_id = Swapped(packet.scan_id); }
+        inline void SwapFields(FlicClientProtocol::CmdCreateConnectionChannel& packet) { packet.conn_id = Swapped(packet.conn_id); packet.auto_disconnect_time = Swapped(packet.auto_disconnect_time); }
+        inline void SwapFields(FlicClientProtocol::CmdRemoveConnectionChannel& packet) { packet.conn_id = Swapped(packet.conn_id); }
+        inline void SwapFields(FlicClientProtocol::CmdChangeModeParameters& packet) { packet.conn_id = Swapped(packet.conn_id); packet.auto_disconnect_time = Swapped(packet.auto_disconnect_time); }
+        inline void SwapFields(FlicClientProtocol::CmdPing& packet) { packet.ping_id = Swapped(packet.ping_id); }
+        inline void SwapFields(FlicClientProtocol::CmdCreateScanWizard& packet) { packet.scan_wizard_id = Swapped(packet.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::CmdCancelScanWizard& packet) { packet.scan_wizard_id = Swapped(packet.scan_wizard_id); }
+        inline void SwapFields(FlicClientProtocol::CmdCreateBatteryStatusListener& packet) { packet.listener_id = Swapped(packet.listener_id); }
+        inline void SwapFields(FlicClientProtocol::CmdRemoveBatteryStatusListener& packet) { packet.listener_id = Swapped(packet.listener_id); }
+
+        // Returns nullptr if the packet is too short. On little endian hosts the result points into the packet and
+        // storage is untouched; otherwise the packet is copied into storage and converted to host order
+        template<uint8_t Opcode>
+        typename Event<Opcode>::Type const* Decode(PacketView const& packet, typename Event<Opcode>::Type& storage)
+        {
+            using Type = typename Event<Opcode>::Type;
+
+            if (packet.length < Event<Opcode>::c_WireSize || packet.data[0] != Opcode)
+            {
+                return nullptr;
+            }
+
+            if constexpr (c_IsLittleEndianHost)
+            {
+                return reinterpret_cast<Type const*>(packet.data);
+            }
+            else
+            {
+                memcpy(&storage, packet.data, sizeof(Type));
+                SwapFields(storage);
+                return &storage;
+            }
+        }
+
+        // Encodes a command including its length prefix. The buffer must hold c_EncodedSize<Type> bytes
+        template<typename Type>
+        static constexpr size_t c_EncodedSize = PacketReader::c_LengthPrefixSize + Command<Type>::c_WireSize;
+
+        template<typename Type>
+        size_t Encode(Type const& command, uint8_t* buffer)
+        {
+            static_assert(Command<Type>::c_WireSize <= PacketReader::c_MaxPacketLength, "Command too large to frame");
+
+            buffer[0] = static_cast<uint8_t>(Command<Type>::c_WireSize & 0xff);
+            buffer[1] = static_cast<uint8_t>(Command<Type>::c_WireSize >> 8);
+
+            if constexpr (c_IsLittleEndianHost)
+            {
+                memcpy(buffer + PacketReader::c_LengthPrefixSize, &command, sizeof(Type));
+            }
+            else
+            {
+                Type swapped(command);
+                SwapFields(swapped);
+                memcpy(buffer + PacketReader::c_LengthPrefixSize, &swapped, sizeof(Type));
+            }
+
+            return c_EncodedSize<Type>;
+        }
+
+        // The flicd side of the protocol, for stand-ins such as tools/FakeFlicd: decoding commands and encoding events.
+        // Like Decode(), returns nullptr if the packet is too short or isn't a Type
+        template<typename Type>
+        Type const* DecodeCommand(PacketView const& packet, Type& storage)
+        {
+            if (packet.length < Command<Type>::c_WireSize || packet.data[0] != Command<Type>::c_Opcode)
+            {
+                return nullptr;
+            }
+
+            if constexpr (c_IsLittleEndianHost)
+            {
+                return reinterpret_cast<Type const*>(packet.data);
+            }
+            else
+            {
+                memcpy(static_cast<void*>(&storage), packet.data, sizeof(Type));
+                SwapFields(storage);
+                return &storage;
+            }
+        }
+
+        template<uint8_t Opcode>
+        static constexpr size_t c_EncodedEventSize = PacketReader::c_LengthPrefixSize + Event<Opcode>::c_WireSize;
+
+        // Several opcodes share a struct, so the opcode is given explicitly and written over the struct's own
+        template<uint8_t Opcode>
+        size_t EncodeEvent(typename Event<Opcode>::Type const& event, uint8_t* buffer)
+        {
+            using Type = typename Event<Opcode>::Type;
+
+            buffer[0] = static_cast<uint8_t>(Event<Opcode>::c_WireSize & 0xff);
+            buffer[1] = static_cast<uint8_t>(Event<Opcode>::c_WireSize >> 8);
+
+            if constexpr (c_IsLittleEndianHost)
+            {
+                memcpy(buffer + PacketReader::c_LengthPrefixSize, &event, sizeof(Type));
+            }
+            else
+            {
+                Type swapped(event);
+                SwapFields(swapped);
+                memcpy(buffer + PacketReader::c_LengthPrefixSize, &swapped, sizeof(Type));
+            }
+            buffer[PacketReader::c_LengthPrefixSize] = Opcode;
+
+            return c_EncodedEventSize<Opcode>;
+        }
+
+        // Handlers can derive from this to silently ignore any event they don't provide an OnEvent() for. They need
+        // a "using IgnoreEvents::OnEvent;" so that their own overloads don't hide this one
+        struct IgnoreEvents
+        {
+            template<uint8_t Opcode, typename Type>
+            void OnEvent(EventTag<Opcode>, Type const&)
+            {
+            }
+        };
+
+        // Dispatches packets to Handler::OnEvent(EventTag<Opcode>, Type const&) through a jump table generated at
+        // compile time, with one entry per event opcode
+        template<typename Handler>
+        class Dispatcher
+        {
+        public:
+            static DispatchResult Dispatch(Handler& handler, PacketView const& packet)
+            {
+                uint8_t const opcode = packet.data[0];
+                if (opcode >= c_EventOpcodeCount)
+                {
+                    return DispatchResult::UnknownOpcode;
+                }
+
+                return c_JumpTable[opcode](handler, packet);
+            }
+
+        private:
+            using Entry = DispatchResult (*)(Handler&, PacketView const&);
+
+            template<uint8_t Opcode>
+            static DispatchResult Invoke(Handler& handler, PacketView const& packet)
+            {
+                typename Event<Opcode>::Type storage;
+                auto const* const decoded = Decode<Opcode>(packet, storage);
+                if (decoded == nullptr)
+                {
+                    return DispatchResult::Truncated;
+                }
+
+                handler.OnEvent(EventTag<Opcode>(), *decoded);
+                return DispatchResult::Handled;
+            }
+
+            template<size_t... Opcodes>
+            static constexpr std::array<Entry, sizeof...(Opcodes)> MakeJumpTable(std::index_sequence<Opcodes...>)
+            {
+                return {{ &Invoke<static_cast<uint8_t>(Opcodes)>... }};
+            }
+
+            static constexpr std::array<Entry, c_EventOpcodeCount> c_JumpTable = MakeJumpTable(std::make_index_sequence<c_EventOpcodeCount>());
+        };
+    }
+}
@@ -0,0 +1,783 @@
+#include "FlicConnection.h"
+
+#include "EventLoop.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "Resolver.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    // flicd removing a channel, or failing to create it, is retried after this, doubling up to the maximum
+    std::chrono::milliseconds const c_ChannelRetryDelay = std::chrono::milliseconds(500);
+    std::chrono::milliseconds const c_MaxChannelRetryDelay = std::chrono::seconds(60);
+    // How long a button stays connected to flicd after its last event, in seconds
+    int16_t const c_AutoDisconnectTime = 5;
+    size_t const c_NoChannel = static_cast<size_t>(-1);
+    // Commands flicd hasn't taken yet. Far more than creating every channel at once needs; if flicd gets this far
+    // behind it isn't reading
+    size_t const c_MaxUnsentBytes = 256 * 1024;
+
+    Flic::Connection::ChannelState ToChannelState(FlicClientProtocol::ConnectionStatus const connectionStatus)
+    {
+        switch (connectionStatus)
+        {
+        case FlicClientProtocol::Connected: return Flic::Connection::ChannelState::Connected;
+        case FlicClientProtocol::Ready: return Flic::Connection::ChannelState::Ready;
+        default: return Flic::Connection::ChannelState::Disconnected;
+        }
+    }
+}
+
+namespace Flic
+{
+    Connection::Connection(EventLoop& eventLoop)
+        : m_EventLoop(eventLoop)
+    {
+        m_RetryTimer = m_EventLoop.CreateTimer([this]() { OnRetryTimer(); });
+        m_PingTimer = m_EventLoop.CreateTimer([this]() { OnPingTimer(); });
+    }
+
+    Connection::~Connection()
+    {
+        m_RingHandler = nullptr;
+        m_DisconnectHandler = nullptr;
+        Disconnect();
+
+        if (m_RetryTimer != c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_RetryTimer);
+        }
+
+        if (m_PingTimer != c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_PingTimer);
+        }
+    }
+
+    bool Connection::Connect(std::string const& hostname, in_port_t const port, RingHandler onRing, DisconnectHandler onDisconnect)
+    {
+        Resolver::Addresses addresses;
+        if (!Resolver::ResolveNow(hostname, port, addresses))
+        {
+            return false;
+        }
+
+        for (Resolver::Address const& address : addresses)
+        {
+            int const socketHandle = socket(address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (socketHandle < 0)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Failed to create socket [%s]", GetErrorCodeString().c_str());
+                continue;
+            }
+
+            if (connect(socketHandle, reinterpret_cast<sockaddr const*>(&address.storage), address.length) == 0)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Connected to '%s:%d'", hostname.c_str(), port);
+                return Attach(socketHandle, std::move(onRing), std::move(onDisconnect));
+            }
+
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to connect to '%s:%d' [%s]", hostname.c_str(), port, GetErrorCodeString().c_str());
+            close(socketHandle);
+        }
+
+        return false;
+    }
+
+    bool Connection::Attach(int const socketHandle, RingHandler onRing, DisconnectHandler onDisconnect)
+    {
+        Close();
+
+        // From here on the socket is only ever read when the event loop reports it as readable
+        int const socketFlags = fcntl(socketHandle, F_GETFL, 0);
+        if (socketFlags < 0 || fcntl(socketHandle, F_SETFL, socketFlags | O_NONBLOCK) < 0)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to make socket non-blocking [%s]", GetErrorCodeString().c_str());
+            close(socketHandle);
+            return false;
+        }
+
+        if (!m_EventLoop.AddDescriptor(socketHandle, EPOLLIN | EPOLLRDHUP, [this](uint32_t events) { OnReady(events); }))
+        {
+            close(socketHandle);
+            return false;
+        }
+
+        m_SocketHandle = socketHandle;
+        m_PacketReader.Reset();
+
+        // The controller's state comes back in the response, and changes to it are sent to every client unasked
+        FlicClientProtocol::CmdGetInfo infoCmd;
+        if (!WriteCommand(infoCmd))
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Error %d sending CmdGetInfo", errno);
+            Close();
+            return false;
+        }
+
+        for (Channel& channel : m_Channels)
+        {
+            channel.failures = 0;
+            if (!CreateChannel(channel, true))
+            {
+                Close();
+                return false;
+            }
+        }
+
+        m_RingHandler = std::move(onRing);
+        m_DisconnectHandler = std::move(onDisconnect);
+
+        m_PingOutstanding = false;
+        m_MissedPings = 0;
+        if (m_PingInterval.count() > 0)
+        {
+            m_EventLoop.ArmTimer(m_PingTimer, m_PingInterval);
+        }
+
+        Metrics::Daemon& metrics = Metrics::Global();
+        metrics.connections.Increment();
+        if (m_HasConnected)
+        {
+            metrics.reconnects.Increment();
+        }
+        m_HasConnected = true;
+        return true;
+    }
+
+    bool Connection::IsConnected() const
+    {
+        return m_SocketHandle != c_InvalidHandle;
+    }
+
+    void Connection::Disconnect()
+    {
+        if (m_SocketHandle != c_InvalidHandle)
+        {
+            for (Channel const& channel : m_Channels)
+            {
+                DestroyChannel(channel.connectionId);
+            }
+
+            Close();
+        }
+    }
+
+    bool Connection::AddChannel(ConnectionId const connectionId, ButtonAddress const& buttonAddress)
+    {
+        if (FindChannel(connectionId) != nullptr)
+        {
+            return false;
+        }
+
+        m_Channels.push_back(Channel{ connectionId, buttonAddress, ChannelState::Closed, 0, std::chrono::steady_clock::time_point() });
+        if (connectionId >= m_LatencyModes.size())
+        {
+            m_LatencyModes.resize(connectionId + 1, FlicClientProtocol::NormalLatency);
+            m_ChannelIndexes.resize(connectionId + 1, c_NoChannel);
+        }
+        m_ChannelIndexes[connectionId] = m_Channels.size() - 1;
+        m_LatencyModes[connectionId] = FlicClientProtocol::NormalLatency;
+        UpdateLatencyModeMetrics();
+        return !IsConnected() || CreateChannel(m_Channels.back(), true);
+    }
+
+    bool Connection::RemoveChannel(ConnectionId const connectionId)
+    {
+        if (FindChannel(connectionId) == nullptr)
+        {
+            return false;
+        }
+
+        // Channels are kept in the order they were added, so the ones after it move down
+        size_t const index = m_ChannelIndexes[connectionId];
+        m_Channels.erase(m_Channels.begin() + index);
+        m_ChannelIndexes[connectionId] = c_NoChannel;
+        for (size_t later = index; later < m_Channels.size(); ++later)
+        {
+            m_ChannelIndexes[m_Channels[later].connectionId] = later;
+        }
+
+        UpdateLatencyModeMetrics();
+        return !IsConnected() || DestroyChannel(connectionId);
+    }
+
+    Connection::ChannelState Connection::GetChannelState(ConnectionId const connectionId) const
+    {
+        Channel const* const channel = FindChannel(connectionId);
+        return channel != nullptr ? channel->state : ChannelState::Closed;
+    }
+
+    size_t Connection::ReadyChannelCount() const
+    {
+        size_t readyCount = 0;
+        for (Channel const& channel : m_Channels)
+        {
+            if (channel.state == ChannelState::Ready)
+            {
+                ++readyCount;
+            }
+        }
+
+        return readyCount;
+    }
+
+    bool Connection::SetLatencyMode(ConnectionId const connectionId, FlicClientProtocol::LatencyMode const latencyMode)
+    {
+        Channel* const channel = FindChannel(connectionId);
+        if (channel == nullptr)
+        {
+            return false;
+        }
+
+        if (m_LatencyModes[connectionId] == latencyMode)
+        {
+            return true;
+        }
+
+        m_LatencyModes[connectionId] = latencyMode;
+        Metrics::Global().latencyModeChanges.Increment();
+        UpdateLatencyModeMetrics();
+
+        // A closed channel picks the mode up when it is created
+        if (!IsConnected() || channel->state == ChannelState::Closed)
+        {
+            return true;
+        }
+
+        DOORBELLPI_LOG(LOG_INFO, "Changing connection channel %u to latency mode %d", connectionId, latencyMode);
+        FlicClientProtocol::CmdChangeModeParameters cmd;
+        cmd.conn_id = connectionId;
+        cmd.latency_mode = latencyMode;
+        cmd.auto_disconnect_time = c_AutoDisconnectTime;
+        if (!WriteCommand(cmd))
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Error %d sending CmdChangeModeParameters", errno);
+            Close();
+            return false;
+        }
+
+        return true;
+    }
+
+    FlicClientProtocol::LatencyMode Connection::GetLatencyMode(ConnectionId const connectionId) const
+    {
+        return connectionId < m_LatencyModes.size() ? m_LatencyModes[connectionId] : FlicClientProtocol::NormalLatency;
+    }
+
+    void Connection::SetLivenessCheck(std::chrono::milliseconds const interval, uint32_t const maxMissed)
+    {
+        m_PingInterval = interval;
+        m_MaxMissedPings = maxMissed > 0 ? maxMissed : 1;
+    }
+
+    FlicClientProtocol::BluetoothControllerState Connection::GetControllerState() const
+    {
+        return m_ControllerState;
+    }
+
+    Connection::Channel* Connection::FindChannel(ConnectionId const connectionId)
+    {
+        return const_cast<Channel*>(static_cast<Connection const*>(this)->FindChannel(connectionId));
+    }
+
+    Connection::Channel const* Connection::FindChannel(ConnectionId const connectionId) const
+    {
+        if (connectionId >= m_ChannelIndexes.size() || m_ChannelIndexes[connectionId] == c_NoChannel)
+        {
+            return nullptr;
+        }
+
+        return &m_Channels[m_ChannelIndexes[connectionId]];
+    }
+
+    void Connection::UpdateLatencyModeMetrics() const
+    {
+        size_t counts[Codec::c_LatencyModeCount] = {};
+        for (Channel const& channel : m_Channels)
+        {
+            FlicClientProtocol::LatencyMode const latencyMode = m_LatencyModes[channel.connectionId];
+            if (latencyMode < Codec::c_LatencyModeCount)
+            {
+                ++counts[latencyMode];
+            }
+        }
+
+        Metrics::Daemon& metrics = Metrics::Global();
+        for (size_t mode = 0; mode < Codec::c_LatencyModeCount; ++mode)
+        {
+            metrics.channelsByLatencyMode[mode].Set(static_cast<int64_t>(counts[mode]));
+        }
+    }
+
+    void Connection::OnReady(uint32_t const events)
+    {
+        if ((events & EPOLLOUT) != 0 && !FlushUnsent())
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Error %d writing to socket", errno);
+            Close();
+            return;
+        }
+
+        if ((events & ~EPOLLOUT) != 0)
+        {
+            OnReadable();
+        }
+    }
+
+    void Connection::OnReadable()
+    {
+        // Every packet handled in this wake up is timed from here
+        m_ReadableTime = std::chrono::steady_clock::now();
+
+        // Drain everything that is available, so a burst of packets is handled in one wake up
+        while (IsConnected())
+        {
+            switch (m_PacketReader.Fill(m_SocketHandle))
+            {
+            case PacketReader::ReadResult::Data:
+            {
+                break;
+            }
+            case PacketReader::ReadResult::WouldBlock:
+            {
+                return;
+            }
+            case PacketReader::ReadResult::EndOfStream:
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Connection closed by flicd");
+                Close();
+                return;
+            }
+            case PacketReader::ReadResult::Error:
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Error %d reading from socket'", errno);
+                Close();
+                return;
+            }
+            }
+
+            PacketView packet;
+            PacketReader::FrameResult frameResult = PacketReader::FrameResult::Incomplete;
+            while (IsConnected() && (frameResult = m_PacketReader.Next(packet)) == PacketReader::FrameResult::Packet)
+            {
+                HandlePacket(packet);
+            }
+
+            if (frameResult == PacketReader::FrameResult::Oversized)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Received a packet larger than %d bytes, the stream is corrupt", PacketReader::c_MaxPacketLength);
+                Close();
+                return;
+            }
+        }
+    }
+
+    bool Connection::CreateChannel(Channel& channel, bool const createListener)
+    {
+        FlicClientProtocol::CmdCreateConnectionChannel cmd;
+        memcpy(cmd.bd_addr, channel.buttonAddress.addr, ButtonAddress::c_AddressLength);
+        cmd.conn_id = channel.connectionId;
+        cmd.latency_mode = m_LatencyModes[channel.connectionId];
+        cmd.auto_disconnect_time = c_AutoDisconnectTime;
+        if (!WriteCommand(cmd))
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Error %d sending CmdCreateConnectionChannel", errno);
+            return false;
+        }
+        channel.state = ChannelState::Creating;
+
+        // The battery listener shares the channel's id, so both can be torn down together. It outlives the channel
+        // being removed by flicd, so only needs creating once per connection
+        if (createListener)
+        {
+            FlicClientProtocol::CmdCreateBatteryStatusListener batteryCmd;
+            batteryCmd.listener_id = channel.connectionId;
+            memcpy(batteryCmd.bd_addr, channel.buttonAddress.addr, ButtonAddress::c_AddressLength);
+            if (!WriteCommand(batteryCmd))
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Error %d sending CmdCreateBatteryStatusListener", errno);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool Connection::DestroyChannel(ConnectionId const connectionId)
+    {
+        FlicClientProtocol::CmdRemoveBatteryStatusListener batteryCmd;
+        batteryCmd.listener_id = connectionId;
+        bool const removedListener = WriteCommand(batteryCmd);
+
+        FlicClientProtocol::CmdRemoveConnectionChannel cmd;
+        cmd.conn_id = connectionId;
+        return WriteCommand(cmd) && removedListener;
+    }
+
+    void Connection::HandlePacket(PacketView const& packet)
+    {
+        uint8_t const opCode = packet.data[0];
+        DOORBELLPI_LOG(LOG_DEBUG, "Got a message of type %d from socket", opCode);
+
+        switch (Codec::Dispatcher<Connection>::Dispatch(*this, packet))
+        {
+        case Codec::DispatchResult::Handled:
+        {
+            Metrics::Global().packetsByOpcode[opCode].Increment();
+            break;
+        }
+        case Codec::DispatchResult::UnknownOpcode:
+        {
+            // Ignored, newer versions of flicd may send events we don't know about
+            Metrics::Global().unknownPackets.Increment();
+            break;
+        }
+        case Codec::DispatchResult::Truncated:
+        {
+            Metrics::Global().truncatedPackets.Increment();
+            DOORBELLPI_LOG(LOG_NOTICE, "Ignoring truncated message of type %d with only %d bytes", opCode, packet.length);
+            break;
+        }
+        }
+    }
+
+    void Connection::ScheduleRetry(Channel& channel)
+    {
+        auto const now = std::chrono::steady_clock::now();
+        // Doubles from 500 ms until it reaches the cap, on the eighth failure in a row
+        std::chrono::milliseconds const delay = std::min(c_MaxChannelRetryDelay, c_ChannelRetryDelay * (1 << std::min<uint32_t>(channel.failures, 7)));
+        channel.state = ChannelState::Closed;
+        channel.retryTime = now + delay;
+        ++channel.failures;
+
+        // The timer always runs to the earliest retry
+        auto earliest = channel.retryTime;
+        for (Channel const& other : m_Channels)
+        {
+            if (other.state == ChannelState::Closed && other.failures > 0)
+            {
+                earliest = std::min(earliest, other.retryTime);
+            }
+        }
+        m_EventLoop.ArmTimerAt(m_RetryTimer, earliest);
+    }
+
+    void Connection::OnRetryTimer()
+    {
+        if (!IsConnected())
+        {
+            return;
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        auto earliest = std::chrono::steady_clock::time_point::max();
+        for (Channel& channel : m_Channels)
+        {
+            if (channel.state != ChannelState::Closed || channel.failures == 0)
+            {
+                continue;
+            }
+
+            if (channel.retryTime > now)
+            {
+                earliest = std::min(earliest, channel.retryTime);
+                continue;
+            }
+
+            DOORBELLPI_LOG(LOG_NOTICE, "Creating connection channel %u again", channel.connectionId);
+            Metrics::Global().channelsRecreated.Increment();
+            if (!CreateChannel(channel, false))
+            {
+                // The socket is no good, so it's down to the supervisor now
+                Close();
+                return;
+            }
+        }
+
+        if (earliest != std::chrono::steady_clock::time_point::max())
+        {
+            m_EventLoop.ArmTimerAt(m_RetryTimer, earliest);
+        }
+    }
+
+    void Connection::OnPingTimer()
+    {
+        if (!IsConnected())
+        {
+            return;
+        }
+
+        if (m_PingOutstanding)
+        {
+            Metrics::Global().pingsMissed.Increment();
+            if (++m_MissedPings >= m_MaxMissedPings)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "flicd hasn't answered %u pings, dropping the connection", m_MissedPings);
+                Metrics::Global().livenessTimeouts.Increment();
+                Close();
+                return;
+            }
+        }
+
+        FlicClientProtocol::CmdPing cmd;
+        cmd.ping_id = ++m_NextPingId;
+        if (!WriteCommand(cmd))
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Error %d sending CmdPing", errno);
+            Close();
+            return;
+        }
+
+        m_PingOutstanding = true;
+        m_PingSentTime = std::chrono::steady_clock::now();
+        m_EventLoop.ArmTimer(m_PingTimer, m_PingInterval);
+    }
+
+    void Connection::SetControllerState(FlicClientProtocol::BluetoothControllerState const state)
+    {
+        Metrics::Global().bluetoothControllerState.Set(state);
+        if (state == m_ControllerState)
+        {
+            return;
+        }
+
+        m_ControllerState = state;
+        Metrics::Global().bluetoothControllerStateChanges.Increment();
+        if (state == FlicClientProtocol::Attached)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Bluetooth controller is attached");
+            return;
+        }
+
+        // No button can reach us until it's back. flicd keeps the channels and reconnects them itself once the
+        // controller is attached again, reporting each one's status as it goes
+        DOORBELLPI_LOG(LOG_ERR, "Bluetooth controller is %s, buttons can't be heard until it's attached",
+            state == FlicClientProtocol::Resetting ? "resetting" : "detached");
+        for (Channel& channel : m_Channels)
+        {
+            if (channel.state != ChannelState::Closed && channel.state != ChannelState::Creating)
+            {
+                channel.state = ChannelState::Disconnected;
+            }
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_CREATE_CONNECTION_CHANNEL_RESPONSE_OPCODE>, FlicClientProtocol::EvtCreateConnectionChannelResponse const& event)
+    {
+        Channel* const channel = FindChannel(event.base.conn_id);
+        if (event.error != FlicClientProtocol::NoError)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to create connection channel %u, error %d", event.base.conn_id, event.error);
+            if (channel != nullptr)
+            {
+                ScheduleRetry(*channel);
+            }
+        }
+        else
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Created connection channel %u, connection status %d", event.base.conn_id, event.connection_status);
+            if (channel != nullptr)
+            {
+                channel->state = ToChannelState(event.connection_status);
+            }
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_CONNECTION_STATUS_CHANGED_OPCODE>, FlicClientProtocol::EvtConnectionStatusChanged const& event)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Connection channel %u changed status to %d, disconnect reason %d", event.base.conn_id, event.connection_status, event.disconnect_reason);
+
+        // A button that drops its Bluetooth link keeps its channel, and flicd reconnects it by itself
+        Channel* const channel = FindChannel(event.base.conn_id);
+        if (channel != nullptr && channel->state != ChannelState::Closed)
+        {
+            channel->state = ToChannelState(event.connection_status);
+            if (channel->state == ChannelState::Ready)
+            {
+                channel->failures = 0;
+            }
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_CONNECTION_CHANNEL_REMOVED_OPCODE>, FlicClientProtocol::EvtConnectionChannelRemoved const& event)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Connection channel %u was removed, reason %d", event.base.conn_id, event.removed_reason);
+
+        // Channels removed by RemoveChannel are already gone from the list. Any other removal, such as another
+        // client force disconnecting the button, is put right by creating the channel again
+        Channel* const channel = FindChannel(event.base.conn_id);
+        if (channel != nullptr && event.removed_reason != FlicClientProtocol::RemovedByThisClient)
+        {
+            ScheduleRetry(*channel);
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_BUTTON_UP_OR_DOWN_OPCODE>, FlicClientProtocol::EvtButtonEvent const& event)
+    {
+        Metrics::Daemon& metrics = Metrics::Global();
+        metrics.readableToDecoded.Record(std::chrono::steady_clock::now() - m_ReadableTime);
+        // By the mode flicd was last asked for
+        FlicClientProtocol::LatencyMode const latencyMode = GetLatencyMode(event.base.conn_id);
+        metrics.buttonTimeDiff[latencyMode < Codec::c_LatencyModeCount ? latencyMode : 0].Record(event.time_diff);
+
+        if (event.time_diff < 10 && event.click_type == FlicClientProtocol::ButtonDown)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Saw a button click event of click type %d on channel %u", event.click_type, event.base.conn_id);
+            if (m_RingHandler)
+            {
+                m_RingHandler(event.base.conn_id, m_ReadableTime, event.time_diff);
+            }
+        }
+        else
+        {
+            if (event.click_type == FlicClientProtocol::ButtonDown)
+            {
+                metrics.pressesStale.Increment();
+            }
+            DOORBELLPI_LOG(LOG_NOTICE, "Saw a button click event, but it was %d seconds old and a click type of %d'", event.time_diff, event.click_type);
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_GET_INFO_RESPONSE_OPCODE>, FlicClientProtocol::EvtGetInfoResponse const& event)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "flicd's Bluetooth controller is in state %d with %u verified buttons", event.bluetooth_controller_state, event.nb_verified_buttons);
+        SetControllerState(event.bluetooth_controller_state);
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_BLUETOOTH_CONTROLLER_STATE_CHANGE_OPCODE>, FlicClientProtocol::EvtBluetoothControllerStateChange const& event)
+    {
+        SetControllerState(event.state);
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_PING_RESPONSE_OPCODE>, FlicClientProtocol::EvtPingResponse const& event)
+    {
+        DOORBELLPI_LOG(LOG_DEBUG, "Ping response %u", event.ping_id);
+
+        m_MissedPings = 0;
+        if (m_PingOutstanding && event.ping_id == m_NextPingId)
+        {
+            m_PingOutstanding = false;
+            Metrics::Global().pingRoundTrip.Record(std::chrono::steady_clock::now() - m_PingSentTime);
+        }
+    }
+
+    void Connection::OnEvent(Codec::EventTag<EVT_BATTERY_STATUS_OPCODE>, FlicClientProtocol::EvtBatteryStatus const& event)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Button %u battery level is %d%%", event.listener_id, event.battery_percentage);
+    }
+
+    void Connection::Close()
+    {
+        if (m_SocketHandle == c_InvalidHandle)
+        {
+            return;
+        }
+
+        m_EventLoop.RemoveDescriptor(m_SocketHandle);
+        close(m_SocketHandle);
+        m_SocketHandle = c_InvalidHandle;
+        m_Unsent.clear();
+        Metrics::Global().disconnections.Increment();
+
+        // Every channel goes with the connection, and is created afresh on the next one
+        m_EventLoop.DisarmTimer(m_RetryTimer);
+        m_EventLoop.DisarmTimer(m_PingTimer);
+        for (Channel& channel : m_Channels)
+        {
+            channel.state = ChannelState::Closed;
+            channel.failures = 0;
+        }
+
+        if (m_DisconnectHandler)
+        {
+            DisconnectHandler const onDisconnect = std::move(m_DisconnectHandler);
+            m_DisconnectHandler = nullptr;
+            onDisconnect();
+        }
+    }
+
+    bool Connection::WriteBuffer(uint8_t const* buf, int len)
+    {
+        // Anything already waiting goes first, so commands stay in order
+        if (!m_Unsent.empty())
+        {
+            if (m_Unsent.size() + len > c_MaxUnsentBytes)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "flicd isn't taking commands, %zu bytes are waiting", m_Unsent.size());
+                return false;
+            }
+            m_Unsent.insert(m_Unsent.end(), buf, buf + len);
+            return true;
+        }
+
+        int pos = 0;
+        int left = len;
+        while (left) 
+        {
+            int res = write(m_SocketHandle, buf + pos, left);
+            if (res < 0) 
+            {
+                if (errno == EINTR) 
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    // The rest is sent once the socket has room for it
+                    m_Unsent.assign(buf + pos, buf + len);
+                    return m_EventLoop.AddDescriptor(m_SocketHandle, EPOLLIN | EPOLLRDHUP | EPOLLOUT, [this](uint32_t events) { OnReady(events); });
+                }
+                return false;
+            }
+            pos += res;
+            left -= res;
+        }
+
+        return true;
+    }
+
+    bool Connection::FlushUnsent()
+    {
+        size_t sent = 0;
+        while (sent < m_Unsent.size())
+        {
+            ssize_t const result = write(m_SocketHandle, m_Unsent.data() + sent, m_Unsent.size() - sent);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return false;
+            }
+            sent += static_cast<size_t>(result);
+        }
+
+        m_Unsent.erase(m_Unsent.begin(), m_Unsent.begin() + sent);
+        if (m_Unsent.empty())
+        {
+            // Stop waking up for a socket that's always writable
+            return m_EventLoop.AddDescriptor(m_SocketHandle, EPOLLIN | EPOLLRDHUP, [this](uint32_t events) { OnReady(events); });
+        }
+        return true;
+    }
+
+    std::string Connection::GetErrorCodeString() const
+    {
+        int const errorCode = errno;
+        char const* errorMessage = strerror(errorCode);
+        return std::string(errorMessage);
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "FlicButtonAddress.h"
+#include "FlicChannelTable.h"
+#include "FlicCodec.h"
+#include "FlicPacketReader.h"
+
+class EventLoop;
+
+namespace Flic
+{
+    // A connection to the flic daemon. The socket is non-blocking and serviced by the event loop, so packets are
+    // read and dispatched as soon as they arrive regardless of what else the daemon is doing. One connection hosts
+    // a connection channel per button, identified by the conn_id the caller allocates. A channel that flicd removes
+    // is created again, with a backoff, without dropping the connection. flicd is pinged periodically and the
+    // connection closed if it stops answering; re-establishing the connection is left to Flic::Supervisor
+    class Connection : private Codec::IgnoreEvents
+    {
+    public:
+        // readableTime is when the socket the press arrived on was reported readable, for measuring latency, and
+        // timeDiff is how old flicd says the press was, in seconds
+        using RingHandler = std::function<void(ConnectionId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)>;
+        using DisconnectHandler = std::function<void()>;
+
+        // Closed until it has been asked for, then as last reported by flicd
+        enum class ChannelState
+        {
+            Closed,
+            Creating,
+            Disconnected,
+            Connected,
+            Ready
+        };
+
+        int const c_InvalidHandle = -1;
+
+        explicit Connection(EventLoop& eventLoop);
+        ~Connection();
+
+        Connection(Connection const&) = delete;
+        Connection& operator=(Connection const&) = delete;
+
+        // Resolves and connects before returning, so it's only for tools and tests; the daemon uses Flic::Supervisor
+        bool Connect(std::string const& hostname, in_port_t const port, RingHandler onRing, DisconnectHandler onDisconnect);
+        // Takes ownership of a socket that is already connected to flicd, and creates every channel on it
+        bool Attach(int const socketHandle, RingHandler onRing, DisconnectHandler onDisconnect);
+        bool IsConnected() const;
+        void Disconnect();
+
+        // Channels can be added before or after connecting. They are created with flicd as soon as it is possible
+        bool AddChannel(ConnectionId const connectionId, ButtonAddress const& buttonAddress);
+        bool RemoveChannel(ConnectionId const connectionId);
+        ChannelState GetChannelState(ConnectionId const connectionId) const;
+        size_t ReadyChannelCount() const;
+
+        // Channels start out in NormalLatency. A change is sent to flicd straight away if the channel is open, and
+        // kept for whenever it is created again
+        bool SetLatencyMode(ConnectionId const connectionId, FlicClientProtocol::LatencyMode const latencyMode);
+        FlicClientProtocol::LatencyMode GetLatencyMode(ConnectionId const connectionId) const;
+
+        // Pings flicd every interval, and treats the connection as dead once maxMissed pings in a row have gone
+        // unanswered. A zero interval turns it off. Applies from the next connection
+        void SetLivenessCheck(std::chrono::milliseconds const interval, uint32_t const maxMissed);
+        // As last reported by flicd, or Detached before it has said
+        FlicClientProtocol::BluetoothControllerState GetControllerState() const;
+
+    private:
+        friend class Codec::Dispatcher<Connection>;
+
+        void OnReady(uint32_t const events);
+        void OnReadable();
+        void HandlePacket(PacketView const& packet);
+        void Close();
+
+        struct Channel
+        {
+            ConnectionId connectionId;
+            ButtonAddress buttonAddress;
+            ChannelState state;
+            // Consecutive failures to keep the channel open, for the backoff before the next try
+            uint32_t failures;
+            std::chrono::steady_clock::time_point retryTime;
+        };
+
+        Channel* FindChannel(ConnectionId const connectionId);
+        Channel const* FindChannel(ConnectionId const connectionId) const;
+        bool CreateChannel(Channel& channel, bool const createListener);
+        bool DestroyChannel(ConnectionId const connectionId);
+        void UpdateLatencyModeMetrics() const;
+        void ScheduleRetry(Channel& channel);
+        void OnRetryTimer();
+        void OnPingTimer();
+        void SetControllerState(FlicClientProtocol::BluetoothControllerState const state);
+
+        // Event handlers, called through Codec::Dispatcher
+        using IgnoreEvents::OnEvent;
+        void OnEvent(Codec::EventTag<EVT_CREATE_CONNECTION_CHANNEL_RESPONSE_OPCODE>, FlicClientProtocol::EvtCreateConnectionChannelResponse const& event);
+        void OnEvent(Codec::EventTag<EVT_CONNECTION_STATUS_CHANGED_OPCODE>, FlicClientProtocol::EvtConnectionStatusChanged const& event);
+        void OnEvent(Codec::EventTag<EVT_CONNECTION_CHANNEL_REMOVED_OPCODE>, FlicClientProtocol::EvtConnectionChannelRemoved const& event);
+        void OnEvent(Codec::EventTag<EVT_BUTTON_UP_OR_DOWN_OPCODE>, FlicClientProtocol::EvtButtonEvent const& event);
+        void OnEvent(Codec::EventTag<EVT_GET_INFO_RESPONSE_OPCODE>, FlicClientProtocol::EvtGetInfoResponse const& event);
+        void OnEvent(Codec::EventTag<EVT_BLUETOOTH_CONTROLLER_STATE_CHANGE_OPCODE>, FlicClientProtocol::EvtBluetoothControllerStateChange const& event);
+        void OnEvent(Codec::EventTag<EVT_PING_RESPONSE_OPCODE>, FlicClientProtocol::EvtPingResponse const& event);
+        void OnEvent(Codec::EventTag<EVT_BATTERY_STATUS_OPCODE>, FlicClientProtocol::EvtBatteryStatus const& event);
+
+        template<typename Command>
+        bool WriteCommand(Command const& command)
+        {
+            uint8_t buffer[Codec::c_EncodedSize<Command>];
+            return WriteBuffer(buffer, static_cast<int>(Codec::Encode(command, buffer)));
+        }
+
+        // Whatever the socket won't take straight away is kept and sent as it has room
+        bool WriteBuffer(uint8_t const* buf, int len);
+        bool FlushUnsent();
+        std::string GetErrorCodeString() const;
+
+        EventLoop& m_EventLoop;
+        RingHandler m_RingHandler;
+        DisconnectHandler m_DisconnectHandler;
+
+        int m_SocketHandle = c_InvalidHandle;
+        std::vector<uint8_t> m_Unsent;
+        std::vector<Channel> m_Channels;
+        // Indexed by conn_id, each channel's position in m_Channels, or c_NoChannel
+        std::vector<size_t> m_ChannelIndexes;
+        // Indexed by conn_id, which are kept dense, so that every button event can be put down to its mode in O(1)
+        std::vector<FlicClientProtocol::LatencyMode> m_LatencyModes;
+        int m_RetryTimer = c_InvalidHandle;
+
+        // Only the latest ping is timed; an answer to any of them shows flicd is still there
+        int m_PingTimer = c_InvalidHandle;
+        std::chrono::milliseconds m_PingInterval = std::chrono::seconds(2);
+        uint32_t m_MaxMissedPings = 3;
+        uint32_t m_NextPingId = 0;
+        bool m_PingOutstanding = false;
+        std::chrono::steady_clock::time_point m_PingSentTime;
+        uint32_t m_MissedPings = 0;
+        FlicClientProtocol::BluetoothControllerState m_ControllerState = FlicClientProtocol::Detached;
+        PacketReader m_PacketReader;
+        std::chrono::steady_clock::time_point m_ReadableTime;
+        bool m_HasConnected = false;
+    };
+}
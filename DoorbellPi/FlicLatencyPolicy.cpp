@@ -0,0 +1,269 @@
+#include "FlicLatencyPolicy.h"
+
+#include "Log.h"
+
+#include <algorithm>
+#include <time.h>
+
+namespace
+{
+    // The schedule is in wall clock time, which the steady clock the timers use can drift from, so rather than
+    // arming a timer for the next change of day it is checked this often
+    std::chrono::milliseconds const c_ScheduleCheckInterval = std::chrono::minutes(1);
+    size_t const c_NoButton = static_cast<size_t>(-1);
+}
+
+namespace Flic
+{
+    LatencyPolicy::LatencyPolicy(EventLoop& eventLoop, Connection& connection, Schedule const& schedule)
+        : m_EventLoop(eventLoop)
+        , m_Connection(connection)
+        , m_Schedule(schedule)
+        , m_TimeOfDay(&LatencyPolicy::LocalTimeOfDay)
+    {
+    }
+
+    LatencyPolicy::~LatencyPolicy()
+    {
+        Stop();
+
+        if (m_Timer != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_Timer);
+        }
+    }
+
+    bool LatencyPolicy::AddButton(ConnectionId const connectionId, ButtonModes const& modes)
+    {
+        if (FindButton(connectionId) != nullptr)
+        {
+            return false;
+        }
+
+        m_Buttons.push_back(Button{ connectionId, modes, std::chrono::steady_clock::time_point() });
+        if (connectionId >= m_ButtonIndexes.size())
+        {
+            m_ButtonIndexes.resize(connectionId + 1, c_NoButton);
+        }
+        m_ButtonIndexes[connectionId] = m_Buttons.size() - 1;
+        UpdateGroups();
+        if (m_Started)
+        {
+            Apply();
+        }
+        return true;
+    }
+
+    void LatencyPolicy::SetTimeOfDaySource(TimeOfDaySource source)
+    {
+        m_TimeOfDay = source ? std::move(source) : TimeOfDaySource(&LatencyPolicy::LocalTimeOfDay);
+        if (m_Started)
+        {
+            Apply();
+        }
+    }
+
+    void LatencyPolicy::SetSchedule(Schedule const& schedule)
+    {
+        m_Schedule = schedule;
+        if (m_Started)
+        {
+            Apply();
+        }
+    }
+
+    bool LatencyPolicy::SetButtonModes(ConnectionId const connectionId, ButtonModes const& modes)
+    {
+        Button* const button = FindButton(connectionId);
+        if (button == nullptr)
+        {
+            return false;
+        }
+
+        button->modes = modes;
+        UpdateGroups();
+        if (m_Started)
+        {
+            Apply();
+        }
+        return true;
+    }
+
+    bool LatencyPolicy::Reconfigure(Schedule const& schedule, std::vector<std::pair<ConnectionId, ButtonModes>> const& buttonModes)
+    {
+        bool found = true;
+        for (auto const& entry : buttonModes)
+        {
+            Button* const button = FindButton(entry.first);
+            if (button == nullptr)
+            {
+                found = false;
+                continue;
+            }
+            button->modes = entry.second;
+        }
+
+        m_Schedule = schedule;
+        UpdateGroups();
+        if (m_Started)
+        {
+            Apply();
+        }
+        return found;
+    }
+
+    bool LatencyPolicy::Start()
+    {
+        if (m_Started)
+        {
+            return true;
+        }
+
+        if (m_Timer == EventLoop::c_InvalidHandle)
+        {
+            m_Timer = m_EventLoop.CreateTimer([this]() { Apply(); });
+            if (m_Timer == EventLoop::c_InvalidHandle)
+            {
+                return false;
+            }
+        }
+
+        m_Started = true;
+        m_Daytime = IsDaytime();
+        DOORBELLPI_LOG(LOG_NOTICE, "Starting with the %s latency modes", m_Daytime ? "day" : "night");
+        Apply();
+        return true;
+    }
+
+    void LatencyPolicy::Stop()
+    {
+        // The channels are left in whatever mode they were last given
+        if (m_Started)
+        {
+            m_EventLoop.DisarmTimer(m_Timer);
+            m_Started = false;
+        }
+    }
+
+    void LatencyPolicy::OnActivity(ConnectionId const connectionId)
+    {
+        Button* const pressed = FindButton(connectionId);
+        if (pressed == nullptr)
+        {
+            return;
+        }
+
+        // Nothing else can have changed, so only the pressed button's group is looked at. Any change of day is left
+        // to the timer
+        auto const now = std::chrono::steady_clock::now();
+        auto const activeUntil = now + m_Schedule.activeTime;
+        auto const activate = [this, now, activeUntil](Button& button)
+        {
+            button.activeUntil = activeUntil;
+            if (m_Started)
+            {
+                ApplyTo(button, now);
+            }
+        };
+
+        auto const group = pressed->modes.group != 0 ? m_Groups.find(pressed->modes.group) : m_Groups.end();
+        if (group == m_Groups.end())
+        {
+            activate(*pressed);
+        }
+        else
+        {
+            for (size_t const index : group->second)
+            {
+                activate(m_Buttons[index]);
+            }
+        }
+
+        if (m_Started && activeUntil < m_NextCheck)
+        {
+            m_NextCheck = activeUntil;
+            m_EventLoop.ArmTimerAt(m_Timer, m_NextCheck);
+        }
+    }
+
+    LatencyPolicy::Button* LatencyPolicy::FindButton(ConnectionId const connectionId)
+    {
+        if (connectionId >= m_ButtonIndexes.size() || m_ButtonIndexes[connectionId] == c_NoButton)
+        {
+            return nullptr;
+        }
+
+        return &m_Buttons[m_ButtonIndexes[connectionId]];
+    }
+
+    void LatencyPolicy::UpdateGroups()
+    {
+        m_Groups.clear();
+        for (size_t index = 0; index < m_Buttons.size(); ++index)
+        {
+            if (m_Buttons[index].modes.group != 0)
+            {
+                m_Groups[m_Buttons[index].modes.group].push_back(index);
+            }
+        }
+    }
+
+    void LatencyPolicy::Apply()
+    {
+        bool const daytime = IsDaytime();
+        if (daytime != m_Daytime)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Switching to the %s latency modes", daytime ? "day" : "night");
+            m_Daytime = daytime;
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        auto nextCheck = now + c_ScheduleCheckInterval;
+        for (Button const& button : m_Buttons)
+        {
+            if (button.activeUntil > now)
+            {
+                nextCheck = std::min(nextCheck, button.activeUntil);
+            }
+            ApplyTo(button, now);
+        }
+
+        m_NextCheck = nextCheck;
+        m_EventLoop.ArmTimerAt(m_Timer, m_NextCheck);
+    }
+
+    void LatencyPolicy::ApplyTo(Button const& button, std::chrono::steady_clock::time_point const now)
+    {
+        FlicClientProtocol::LatencyMode latencyMode = m_Daytime ? button.modes.day : button.modes.night;
+        if (button.activeUntil > now)
+        {
+            latencyMode = button.modes.active;
+        }
+
+        // Only sent to flicd if it's a change
+        m_Connection.SetLatencyMode(button.connectionId, latencyMode);
+    }
+
+    bool LatencyPolicy::IsDaytime() const
+    {
+        std::chrono::minutes const timeOfDay = m_TimeOfDay();
+        if (m_Schedule.dayStart <= m_Schedule.dayEnd)
+        {
+            return timeOfDay >= m_Schedule.dayStart && timeOfDay < m_Schedule.dayEnd;
+        }
+
+        return timeOfDay >= m_Schedule.dayStart || timeOfDay < m_Schedule.dayEnd;
+    }
+
+    std::chrono::minutes LatencyPolicy::LocalTimeOfDay()
+    {
+        time_t const now = time(nullptr);
+        tm local;
+        if (localtime_r(&now, &local) == nullptr)
+        {
+            return std::chrono::minutes(0);
+        }
+
+        return std::chrono::hours(local.tm_hour) + std::chrono::minutes(local.tm_min);
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "EventLoop.h"
+#include "FlicChannelTable.h"
+#include "FlicConnection.h"
+
+namespace Flic
+{
+    // Chooses the latency mode of each button's channel and switches it at runtime. Lower latency costs the buttons
+    // battery, so it's kept for when someone is likely to be at the door: each button has a mode for the day and one
+    // for the night, and a press puts the button and its neighbours into their active mode for a while, so a second
+    // press, or one on the next door round, is heard sooner. The modes are applied through the Connection, which
+    // keeps them across reconnects
+    class LatencyPolicy
+    {
+    public:
+        struct Schedule
+        {
+            // Local time of day. An end before the start runs past midnight
+            std::chrono::minutes dayStart = std::chrono::hours(7);
+            std::chrono::minutes dayEnd = std::chrono::hours(22);
+            // How long a press keeps a button and its neighbours in their active mode
+            std::chrono::milliseconds activeTime = std::chrono::minutes(2);
+        };
+
+        struct ButtonModes
+        {
+            FlicClientProtocol::LatencyMode day = FlicClientProtocol::NormalLatency;
+            FlicClientProtocol::LatencyMode night = FlicClientProtocol::HighLatency;
+            FlicClientProtocol::LatencyMode active = FlicClientProtocol::LowLatency;
+            // Buttons sharing a non-zero group are neighbours. Zero is a group of one
+            uint32_t group = 0;
+        };
+
+        // Time since local midnight. Replaceable so that the schedule can be exercised without waiting for it
+        using TimeOfDaySource = std::function<std::chrono::minutes()>;
+
+        LatencyPolicy(EventLoop& eventLoop, Connection& connection, Schedule const& schedule);
+        ~LatencyPolicy();
+
+        LatencyPolicy(LatencyPolicy const&) = delete;
+        LatencyPolicy& operator=(LatencyPolicy const&) = delete;
+
+        // The button's channel should already have been added to the connection
+        bool AddButton(ConnectionId const connectionId, ButtonModes const& modes);
+        void SetTimeOfDaySource(TimeOfDaySource source);
+
+        // Both take effect straight away, and leave any button that's active in its active mode until it runs out
+        void SetSchedule(Schedule const& schedule);
+        bool SetButtonModes(ConnectionId const connectionId, ButtonModes const& modes);
+        // Both at once, as for a reload, so the groups are rebuilt and the modes applied once rather than per button.
+        // Returns false if any of the buttons is unknown, still setting the rest
+        bool Reconfigure(Schedule const& schedule, std::vector<std::pair<ConnectionId, ButtonModes>> const& buttonModes);
+
+        bool Start();
+        void Stop();
+
+        // Called for every press, whether or not it rang. Only touches the pressed button and its neighbours
+        void OnActivity(ConnectionId const connectionId);
+
+    private:
+        struct Button
+        {
+            ConnectionId connectionId;
+            ButtonModes modes;
+            std::chrono::steady_clock::time_point activeUntil;
+        };
+
+        Button* FindButton(ConnectionId const connectionId);
+        void UpdateGroups();
+        // Sets every button's mode for now, and arms the timer for the next time one might change
+        void Apply();
+        // Sets the one button's mode, for the time of day Apply last saw
+        void ApplyTo(Button const& button, std::chrono::steady_clock::time_point const now);
+        bool IsDaytime() const;
+        static std::chrono::minutes LocalTimeOfDay();
+
+        EventLoop& m_EventLoop;
+        Connection& m_Connection;
+        Schedule m_Schedule;
+        TimeOfDaySource m_TimeOfDay;
+        std::vector<Button> m_Buttons;
+        // Indexed by conn_id, each button's position in m_Buttons, or c_NoButton
+        std::vector<size_t> m_ButtonIndexes;
+        // The positions in m_Buttons of each non-zero group's buttons
+        std::unordered_map<uint32_t, std::vector<size_t>> m_Groups;
+        int m_Timer = EventLoop::c_InvalidHandle;
+        std::chrono::steady_clock::time_point m_NextCheck;
+        bool m_Started = false;
+        bool m_Daytime = false;
+    };
+}
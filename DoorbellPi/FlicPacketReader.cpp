@@ -0,0 +1,95 @@
+#include "FlicPacketReader.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace Flic
+{
+    PacketReader::ReadResult PacketReader::Fill(int const fileDescriptor)
+    {
+        Compact();
+
+        while (true)
+        {
+            ssize_t const nbytes = read(fileDescriptor, m_Buffer + m_WritePosition, c_BufferSize - m_WritePosition);
+            if (nbytes > 0)
+            {
+                m_WritePosition += static_cast<size_t>(nbytes);
+                return ReadResult::Data;
+            }
+            else if (nbytes == 0)
+            {
+                return ReadResult::EndOfStream;
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return ReadResult::WouldBlock;
+            }
+
+            return ReadResult::Error;
+        }
+    }
+
+    PacketReader::FrameResult PacketReader::Next(PacketView& packet)
+    {
+        while (BufferedBytes() >= c_LengthPrefixSize)
+        {
+            uint8_t const* const header = m_Buffer + m_ReadPosition;
+            uint16_t const packetLength = static_cast<uint16_t>(header[0] | (header[1] << 8));
+            if (packetLength > c_MaxPacketLength)
+            {
+                return FrameResult::Oversized;
+            }
+
+            if (BufferedBytes() < c_LengthPrefixSize + packetLength)
+            {
+                break;
+            }
+
+            m_ReadPosition += c_LengthPrefixSize + packetLength;
+
+            // An empty packet carries no opcode, so there is nothing to dispatch
+            if (packetLength != 0)
+            {
+                packet.data = header + c_LengthPrefixSize;
+                packet.length = packetLength;
+                return FrameResult::Packet;
+            }
+        }
+
+        return FrameResult::Incomplete;
+    }
+
+    void PacketReader::Reset()
+    {
+        m_ReadPosition = 0;
+        m_WritePosition = 0;
+    }
+
+    size_t PacketReader::BufferedBytes() const
+    {
+        return m_WritePosition - m_ReadPosition;
+    }
+
+    void PacketReader::Compact()
+    {
+        if (m_ReadPosition == m_WritePosition)
+        {
+            Reset();
+        }
+        else if (c_BufferSize - m_WritePosition < c_MaxPacketLength + c_LengthPrefixSize)
+        {
+            // Not enough room left to guarantee the partial packet can be completed, so move it to the front. As
+            // callers drain Next() before filling again, this only ever copies the tail of a single packet
+            size_t const bufferedBytes = BufferedBytes();
+            memmove(m_Buffer, m_Buffer + m_ReadPosition, bufferedBytes);
+            m_ReadPosition = 0;
+            m_WritePosition = bufferedBytes;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Flic
+{
+    // A complete packet inside the reader's buffer, without its length prefix. Only valid until the next Fill()
+    struct PacketView
+    {
+        uint8_t const* data;
+        uint16_t length;
+    };
+
+    // Frames the length prefixed flicd packet stream using a fixed buffer. Each Fill() pulls as many bytes as are
+    // available in one read() and Next() then yields every complete packet in place, so steady state reading costs
+    // one syscall per batch of packets and no allocations at all
+    class PacketReader
+    {
+    public:
+        static size_t const c_LengthPrefixSize = 2;
+        static uint16_t const c_MaxPacketLength = 4096;
+        static size_t const c_BufferSize = 4 * (c_MaxPacketLength + c_LengthPrefixSize);
+
+        enum class ReadResult
+        {
+            Data,
+            WouldBlock,
+            EndOfStream,
+            Error
+        };
+
+        enum class FrameResult
+        {
+            Packet,
+            Incomplete,
+            Oversized
+        };
+
+        ReadResult Fill(int const fileDescriptor);
+        FrameResult Next(PacketView& packet);
+
+        void Reset();
+        size_t BufferedBytes() const;
+
+    private:
+        void Compact();
+
+        uint8_t m_Buffer[c_BufferSize];
+        size_t m_ReadPosition = 0;
+        size_t m_WritePosition = 0;
+    };
+}
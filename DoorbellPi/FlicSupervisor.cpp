@@ -0,0 +1,299 @@
+#include "FlicSupervisor.h"
+
+#include "Log.h"
+#include "Metrics.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Flic
+{
+    Supervisor::Supervisor(EventLoop& eventLoop, Connection& connection, std::string const& hostname, in_port_t const port)
+        : Supervisor(eventLoop, connection, hostname, port, Policy())
+    {
+    }
+
+    Supervisor::Supervisor(EventLoop& eventLoop, Connection& connection, std::string const& hostname, in_port_t const port, Policy const& policy)
+        : m_EventLoop(eventLoop)
+        , m_Connection(connection)
+        , m_Resolver(eventLoop)
+        , m_Hostname(hostname)
+        , m_Port(port)
+        , m_Policy(policy)
+        , m_Random(std::random_device()())
+    {
+    }
+
+    Supervisor::~Supervisor()
+    {
+        Stop();
+
+        if (m_Timer != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_Timer);
+        }
+    }
+
+    bool Supervisor::Start(Connection::RingHandler onRing)
+    {
+        if (m_State != State::Stopped)
+        {
+            return true;
+        }
+
+        if (m_Timer == EventLoop::c_InvalidHandle)
+        {
+            m_Timer = m_EventLoop.CreateTimer([this]() { OnTimer(); });
+            if (m_Timer == EventLoop::c_InvalidHandle)
+            {
+                return false;
+            }
+        }
+
+        if (!m_Resolver.Start())
+        {
+            return false;
+        }
+
+        m_RingHandler = std::move(onRing);
+        m_Failures = 0;
+        m_HasLost = false;
+        BeginAttempt();
+        return true;
+    }
+
+    void Supervisor::Stop()
+    {
+        if (m_State == State::Stopped)
+        {
+            return;
+        }
+
+        // Stopped first, so that closing the connection doesn't schedule another attempt
+        m_State = State::Stopped;
+        m_EventLoop.DisarmTimer(m_Timer);
+        AbandonSocket();
+        m_Resolver.Stop();
+        m_Connection.Disconnect();
+    }
+
+    bool Supervisor::IsConnected() const
+    {
+        return m_State == State::Connected;
+    }
+
+    void Supervisor::BeginAttempt()
+    {
+        m_State = State::Resolving;
+        if (!m_Resolver.Resolve(m_Hostname, m_Port, [this](Resolver::Addresses const& addresses) { OnResolved(addresses); }))
+        {
+            AttemptFailed();
+            return;
+        }
+
+        m_EventLoop.ArmTimer(m_Timer, m_Policy.resolveTimeout);
+    }
+
+    void Supervisor::OnResolved(Resolver::Addresses const& addresses)
+    {
+        if (m_State != State::Resolving)
+        {
+            return;
+        }
+
+        if (addresses.empty())
+        {
+            AttemptFailed();
+            return;
+        }
+
+        m_Addresses = addresses;
+        m_NextAddress = 0;
+        ConnectNext();
+    }
+
+    void Supervisor::ConnectNext()
+    {
+        while (m_NextAddress < m_Addresses.size())
+        {
+            Resolver::Address const& address = m_Addresses[m_NextAddress++];
+            int const socketHandle = socket(address.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (socketHandle < 0)
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Failed to create socket [%s]", strerror(errno));
+                continue;
+            }
+
+            // Commands are small and there's nothing to gain from holding them back
+            int const noDelay = 1;
+            setsockopt(socketHandle, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+            if (connect(socketHandle, reinterpret_cast<sockaddr const*>(&address.storage), address.length) == 0)
+            {
+                OnSocketConnected(socketHandle);
+                return;
+            }
+
+            if (errno == EINPROGRESS)
+            {
+                if (!m_EventLoop.AddDescriptor(socketHandle, EPOLLOUT, [this](uint32_t) { OnConnectReady(); }))
+                {
+                    close(socketHandle);
+                    continue;
+                }
+
+                m_SocketHandle = socketHandle;
+                m_State = State::Connecting;
+                m_EventLoop.ArmTimer(m_Timer, m_Policy.connectTimeout);
+                return;
+            }
+
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to connect to '%s:%u' [%s]", m_Hostname.c_str(), m_Port, strerror(errno));
+            close(socketHandle);
+        }
+
+        AttemptFailed();
+    }
+
+    void Supervisor::OnConnectReady()
+    {
+        int const socketHandle = m_SocketHandle;
+        m_EventLoop.RemoveDescriptor(socketHandle);
+        m_SocketHandle = EventLoop::c_InvalidHandle;
+
+        int socketError = 0;
+        socklen_t socketErrorLength = sizeof(socketError);
+        if (getsockopt(socketHandle, SOL_SOCKET, SO_ERROR, &socketError, &socketErrorLength) < 0)
+        {
+            socketError = errno;
+        }
+
+        if (socketError != 0)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to connect to '%s:%u' [%s]", m_Hostname.c_str(), m_Port, strerror(socketError));
+            close(socketHandle);
+            ConnectNext();
+            return;
+        }
+
+        OnSocketConnected(socketHandle);
+    }
+
+    void Supervisor::OnSocketConnected(int const socketHandle)
+    {
+        m_EventLoop.DisarmTimer(m_Timer);
+
+        // Attach takes the socket either way
+        if (!m_Connection.Attach(socketHandle, m_RingHandler, [this]() { OnDisconnected(); }))
+        {
+            AttemptFailed();
+            return;
+        }
+
+        m_State = State::Connected;
+        m_ConnectedTime = std::chrono::steady_clock::now();
+        if (m_HasLost)
+        {
+            Metrics::Global().reconnectTime.Record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(m_ConnectedTime - m_LostTime).count()));
+        }
+        DOORBELLPI_LOG(LOG_NOTICE, "Connected to flicd at '%s:%u'", m_Hostname.c_str(), m_Port);
+    }
+
+    void Supervisor::OnTimer()
+    {
+        switch (m_State)
+        {
+        case State::Waiting:
+        {
+            BeginAttempt();
+            break;
+        }
+        case State::Resolving:
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Timed out resolving '%s'", m_Hostname.c_str());
+            m_Resolver.Cancel();
+            AttemptFailed();
+            break;
+        }
+        case State::Connecting:
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Timed out connecting to '%s:%u'", m_Hostname.c_str(), m_Port);
+            AbandonSocket();
+            ConnectNext();
+            break;
+        }
+        default:
+        {
+            break;
+        }
+        }
+    }
+
+    void Supervisor::OnDisconnected()
+    {
+        if (m_State != State::Connected)
+        {
+            return;
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        m_LostTime = now;
+        m_HasLost = true;
+
+        // Only a connection that had been up a while earns an immediate retry, otherwise one that's accepted and then
+        // dropped straight away would be retried flat out
+        if (now - m_ConnectedTime >= m_Policy.stableTime)
+        {
+            m_Failures = 0;
+        }
+        else
+        {
+            ++m_Failures;
+        }
+
+        DOORBELLPI_LOG(LOG_NOTICE, "Lost the connection to flicd");
+        ScheduleAttempt();
+    }
+
+    void Supervisor::AttemptFailed()
+    {
+        Metrics::Global().connectFailures.Increment();
+        ++m_Failures;
+        ScheduleAttempt();
+    }
+
+    void Supervisor::ScheduleAttempt()
+    {
+        m_State = State::Waiting;
+        if (m_Failures == 0)
+        {
+            m_EventLoop.ArmTimer(m_Timer, std::chrono::nanoseconds(0));
+            return;
+        }
+
+        // Half the backoff is fixed and half is random, so that clients restarting together don't stay in step
+        uint32_t const doublings = std::min<uint32_t>(m_Failures - 1, 20);
+        std::chrono::milliseconds const backoff = std::min(m_Policy.maxBackoff, m_Policy.initialBackoff * (1 << doublings));
+        std::uniform_int_distribution<int64_t> jitter(0, backoff.count() / 2);
+        std::chrono::milliseconds const delay = backoff - std::chrono::milliseconds(jitter(m_Random));
+
+        DOORBELLPI_LOG(LOG_NOTICE, "Connecting to flicd again in %lld ms", static_cast<long long>(delay.count()));
+        m_EventLoop.ArmTimer(m_Timer, delay);
+    }
+
+    void Supervisor::AbandonSocket()
+    {
+        if (m_SocketHandle != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.RemoveDescriptor(m_SocketHandle);
+            close(m_SocketHandle);
+            m_SocketHandle = EventLoop::c_InvalidHandle;
+        }
+    }
+}
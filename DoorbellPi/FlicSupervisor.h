@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <netinet/in.h>
+#include <random>
+#include <stdint.h>
+#include <string>
+
+#include "EventLoop.h"
+#include "FlicConnection.h"
+#include "Resolver.h"
+
+namespace Flic
+{
+    // Keeps a Connection to flicd up for as long as the daemon runs. The host is resolved on the resolver's thread and
+    // connected to without blocking, both with timeouts, so the event loop carries on ringing for everything else in
+    // the meantime. A lost connection is retried straight away if it had been up a while, then with exponential
+    // backoff and jitter. The Connection creates the channels again on every new connection
+    class Supervisor
+    {
+    public:
+        struct Policy
+        {
+            std::chrono::milliseconds initialBackoff = std::chrono::milliseconds(100);
+            std::chrono::milliseconds maxBackoff = std::chrono::seconds(30);
+            std::chrono::milliseconds resolveTimeout = std::chrono::seconds(10);
+            // Per address
+            std::chrono::milliseconds connectTimeout = std::chrono::seconds(3);
+            // A connection that lasted this long resets the backoff, one that didn't counts as another failure
+            std::chrono::milliseconds stableTime = std::chrono::seconds(10);
+        };
+
+        Supervisor(EventLoop& eventLoop, Connection& connection, std::string const& hostname, in_port_t const port);
+        Supervisor(EventLoop& eventLoop, Connection& connection, std::string const& hostname, in_port_t const port, Policy const& policy);
+        ~Supervisor();
+
+        Supervisor(Supervisor const&) = delete;
+        Supervisor& operator=(Supervisor const&) = delete;
+
+        // Has to be called after any signals are blocked, as it starts the resolver thread
+        bool Start(Connection::RingHandler onRing);
+        void Stop();
+
+        bool IsConnected() const;
+
+    private:
+        enum class State
+        {
+            Stopped,
+            Waiting,
+            Resolving,
+            Connecting,
+            Connected
+        };
+
+        void BeginAttempt();
+        void OnResolved(Resolver::Addresses const& addresses);
+        void ConnectNext();
+        void OnConnectReady();
+        void OnSocketConnected(int const socketHandle);
+        void OnTimer();
+        void OnDisconnected();
+        void AttemptFailed();
+        void ScheduleAttempt();
+        void AbandonSocket();
+
+        EventLoop& m_EventLoop;
+        Connection& m_Connection;
+        Resolver m_Resolver;
+        std::string const m_Hostname;
+        in_port_t const m_Port;
+        Policy const m_Policy;
+        Connection::RingHandler m_RingHandler;
+
+        State m_State = State::Stopped;
+        // Either the wait before the next attempt or the timeout on the current one, depending on the state
+        int m_Timer = EventLoop::c_InvalidHandle;
+        int m_SocketHandle = EventLoop::c_InvalidHandle;
+        Resolver::Addresses m_Addresses;
+        size_t m_NextAddress = 0;
+        uint32_t m_Failures = 0;
+        std::chrono::steady_clock::time_point m_ConnectedTime;
+        std::chrono::steady_clock::time_point m_LostTime;
+        bool m_HasLost = false;
+        std::minstd_rand m_Random;
+    };
+}
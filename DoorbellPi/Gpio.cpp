@@ -0,0 +1,25 @@
+#include "Gpio.h"
+
+namespace Gpio
+{
+    LineMask Backend::MaskFor(std::vector<int> const& pins) const
+    {
+        LineMask mask = 0;
+        for (int const pin : pins)
+        {
+            for (size_t lineIndex = 0; lineIndex < m_RequestedPins.size(); ++lineIndex)
+            {
+                if (m_RequestedPins[lineIndex] == pin)
+                {
+                    mask |= LineMask(1) << lineIndex;
+                }
+            }
+        }
+        return mask;
+    }
+
+    void Backend::SetRequestedPins(std::vector<int> const& pins)
+    {
+        m_RequestedPins = pins;
+    }
+}
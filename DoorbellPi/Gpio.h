@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Gpio
+{
+    // One bit per requested output line, in the order the pins were requested
+    using LineMask = uint64_t;
+
+    static size_t const c_MaxLines = 64;
+
+    // Somewhere ring edges can be written to. Output lines are all requested once up front, after which any
+    // combination of them can be changed together with a single SetLines()
+    class Backend
+    {
+    public:
+        virtual ~Backend() = default;
+
+        // Pins are BCM GPIO numbers. Returns false if they could not all be claimed as outputs
+        virtual bool RequestOutputs(std::vector<int> const& pins) = 0;
+
+        // Sets the lines in mask to the matching bits of values, leaving the others alone
+        virtual bool SetLines(LineMask const mask, LineMask const values) = 0;
+
+        // The mask for a set of requested pins. Pins that weren't requested are left out
+        LineMask MaskFor(std::vector<int> const& pins) const;
+
+    protected:
+        void SetRequestedPins(std::vector<int> const& pins);
+
+    private:
+        std::vector<int> m_RequestedPins;
+    };
+}
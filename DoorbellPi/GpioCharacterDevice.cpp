@@ -0,0 +1,99 @@
+#include "GpioCharacterDevice.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace
+{
+    char const* const c_Consumer = "DoorbellPi";
+}
+
+namespace Gpio
+{
+    CharacterDeviceBackend::CharacterDeviceBackend(std::string const& chipPath)
+        : m_ChipPath(chipPath)
+    {
+    }
+
+    CharacterDeviceBackend::~CharacterDeviceBackend()
+    {
+        Release();
+    }
+
+    bool CharacterDeviceBackend::RequestOutputs(std::vector<int> const& pins)
+    {
+        Release();
+
+        if (pins.empty() || pins.size() > c_MaxLines)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Can't request %zu GPIO lines", pins.size());
+            return false;
+        }
+
+        int const chipHandle = open(m_ChipPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (chipHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to open GPIO chip '%s' [%s]", m_ChipPath.c_str(), strerror(errno));
+            return false;
+        }
+
+        gpio_v2_line_request request;
+        memset(&request, 0, sizeof(request));
+        for (size_t lineIndex = 0; lineIndex < pins.size(); ++lineIndex)
+        {
+            request.offsets[lineIndex] = static_cast<__u32>(pins[lineIndex]);
+        }
+        request.num_lines = static_cast<__u32>(pins.size());
+        strncpy(request.consumer, c_Consumer, sizeof(request.consumer) - 1);
+
+        // All outputs, starting low
+        request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+        request.config.num_attrs = 1;
+        request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        request.config.attrs[0].attr.values = 0;
+        request.config.attrs[0].mask = pins.size() == c_MaxLines ? ~LineMask(0) : (LineMask(1) << pins.size()) - 1;
+
+        int const result = ioctl(chipHandle, GPIO_V2_GET_LINE_IOCTL, &request);
+        int const requestError = errno;
+        close(chipHandle);
+
+        if (result < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to request GPIO lines from '%s' [%s]", m_ChipPath.c_str(), strerror(requestError));
+            return false;
+        }
+
+        m_LinesHandle = request.fd;
+        SetRequestedPins(pins);
+        return true;
+    }
+
+    bool CharacterDeviceBackend::SetLines(LineMask const mask, LineMask const values)
+    {
+        if (m_LinesHandle == c_InvalidHandle || mask == 0)
+        {
+            return false;
+        }
+
+        gpio_v2_line_values lineValues;
+        lineValues.mask = mask;
+        lineValues.bits = values & mask;
+        return ioctl(m_LinesHandle, GPIO_V2_LINE_SET_VALUES_IOCTL, &lineValues) == 0;
+    }
+
+    void CharacterDeviceBackend::Release()
+    {
+        if (m_LinesHandle != c_InvalidHandle)
+        {
+            close(m_LinesHandle);
+            m_LinesHandle = c_InvalidHandle;
+            SetRequestedPins({});
+        }
+    }
+}
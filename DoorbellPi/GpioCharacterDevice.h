@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "Gpio.h"
+
+namespace Gpio
+{
+    // Drives the lines through the Linux GPIO character device (v2 uAPI). The lines are requested as one set when
+    // the backend starts, and each SetLines() is a single ioctl however many lines change. Access is governed by the
+    // permissions on the chip's device node, so the daemon no longer needs to run as root
+    class CharacterDeviceBackend : public Backend
+    {
+    public:
+        static int const c_InvalidHandle = -1;
+
+        explicit CharacterDeviceBackend(std::string const& chipPath);
+        ~CharacterDeviceBackend() override;
+
+        CharacterDeviceBackend(CharacterDeviceBackend const&) = delete;
+        CharacterDeviceBackend& operator=(CharacterDeviceBackend const&) = delete;
+
+        bool RequestOutputs(std::vector<int> const& pins) override;
+        bool SetLines(LineMask const mask, LineMask const values) override;
+
+    private:
+        void Release();
+
+        std::string const m_ChipPath;
+        int m_LinesHandle = c_InvalidHandle;
+    };
+}
@@ -0,0 +1,63 @@
+#include "GpioMock.h"
+
+namespace Gpio
+{
+    bool MockBackend::RequestOutputs(std::vector<int> const& pins)
+    {
+        if (pins.empty() || pins.size() > c_MaxLines)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> const lock(m_Mutex);
+        m_LineCount = pins.size();
+        m_State = 0;
+        SetRequestedPins(pins);
+        return true;
+    }
+
+    bool MockBackend::SetLines(LineMask const mask, LineMask const values)
+    {
+        auto const now = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> const lock(m_Mutex);
+        if (m_LineCount == 0 || mask == 0)
+        {
+            return false;
+        }
+
+        m_State = (m_State & ~mask) | (values & mask);
+        Edge const edge{ now, mask, values & mask };
+        if (m_Edges.size() < c_MaxEdges)
+        {
+            m_Edges.push_back(edge);
+        }
+        else
+        {
+            m_Edges[m_NextEdge] = edge;
+            m_NextEdge = (m_NextEdge + 1) % c_MaxEdges;
+        }
+        return true;
+    }
+
+    LineMask MockBackend::State() const
+    {
+        std::lock_guard<std::mutex> const lock(m_Mutex);
+        return m_State;
+    }
+
+    std::vector<MockBackend::Edge> MockBackend::Edges() const
+    {
+        std::lock_guard<std::mutex> const lock(m_Mutex);
+        std::vector<Edge> edges(m_Edges.begin() + m_NextEdge, m_Edges.end());
+        edges.insert(edges.end(), m_Edges.begin(), m_Edges.begin() + m_NextEdge);
+        return edges;
+    }
+
+    void MockBackend::ClearEdges()
+    {
+        std::lock_guard<std::mutex> const lock(m_Mutex);
+        m_Edges.clear();
+        m_NextEdge = 0;
+    }
+}
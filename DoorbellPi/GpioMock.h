@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "Gpio.h"
+
+namespace Gpio
+{
+    // Keeps the line state in memory and records each change with a timestamp, so the daemon can run, and be
+    // measured, on a machine without GPIO. Only the most recent c_MaxEdges changes are kept, so a daemon left
+    // running on it doesn't grow without bound
+    class MockBackend : public Backend
+    {
+    public:
+        struct Edge
+        {
+            std::chrono::steady_clock::time_point time;
+            LineMask mask;
+            LineMask values;
+        };
+
+        static size_t const c_MaxEdges = 16384;
+
+        bool RequestOutputs(std::vector<int> const& pins) override;
+        bool SetLines(LineMask const mask, LineMask const values) override;
+
+        LineMask State() const;
+        // Oldest first
+        std::vector<Edge> Edges() const;
+        void ClearEdges();
+
+    private:
+        mutable std::mutex m_Mutex;
+        size_t m_LineCount = 0;
+        LineMask m_State = 0;
+        // A ring once full, with m_NextEdge the oldest
+        std::vector<Edge> m_Edges;
+        size_t m_NextEdge = 0;
+    };
+}
@@ -0,0 +1,393 @@
+#include "HttpClient.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t const c_ReadSize = 4096;
+    // Any response bigger than this is not one we're interested in
+    size_t const c_MaxResponseSize = 64 * 1024;
+
+    bool HeaderIs(std::string const& line, char const* name, std::string& value)
+    {
+        size_t const nameLength = strlen(name);
+        if (line.size() <= nameLength || line[nameLength] != ':' || strncasecmp(line.c_str(), name, nameLength) != 0)
+        {
+            return false;
+        }
+
+        size_t const valueStart = line.find_first_not_of(" \t", nameLength + 1);
+        value = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+        return true;
+    }
+}
+
+HttpClient::HttpClient(std::chrono::milliseconds const timeout)
+    : m_Timeout(timeout)
+{
+}
+
+HttpClient::~HttpClient()
+{
+    Close();
+}
+
+bool HttpClient::SetUrl(std::string const& url)
+{
+    std::string const c_Scheme = "http://";
+    if (url.compare(0, c_Scheme.size(), c_Scheme) != 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Only http:// URLs are supported, not '%s'", url.c_str());
+        return false;
+    }
+
+    size_t const hostStart = c_Scheme.size();
+    size_t const pathStart = url.find('/', hostStart);
+    std::string const authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+    size_t const portStart = authority.find(':');
+
+    Close();
+    m_Host = authority.substr(0, portStart);
+    m_Port = portStart == std::string::npos ? "80" : authority.substr(portStart + 1);
+    m_Path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+    if (m_Host.empty() || m_Port.empty())
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Invalid URL '%s'", url.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+int HttpClient::Post(std::string const& contentType, std::string const& body)
+{
+    std::string request;
+    request.reserve(body.size() + 256);
+    request += "POST " + m_Path + " HTTP/1.1\r\n";
+    request += "Host: " + m_Host + ":" + m_Port + "\r\n";
+    request += "Content-Type: " + contentType + "\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    request += "Connection: keep-alive\r\n\r\n";
+    request += body;
+
+    // The server is free to close a kept alive connection while it's idle. That's usually already visible, so a
+    // fresh connection is made up front rather than finding out part way through the request
+    if (m_Socket >= 0 && IsStale())
+    {
+        Close();
+    }
+
+    bool const reusingConnection = m_Socket >= 0;
+    bool refused = false;
+    int status = Exchange(request, refused);
+
+    // If the connection was closed just as the request went out, the first write fails before any of it is taken,
+    // and it's safe to go again. Once anything has been sent the server may have acted on it, so a lost response
+    // is left to the caller rather than risking posting the same thing twice
+    if (status == 0 && reusingConnection && refused)
+    {
+        status = Exchange(request, refused);
+    }
+
+    return status;
+}
+
+void HttpClient::Close()
+{
+    if (m_Socket >= 0)
+    {
+        close(m_Socket);
+        m_Socket = -1;
+    }
+    m_Received.clear();
+}
+
+bool HttpClient::Connect()
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    int const lookupResult = getaddrinfo(m_Host.c_str(), m_Port.c_str(), &hints, &addresses);
+    if (lookupResult != 0)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Failed to resolve '%s' [%s]", m_Host.c_str(), gai_strerror(lookupResult));
+        return false;
+    }
+
+    for (addrinfo* address = addresses; address != nullptr && m_Socket < 0; address = address->ai_next)
+    {
+        int const socketHandle = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, address->ai_protocol);
+        if (socketHandle < 0)
+        {
+            continue;
+        }
+
+        // Connect without blocking so that an unreachable host only costs the timeout
+        bool connected = connect(socketHandle, address->ai_addr, address->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS)
+        {
+            pollfd pollEntry = { socketHandle, POLLOUT, 0 };
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            connected = poll(&pollEntry, 1, static_cast<int>(m_Timeout.count())) == 1
+                && getsockopt(socketHandle, SOL_SOCKET, SO_ERROR, &error, &errorLength) == 0
+                && error == 0;
+        }
+
+        if (!connected)
+        {
+            close(socketHandle);
+            continue;
+        }
+
+        // From here on plain blocking calls, bounded by the timeout
+        fcntl(socketHandle, F_SETFL, fcntl(socketHandle, F_GETFL, 0) & ~O_NONBLOCK);
+        timeval timeout;
+        timeout.tv_sec = static_cast<time_t>(m_Timeout.count() / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((m_Timeout.count() % 1000) * 1000);
+        setsockopt(socketHandle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(socketHandle, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        m_Socket = socketHandle;
+    }
+
+    freeaddrinfo(addresses);
+
+    if (m_Socket < 0)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Failed to connect to %s:%s", m_Host.c_str(), m_Port.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool HttpClient::IsStale() const
+{
+    // An idle connection should have nothing to read. End of file, a reset or anything unasked for all mean it's no
+    // longer usable
+    char byte;
+    ssize_t const result = recv(m_Socket, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT);
+    return !(result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+int HttpClient::Exchange(std::string const& request, bool& refused)
+{
+    refused = false;
+    if (m_Socket < 0 && !Connect())
+    {
+        return 0;
+    }
+
+    m_Received.clear();
+    size_t sent = 0;
+    if (!SendAll(request, sent))
+    {
+        refused = sent == 0 && (errno == EPIPE || errno == ECONNRESET);
+        Close();
+        return 0;
+    }
+
+    std::string line;
+    if (!ReadLine(line))
+    {
+        Close();
+        return 0;
+    }
+
+    // Status line: HTTP/1.1 200 OK
+    int status = 0;
+    bool keepAlive = line.compare(0, 8, "HTTP/1.1") == 0;
+    size_t const statusStart = line.find(' ');
+    if (statusStart != std::string::npos)
+    {
+        status = atoi(line.c_str() + statusStart + 1);
+    }
+
+    if (status < 100 || status > 599)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Malformed HTTP status line from %s:%s", m_Host.c_str(), m_Port.c_str());
+        Close();
+        return 0;
+    }
+
+    bool chunked = false;
+    bool hasLength = false;
+    size_t contentLength = 0;
+    while (true)
+    {
+        if (!ReadLine(line))
+        {
+            Close();
+            return 0;
+        }
+
+        if (line.empty())
+        {
+            break;
+        }
+
+        std::string value;
+        if (HeaderIs(line, "Content-Length", value))
+        {
+            hasLength = true;
+            contentLength = strtoul(value.c_str(), nullptr, 10);
+        }
+        else if (HeaderIs(line, "Transfer-Encoding", value))
+        {
+            chunked = strcasecmp(value.c_str(), "chunked") == 0;
+        }
+        else if (HeaderIs(line, "Connection", value))
+        {
+            keepAlive = strcasecmp(value.c_str(), "close") != 0;
+        }
+    }
+
+    // The body is never used, but has to be consumed to keep the connection in step
+    bool bodyRead = true;
+    if (chunked)
+    {
+        bodyRead = ReadChunkedBody();
+    }
+    else if (hasLength)
+    {
+        bodyRead = ReadBody(contentLength);
+    }
+    else if (status >= 200 && status != 204 && status != 304)
+    {
+        // Delimited by the server closing the connection
+        keepAlive = false;
+    }
+
+    if (!bodyRead || !keepAlive)
+    {
+        Close();
+    }
+
+    return status;
+}
+
+bool HttpClient::SendAll(std::string const& data, size_t& sent)
+{
+    sent = 0;
+    while (sent < data.size())
+    {
+        // MSG_NOSIGNAL, as a peer that's gone away must not raise SIGPIPE
+        ssize_t const result = send(m_Socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        sent += static_cast<size_t>(result);
+    }
+
+    return true;
+}
+
+bool HttpClient::ReadMore()
+{
+    if (m_Received.size() > c_MaxResponseSize)
+    {
+        return false;
+    }
+
+    char buffer[c_ReadSize];
+    while (true)
+    {
+        ssize_t const result = recv(m_Socket, buffer, sizeof(buffer), 0);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (result <= 0)
+        {
+            return false;
+        }
+
+        m_Received.append(buffer, static_cast<size_t>(result));
+        return true;
+    }
+}
+
+bool HttpClient::ReadLine(std::string& line)
+{
+    size_t lineEnd;
+    while ((lineEnd = m_Received.find("\r\n")) == std::string::npos)
+    {
+        if (!ReadMore())
+        {
+            return false;
+        }
+    }
+
+    line.assign(m_Received, 0, lineEnd);
+    m_Received.erase(0, lineEnd + 2);
+    return true;
+}
+
+bool HttpClient::ReadBody(size_t const length)
+{
+    while (m_Received.size() < length)
+    {
+        if (!ReadMore())
+        {
+            return false;
+        }
+    }
+
+    m_Received.erase(0, length);
+    return true;
+}
+
+bool HttpClient::ReadChunkedBody()
+{
+    std::string line;
+    while (true)
+    {
+        if (!ReadLine(line))
+        {
+            return false;
+        }
+
+        size_t const chunkLength = strtoul(line.c_str(), nullptr, 16);
+        if (chunkLength == 0)
+        {
+            break;
+        }
+
+        // Each chunk is followed by its own CRLF
+        if (!ReadBody(chunkLength + 2))
+        {
+            return false;
+        }
+    }
+
+    // Trailers, if any, end with an empty line
+    do
+    {
+        if (!ReadLine(line))
+        {
+            return false;
+        }
+    } while (!line.empty());
+
+    return true;
+}
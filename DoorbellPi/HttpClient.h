@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Minimal blocking HTTP/1.1 client that keeps its connection open between requests. Only meant to be used from a
+// worker thread, never the event loop, as every call can take up to the timeout
+class HttpClient
+{
+public:
+    explicit HttpClient(std::chrono::milliseconds const timeout);
+    ~HttpClient();
+
+    HttpClient(HttpClient const&) = delete;
+    HttpClient& operator=(HttpClient const&) = delete;
+
+    // Only plain http://host[:port][/path] URLs are supported
+    bool SetUrl(std::string const& url);
+
+    // Returns the response status code, or 0 if no response was received. Only sent again if it's certain the server
+    // never saw it, so a 0 may still have been acted on
+    int Post(std::string const& contentType, std::string const& body);
+
+    void Close();
+
+private:
+    bool Connect();
+    bool IsStale() const;
+    int Exchange(std::string const& request, bool& refused);
+    bool SendAll(std::string const& data, size_t& sent);
+    bool ReadMore();
+    bool ReadLine(std::string& line);
+    bool ReadBody(size_t const length);
+    bool ReadChunkedBody();
+
+    std::chrono::milliseconds const m_Timeout;
+    std::string m_Host;
+    std::string m_Port;
+    std::string m_Path;
+    int m_Socket = -1;
+    std::string m_Received;
+};
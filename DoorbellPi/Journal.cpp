@@ -0,0 +1,453 @@
+#include "Journal.h"
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t MappingSize(uint64_t const capacity)
+    {
+        return sizeof(Journal::Header) + static_cast<size_t>(capacity) * sizeof(Journal::Record);
+    }
+
+    std::string RotatedPath(std::string const& path, size_t const index)
+    {
+        return index == 0 ? path : path + "." + std::to_string(index);
+    }
+
+    // The next file, made ready before it's needed
+    std::string NextPath(std::string const& path)
+    {
+        return path + ".next";
+    }
+
+    // Moves each file along one, making way for a new path
+    void ShiftFiles(std::string const& path, size_t const files)
+    {
+        for (size_t index = files - 1; index > 0; --index)
+        {
+            std::string const from = RotatedPath(path, index - 1);
+            if (rename(from.c_str(), RotatedPath(path, index).c_str()) != 0 && errno != ENOENT)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to rotate press journal '%s' [%s]", from.c_str(), strerror(errno));
+            }
+        }
+    }
+
+    // Creates, sizes and maps an empty file, or returns nullptr
+    void* CreateFile(std::string const& path, uint64_t const capacity)
+    {
+        size_t const size = MappingSize(capacity);
+        int const handle = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (handle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to create press journal '%s' [%s]", path.c_str(), strerror(errno));
+            return nullptr;
+        }
+
+        // Allocated up front so appending never runs out of space half way through a page, which would be a SIGBUS
+        // on the ring thread. Only a file system that can't allocate at all is left sparse
+        int result = posix_fallocate(handle, 0, size);
+        if ((result == EOPNOTSUPP || result == EINVAL) && ftruncate(handle, size) == 0)
+        {
+            result = 0;
+        }
+        if (result != 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to allocate press journal '%s' [%s]", path.c_str(), strerror(result));
+            close(handle);
+            unlink(path.c_str());
+            return nullptr;
+        }
+
+        void* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, 0);
+        close(handle);
+        if (mapping == MAP_FAILED)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to map press journal '%s' [%s]", path.c_str(), strerror(errno));
+            return nullptr;
+        }
+
+        // The magic goes last, so a file that was never finished being set up is seen as unreadable
+        Journal::Header* const header = static_cast<Journal::Header*>(mapping);
+        header->version = Journal::Header::c_Version;
+        header->recordSize = sizeof(Journal::Record);
+        header->capacity = capacity;
+        header->committed.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(header->magic, Journal::Header::c_Magic, sizeof(header->magic));
+        return mapping;
+    }
+
+    bool IsValid(Journal::Header const& header, size_t const fileSize)
+    {
+        return memcmp(header.magic, Journal::Header::c_Magic, sizeof(header.magic)) == 0
+            && header.version == Journal::Header::c_Version
+            && header.recordSize == sizeof(Journal::Record)
+            && header.capacity > 0
+            && fileSize >= MappingSize(header.capacity)
+            && header.committed.load(std::memory_order_acquire) <= header.capacity;
+    }
+}
+
+namespace Journal
+{
+    Writer::~Writer()
+    {
+        Close();
+    }
+
+    bool Writer::Open(std::string const& path, size_t const recordsPerFile, size_t const files)
+    {
+        Close();
+        m_Path = path;
+        m_RecordsPerFile = recordsPerFile > 0 ? recordsPerFile : 1;
+        m_Files = files > 0 ? files : 1;
+
+        // A spare that had been swapped in, but not yet renamed into place, when the writer last stopped holds the
+        // newest records
+        std::string const nextPath = NextPath(m_Path);
+        Reader next;
+        if (next.Open(nextPath) && next.Size() > 0)
+        {
+            next.Close();
+            ShiftFiles(m_Path, m_Files);
+            if (rename(nextPath.c_str(), m_Path.c_str()) != 0)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to rename press journal '%s' [%s]", nextPath.c_str(), strerror(errno));
+            }
+        }
+
+        if (!Resume() || (m_Committed == m_Capacity && !Rotate()))
+        {
+            Close();
+            return false;
+        }
+
+        m_WakeHandle = eventfd(0, EFD_CLOEXEC);
+        if (m_WakeHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to create press journal wake descriptor [%s]", strerror(errno));
+            Close();
+            return false;
+        }
+
+        // The first spare is ready before anything is appended. A disk too full for it is too full to journal to
+        void* const spare = CreateFile(nextPath, m_RecordsPerFile);
+        if (spare == nullptr)
+        {
+            Close();
+            return false;
+        }
+        m_Spare.store(spare, std::memory_order_relaxed);
+        m_Stopping.store(false, std::memory_order_relaxed);
+        m_Preparer = std::thread(&Writer::Prepare, this);
+        return true;
+    }
+
+    void Writer::Close()
+    {
+        if (m_Preparer.joinable())
+        {
+            m_Stopping.store(true, std::memory_order_release);
+            Wake();
+            m_Preparer.join();
+        }
+
+        if (m_WakeHandle >= 0)
+        {
+            close(m_WakeHandle);
+            m_WakeHandle = -1;
+        }
+
+        // Left as it is, to be written over by the next writer
+        void* const spare = m_Spare.exchange(nullptr, std::memory_order_acquire);
+        if (spare != nullptr)
+        {
+            munmap(spare, MappingSize(m_RecordsPerFile));
+        }
+
+        if (m_Mapping != nullptr)
+        {
+            // Not needed for a crash, as the pages belong to the file, but shortens what a power cut can lose
+            msync(m_Mapping, m_MappingSize, MS_ASYNC);
+        }
+        Unmap();
+    }
+
+    bool Writer::IsOpen() const
+    {
+        return m_Records != nullptr;
+    }
+
+    bool Writer::Append(Record const& record)
+    {
+        if (m_Records == nullptr)
+        {
+            return false;
+        }
+
+        if (m_Committed == m_Capacity)
+        {
+            void* const spare = m_Spare.exchange(nullptr, std::memory_order_acquire);
+            if (spare == nullptr)
+            {
+                // Still being prepared, or preparing it failed and this asks for another try
+                Wake();
+                return false;
+            }
+
+            // The full file is handed over to be unmapped, and renamed out of the way along with the others
+            m_RetiredSize = m_MappingSize;
+            m_Retired.store(m_Mapping, std::memory_order_release);
+            Adopt(spare, MappingSize(m_RecordsPerFile));
+            Wake();
+        }
+
+        m_Records[m_Committed] = record;
+        m_Header->committed.store(++m_Committed, std::memory_order_release);
+        return true;
+    }
+
+    bool Writer::WaitForNextFile(std::chrono::milliseconds const timeout) const
+    {
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        while (m_Spare.load(std::memory_order_acquire) == nullptr)
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    bool Writer::Resume()
+    {
+        int const handle = open(m_Path.c_str(), O_RDWR | O_CLOEXEC);
+        if (handle < 0)
+        {
+            return errno == ENOENT ? Create() : Rotate();
+        }
+
+        struct stat status;
+        void* mapping = MAP_FAILED;
+        if (fstat(handle, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+        {
+            mapping = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, handle, 0);
+        }
+        close(handle);
+
+        if (mapping == MAP_FAILED || !IsValid(*static_cast<Header*>(mapping), status.st_size))
+        {
+            if (mapping != MAP_FAILED)
+            {
+                munmap(mapping, status.st_size);
+            }
+            DOORBELLPI_LOG(LOG_ERR, "Press journal '%s' is unreadable, starting another", m_Path.c_str());
+            return Rotate();
+        }
+
+        Adopt(mapping, status.st_size);
+        DOORBELLPI_LOG(LOG_NOTICE, "Appending to press journal '%s' after %llu records", m_Path.c_str(), static_cast<unsigned long long>(m_Committed));
+        return true;
+    }
+
+    bool Writer::Create()
+    {
+        void* const mapping = CreateFile(m_Path, m_RecordsPerFile);
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+
+        Adopt(mapping, MappingSize(m_RecordsPerFile));
+        return true;
+    }
+
+    bool Writer::Rotate()
+    {
+        Unmap();
+        ShiftFiles(m_Path, m_Files);
+        DOORBELLPI_LOG(LOG_NOTICE, "Starting a new press journal '%s'", m_Path.c_str());
+        return Create();
+    }
+
+    void Writer::Adopt(void* mapping, size_t const size)
+    {
+        m_Mapping = mapping;
+        m_MappingSize = size;
+        m_Header = static_cast<Header*>(mapping);
+        m_Records = reinterpret_cast<Record*>(m_Header + 1);
+        m_Capacity = m_Header->capacity;
+        m_Committed = m_Header->committed.load(std::memory_order_relaxed);
+    }
+
+    void Writer::Unmap()
+    {
+        if (m_Mapping != nullptr)
+        {
+            munmap(m_Mapping, m_MappingSize);
+        }
+
+        m_Mapping = nullptr;
+        m_MappingSize = 0;
+        m_Header = nullptr;
+        m_Records = nullptr;
+        m_Committed = 0;
+        m_Capacity = 0;
+    }
+
+    void Writer::Prepare()
+    {
+        // A spare is only made once the last one has been swapped in and renamed into place, or if making the last
+        // one failed. Either way nothing is appending to path.next while it's made
+        bool needSpare = m_Spare.load(std::memory_order_acquire) == nullptr;
+        while (true)
+        {
+            uint64_t wakes = 0;
+            if (read(m_WakeHandle, &wakes, sizeof(wakes)) < 0 && errno != EINTR)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to wait on the press journal [%s]", strerror(errno));
+                return;
+            }
+
+            void* const retired = m_Retired.exchange(nullptr, std::memory_order_acquire);
+            if (retired != nullptr)
+            {
+                msync(retired, m_RetiredSize, MS_ASYNC);
+                munmap(retired, m_RetiredSize);
+
+                // The spare, already being appended to, takes the full file's place
+                ShiftFiles(m_Path, m_Files);
+                std::string const nextPath = NextPath(m_Path);
+                if (rename(nextPath.c_str(), m_Path.c_str()) != 0)
+                {
+                    DOORBELLPI_LOG(LOG_ERR, "Failed to rename press journal '%s' [%s]", nextPath.c_str(), strerror(errno));
+                }
+                DOORBELLPI_LOG(LOG_NOTICE, "Started a new press journal '%s'", m_Path.c_str());
+                needSpare = true;
+            }
+
+            if (m_Stopping.load(std::memory_order_acquire))
+            {
+                return;
+            }
+
+            if (needSpare)
+            {
+                void* const spare = CreateFile(NextPath(m_Path), m_RecordsPerFile);
+                needSpare = spare == nullptr;
+                m_Spare.store(spare, std::memory_order_release);
+            }
+        }
+    }
+
+    void Writer::Wake()
+    {
+        uint64_t const wake = 1;
+        write(m_WakeHandle, &wake, sizeof(wake));
+    }
+
+    Reader::~Reader()
+    {
+        Close();
+    }
+
+    bool Reader::Open(std::string const& path)
+    {
+        Close();
+
+        int const handle = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (handle < 0)
+        {
+            return false;
+        }
+
+        struct stat status;
+        void* mapping = MAP_FAILED;
+        if (fstat(handle, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(Header))
+        {
+            mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, handle, 0);
+        }
+        close(handle);
+
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        if (!IsValid(*static_cast<Header const*>(mapping), status.st_size))
+        {
+            munmap(mapping, status.st_size);
+            return false;
+        }
+
+        m_Mapping = mapping;
+        m_MappingSize = status.st_size;
+        m_Header = static_cast<Header const*>(mapping);
+        m_Records = reinterpret_cast<Record const*>(m_Header + 1);
+        m_Capacity = m_Header->capacity;
+        return true;
+    }
+
+    void Reader::Close()
+    {
+        if (m_Mapping != nullptr)
+        {
+            munmap(const_cast<void*>(m_Mapping), m_MappingSize);
+        }
+
+        m_Mapping = nullptr;
+        m_MappingSize = 0;
+        m_Header = nullptr;
+        m_Records = nullptr;
+        m_Capacity = 0;
+    }
+
+    size_t Reader::Size() const
+    {
+        if (m_Header == nullptr)
+        {
+            return 0;
+        }
+
+        // Checked again, as the file is shared with a writer that may not be this code
+        uint64_t const committed = m_Header->committed.load(std::memory_order_acquire);
+        return static_cast<size_t>(committed <= m_Capacity ? committed : m_Capacity);
+    }
+
+    Record const& Reader::operator[](size_t const index) const
+    {
+        return m_Records[index];
+    }
+
+    std::vector<std::string> Files(std::string const& path, size_t const files)
+    {
+        std::vector<std::string> existing;
+        for (size_t index = files; index > 0; --index)
+        {
+            std::string const rotatedPath = RotatedPath(path, index - 1);
+            if (access(rotatedPath.c_str(), F_OK) == 0)
+            {
+                existing.push_back(rotatedPath);
+            }
+        }
+        return existing;
+    }
+
+    void SetPattern(Record& record, std::string const& name)
+    {
+        memset(record.pattern, 0, sizeof(record.pattern));
+        memcpy(record.pattern, name.data(), name.size() < sizeof(record.pattern) ? name.size() : sizeof(record.pattern));
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A compact binary record of every press, for answering questions like "how many presses last month, at what times
+// and how quickly did they ring" without grepping syslog. Records are fixed width and written into a preallocated,
+// memory mapped file, so appending one is a copy and a store with no system call. Each file starts with a header
+// whose committed count is only advanced once a record is complete, so whatever crashes, a reader never sees a torn
+// record. Full files are rotated: path becomes path.1, path.1 becomes path.2 and so on, the oldest being deleted.
+// The next file is prepared in advance, as path.next, on a thread of the writer's own, which also does the renaming,
+// so the thread appending never waits on the file system
+namespace Journal
+{
+    enum class Outcome : uint8_t
+    {
+        // The first press rang; any others were folded into the ring
+        Rang,
+        // An escalation played after the ring. Not itself a press
+        Escalated,
+        // Every press was folded into a ring still in its cooldown, or still playing
+        Cooldown,
+        Busy,
+    };
+
+    // Little endian, as written by the Pi. One per batch of presses the ring thread handled together
+    struct Record
+    {
+        // Microseconds since the Unix epoch that the first press was read
+        int64_t time;
+        // As flicd sends it, little endian
+        uint8_t buttonAddress[6];
+        uint8_t clickType;
+        Outcome outcome;
+        // How old flicd said the first press was, in seconds
+        uint32_t timeDiff;
+        uint32_t presses;
+        // Nanoseconds from the press being readable to it being decoded, and to its ring being scheduled. Zero when
+        // there was no ring
+        uint32_t decodeLatency;
+        uint32_t ringLatency;
+        // The pattern played, truncated and NUL padded
+        char pattern[16];
+    };
+    static_assert(sizeof(Record) == 48, "Journal records are fixed width");
+
+    struct Header
+    {
+        static constexpr char c_Magic[8] = { 'D', 'B', 'P', 'I', 'J', 'R', 'N', 'L' };
+        static uint32_t const c_Version = 1;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t capacity;
+        // Records before this are complete
+        std::atomic<uint64_t> committed;
+        uint8_t reserved[32];
+    };
+    static_assert(sizeof(Header) == 64, "The journal header is one cache line");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The committed count is shared through the mapping");
+
+    // Opened and closed from one thread, and appended to from one thread, which can be another
+    class Writer
+    {
+    public:
+        Writer() = default;
+        ~Writer();
+
+        Writer(Writer const&) = delete;
+        Writer& operator=(Writer const&) = delete;
+
+        // Carries on from the end of an existing journal, or starts a new one. An unreadable file is rotated out of
+        // the way rather than written over. Has to be called after any signals are blocked, as it starts the
+        // preparing thread
+        bool Open(std::string const& path, size_t const recordsPerFile, size_t const files);
+        void Close();
+        bool IsOpen() const;
+
+        // A copy and a store. When the file is full it switches to the prepared one with a pointer exchange, and
+        // wakes the preparing thread to rotate the files. Returns false if there's no file, or the next one isn't
+        // ready yet
+        bool Append(Record const& record);
+
+        // Blocks until the next file is ready, for a caller filling files faster than they can be prepared
+        bool WaitForNextFile(std::chrono::milliseconds const timeout) const;
+
+    private:
+        bool Resume();
+        bool Create();
+        bool Rotate();
+        void Adopt(void* mapping, size_t const size);
+        void Unmap();
+        void Prepare();
+        void Wake();
+
+        std::string m_Path;
+        size_t m_RecordsPerFile = 0;
+        size_t m_Files = 0;
+
+        // The file being appended to. Only touched by the appending thread once open
+        void* m_Mapping = nullptr;
+        size_t m_MappingSize = 0;
+        Header* m_Header = nullptr;
+        Record* m_Records = nullptr;
+        uint64_t m_Committed = 0;
+        uint64_t m_Capacity = 0;
+
+        // Handed between the appending thread and the preparing one. A full file's mapping is passed over to be
+        // unmapped once it has been replaced by the spare, which is always m_RecordsPerFile records
+        std::atomic<void*> m_Spare{ nullptr };
+        std::atomic<void*> m_Retired{ nullptr };
+        size_t m_RetiredSize = 0;
+        std::atomic<bool> m_Stopping{ false };
+        int m_WakeHandle = -1;
+        std::thread m_Preparer;
+    };
+
+    // Reads a journal file, which may still be being written
+    class Reader
+    {
+    public:
+        Reader() = default;
+        ~Reader();
+
+        Reader(Reader const&) = delete;
+        Reader& operator=(Reader const&) = delete;
+
+        bool Open(std::string const& path);
+        void Close();
+
+        // The complete records so far
+        size_t Size() const;
+        Record const& operator[](size_t const index) const;
+
+    private:
+        void const* m_Mapping = nullptr;
+        size_t m_MappingSize = 0;
+        Header const* m_Header = nullptr;
+        Record const* m_Records = nullptr;
+        uint64_t m_Capacity = 0;
+    };
+
+    // path.<files - 1> down to path, oldest first, leaving out any that don't exist
+    std::vector<std::string> Files(std::string const& path, size_t const files);
+
+    // Copies the name into the record's pattern, truncating it if need be
+    void SetPattern(Record& record, std::string const& name);
+}
@@ -0,0 +1,378 @@
+#include "Log.h"
+
+#include "Metrics.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Per thread. Enough for several hundred typical messages, which is a burst the formatter would have to be well
+    // behind to fill
+    size_t const c_BufferSize = 64 * 1024;
+    size_t const c_RecordAlignment = 8;
+    // Longer records are dropped rather than tying up a large part of the buffer
+    size_t const c_MaxRecordSize = 2048;
+    size_t const c_MaxTextLength = 1024;
+    // How often the formatter looks for new records when there weren't any last time
+    std::chrono::milliseconds const c_IdlePeriod = std::chrono::milliseconds(10);
+    // Marks the unused space at the end of the buffer when a record didn't fit before wrapping
+    int32_t const c_PaddingPriority = -1;
+
+    struct RecordHeader
+    {
+        uint32_t size;
+        int32_t priority;
+        Log::Detail::FormatFunction formatter;
+        char const* format;
+    };
+
+    static_assert(sizeof(RecordHeader) % c_RecordAlignment == 0, "Records must stay aligned");
+
+    size_t AlignRecord(size_t const size)
+    {
+        return (size + c_RecordAlignment - 1) & ~(c_RecordAlignment - 1);
+    }
+
+    // A byte ring between the thread that owns it and the formatter thread. Records never wrap: if one won't fit in
+    // the space before the end, that space is padded out and the record starts again at the beginning
+    class ThreadBuffer
+    {
+    public:
+        // Owning thread only. Returns the record's payload, to be published by Commit
+        uint8_t* Reserve(size_t const recordSize)
+        {
+            size_t const tail = m_Tail.load(std::memory_order_relaxed);
+            size_t const offset = tail % c_BufferSize;
+            size_t const contiguous = c_BufferSize - offset;
+            size_t const needed = contiguous < recordSize ? contiguous + recordSize : recordSize;
+
+            if (c_BufferSize - (tail - m_CachedHead) < needed)
+            {
+                m_CachedHead = m_Head.load(std::memory_order_acquire);
+                if (c_BufferSize - (tail - m_CachedHead) < needed)
+                {
+                    return nullptr;
+                }
+            }
+
+            size_t start = offset;
+            if (contiguous < recordSize)
+            {
+                RecordHeader* const padding = reinterpret_cast<RecordHeader*>(m_Data.get() + offset);
+                padding->size = static_cast<uint32_t>(contiguous);
+                padding->priority = c_PaddingPriority;
+                start = 0;
+            }
+
+            m_PendingTail = tail + needed;
+            return m_Data.get() + start;
+        }
+
+        void Commit()
+        {
+            m_Tail.store(m_PendingTail, std::memory_order_release);
+        }
+
+        // Owning thread only. Set around a record being written, so Stop can wait for any it would otherwise miss.
+        // Sequentially consistent with the check of whether the logger is running that follows it
+        void SetWriting(bool const writing)
+        {
+            m_Writing.store(writing, writing ? std::memory_order_seq_cst : std::memory_order_release);
+        }
+
+        bool IsWriting() const
+        {
+            return m_Writing.load(std::memory_order_acquire);
+        }
+
+        // Formatter thread only. Returns whether there was anything
+        bool Drain()
+        {
+            size_t head = m_Head.load(std::memory_order_relaxed);
+            size_t const tail = m_Tail.load(std::memory_order_acquire);
+            if (head == tail)
+            {
+                return false;
+            }
+
+            char text[c_MaxTextLength];
+            while (head != tail)
+            {
+                RecordHeader const* const header = reinterpret_cast<RecordHeader const*>(m_Data.get() + head % c_BufferSize);
+                if (header->priority != c_PaddingPriority)
+                {
+                    header->formatter(header->format, reinterpret_cast<uint8_t const*>(header + 1), text, sizeof(text));
+                    syslog(header->priority, "%s", text);
+                }
+                head += header->size;
+            }
+
+            m_Head.store(head, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        static size_t const c_CacheLineSize = 64;
+
+        std::unique_ptr<uint8_t[]> m_Data{ new uint8_t[c_BufferSize] };
+        alignas(c_CacheLineSize) std::atomic<size_t> m_Head{ 0 };
+        alignas(c_CacheLineSize) std::atomic<size_t> m_Tail{ 0 };
+        std::atomic<bool> m_Writing{ false };
+        size_t m_CachedHead = 0;
+        size_t m_PendingTail = 0;
+    };
+
+    struct Logger
+    {
+        // In case Stop() was never called; a thread that's still joinable would terminate the process on exit
+        ~Logger()
+        {
+            if (thread.joinable())
+            {
+                running = false;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stopping = true;
+                }
+                wake.notify_one();
+                thread.join();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        // Buffers outlive their threads so that nothing they wrote is lost; a thread's buffer is only allocated the
+        // first time it logs, and the daemon's threads are long lived
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::thread thread;
+        bool stopping = false;
+        std::atomic<bool> running{ false };
+        std::atomic<uint64_t> dropped{ 0 };
+    };
+
+    Logger& GetLogger()
+    {
+        static Logger s_Logger;
+        return s_Logger;
+    }
+
+    struct ThreadState
+    {
+        ThreadBuffer* buffer = nullptr;
+        // Where a message is built when it's going straight to syslog
+        bool direct = false;
+        alignas(c_RecordAlignment) uint8_t scratch[c_MaxRecordSize];
+    };
+
+    thread_local ThreadState s_ThreadState;
+
+    ThreadBuffer* GetThreadBuffer()
+    {
+        if (s_ThreadState.buffer == nullptr)
+        {
+            Logger& logger = GetLogger();
+            std::lock_guard<std::mutex> lock(logger.mutex);
+            logger.buffers.emplace_back(new ThreadBuffer());
+            s_ThreadState.buffer = logger.buffers.back().get();
+        }
+        return s_ThreadState.buffer;
+    }
+
+    // Returns whether any records were found
+    bool DrainAll(Logger& logger)
+    {
+        std::vector<ThreadBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(logger.mutex);
+            buffers.reserve(logger.buffers.size());
+            for (auto const& buffer : logger.buffers)
+            {
+                buffers.push_back(buffer.get());
+            }
+        }
+
+        bool drained = false;
+        for (ThreadBuffer* buffer : buffers)
+        {
+            drained |= buffer->Drain();
+        }
+        return drained;
+    }
+
+    void RunFormatter(Logger& logger)
+    {
+        uint64_t reportedDrops = 0;
+        while (true)
+        {
+            bool const drained = DrainAll(logger);
+
+            uint64_t const dropped = logger.dropped.load(std::memory_order_relaxed);
+            if (dropped != reportedDrops)
+            {
+                syslog(LOG_WARNING, "Dropped %llu log messages as the buffers were full", static_cast<unsigned long long>(dropped - reportedDrops));
+                reportedDrops = dropped;
+            }
+
+            std::unique_lock<std::mutex> lock(logger.mutex);
+            if (logger.stopping)
+            {
+                break;
+            }
+            if (!drained)
+            {
+                logger.wake.wait_for(lock, c_IdlePeriod);
+            }
+        }
+    }
+}
+
+namespace Log
+{
+    namespace Detail
+    {
+        std::atomic<int> g_Level{ LOG_NOTICE };
+
+        uint8_t* Begin(int const priority, FormatFunction formatter, char const* format, size_t const payloadSize)
+        {
+            size_t const recordSize = AlignRecord(sizeof(RecordHeader) + payloadSize);
+            if (recordSize > c_MaxRecordSize)
+            {
+                GetLogger().dropped.fetch_add(1, std::memory_order_relaxed);
+                Metrics::Global().logMessagesDropped.Increment();
+                return nullptr;
+            }
+
+            // Checked again once this thread is marked as writing, as Stop may have started in between
+            uint8_t* record = nullptr;
+            s_ThreadState.direct = !GetLogger().running.load(std::memory_order_acquire);
+            if (!s_ThreadState.direct)
+            {
+                GetThreadBuffer()->SetWriting(true);
+                s_ThreadState.direct = !GetLogger().running.load(std::memory_order_seq_cst);
+                if (s_ThreadState.direct)
+                {
+                    s_ThreadState.buffer->SetWriting(false);
+                }
+            }
+
+            if (s_ThreadState.direct)
+            {
+                record = s_ThreadState.scratch;
+            }
+            else
+            {
+                record = s_ThreadState.buffer->Reserve(recordSize);
+                if (record == nullptr)
+                {
+                    s_ThreadState.buffer->SetWriting(false);
+                    GetLogger().dropped.fetch_add(1, std::memory_order_relaxed);
+                    Metrics::Global().logMessagesDropped.Increment();
+                    return nullptr;
+                }
+            }
+
+            RecordHeader* const header = reinterpret_cast<RecordHeader*>(record);
+            header->size = static_cast<uint32_t>(recordSize);
+            header->priority = priority;
+            header->formatter = formatter;
+            header->format = format;
+            return reinterpret_cast<uint8_t*>(header + 1);
+        }
+
+        void End()
+        {
+            if (s_ThreadState.direct)
+            {
+                RecordHeader const* const header = reinterpret_cast<RecordHeader const*>(s_ThreadState.scratch);
+                char text[c_MaxTextLength];
+                header->formatter(header->format, reinterpret_cast<uint8_t const*>(header + 1), text, sizeof(text));
+                syslog(header->priority, "%s", text);
+                return;
+            }
+
+            s_ThreadState.buffer->Commit();
+            s_ThreadState.buffer->SetWriting(false);
+        }
+    }
+
+    bool Start()
+    {
+        Logger& logger = GetLogger();
+        if (logger.running)
+        {
+            return true;
+        }
+
+        logger.stopping = false;
+        try
+        {
+            logger.thread = std::thread(RunFormatter, std::ref(logger));
+        }
+        catch (std::system_error const& error)
+        {
+            syslog(LOG_ERR, "Failed to start the logging thread [%s]", error.what());
+            return false;
+        }
+
+        logger.running = true;
+        return true;
+    }
+
+    void Stop()
+    {
+        Logger& logger = GetLogger();
+        if (!logger.running)
+        {
+            return;
+        }
+
+        // From here on messages go straight to syslog. Anything written just before is picked up by the final drain,
+        // once every thread that had already seen the logger running has finished its record
+        logger.running.store(false, std::memory_order_seq_cst);
+        {
+            std::lock_guard<std::mutex> lock(logger.mutex);
+            logger.stopping = true;
+        }
+        logger.wake.notify_one();
+        logger.thread.join();
+
+        std::vector<ThreadBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(logger.mutex);
+            for (auto const& buffer : logger.buffers)
+            {
+                buffers.push_back(buffer.get());
+            }
+        }
+        for (ThreadBuffer const* buffer : buffers)
+        {
+            while (buffer->IsWriting())
+            {
+                std::this_thread::yield();
+            }
+        }
+        DrainAll(logger);
+    }
+
+    void SetLevel(int const priority)
+    {
+        Detail::g_Level.store(priority, std::memory_order_relaxed);
+    }
+
+    int GetLevel()
+    {
+        return Detail::g_Level.load(std::memory_order_relaxed);
+    }
+
+    uint64_t DroppedCount()
+    {
+        return GetLogger().dropped.load(std::memory_order_relaxed);
+    }
+}
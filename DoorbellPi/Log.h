@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <tuple>
+#include <type_traits>
+
+// Logging that stays off the hot path. DOORBELLPI_LOG(priority, format, args...) takes the same arguments as syslog()
+// and has its format checked the same way, but rather than formatting and writing to /dev/log there and then it
+// copies the format string's address and the raw arguments into a lock free ring buffer owned by the calling thread.
+// A background thread formats the records and passes them on to syslog. Messages below the current level cost one
+// atomic load; if a thread's buffer is full the message is dropped and counted rather than the caller waiting.
+// Until Start() (and after Stop()) messages go straight to syslog, as they did before
+#define DOORBELLPI_LOG(priority, ...) \
+    do \
+    { \
+        if (Log::IsEnabled(priority)) \
+        { \
+            if (false) \
+            { \
+                Log::Detail::CheckFormat(__VA_ARGS__); \
+            } \
+            Log::Write(priority, __VA_ARGS__); \
+        } \
+    } while (false)
+
+namespace Log
+{
+    // The background thread has to be started after forking and after any signals are blocked
+    bool Start();
+    void Stop();
+
+    // A syslog priority such as LOG_NOTICE. Messages of lower priority (a higher number) are discarded
+    void SetLevel(int const priority);
+    int GetLevel();
+    uint64_t DroppedCount();
+
+    namespace Detail
+    {
+        extern std::atomic<int> g_Level;
+
+        inline void CheckFormat(char const*, ...) __attribute__((format(printf, 1, 2)));
+        inline void CheckFormat(char const*, ...) {}
+
+        using FormatFunction = void (*)(char const* format, uint8_t const* payload, char* text, size_t textSize);
+
+        // Strings are copied, up to this length, as the pointer won't be valid by the time they're formatted
+        static size_t const c_MaxStringLength = 255;
+
+        // Scalars are stored as they are; anything else would need its lifetime thinking about
+        template<typename Type>
+        struct Argument
+        {
+            static_assert(std::is_arithmetic<Type>::value || std::is_enum<Type>::value || std::is_pointer<Type>::value,
+                "Only scalars and C strings can be logged");
+
+            static size_t Size(Type const&) { return sizeof(Type); }
+
+            static void Encode(Type const& value, uint8_t* payload, size_t& offset)
+            {
+                memcpy(payload + offset, &value, sizeof(Type));
+                offset += sizeof(Type);
+            }
+
+            static Type Decode(uint8_t const* payload, size_t& offset)
+            {
+                Type value;
+                memcpy(&value, payload + offset, sizeof(Type));
+                offset += sizeof(Type);
+                return value;
+            }
+        };
+
+        template<>
+        struct Argument<char const*>
+        {
+            static size_t Length(char const* value)
+            {
+                return value == nullptr ? 0 : strnlen(value, c_MaxStringLength);
+            }
+
+            static size_t Size(char const* value) { return 1 + Length(value) + 1; }
+
+            static void Encode(char const* value, uint8_t* payload, size_t& offset)
+            {
+                size_t const length = Length(value);
+                payload[offset++] = static_cast<uint8_t>(length);
+                memcpy(payload + offset, value, length);
+                offset += length;
+                payload[offset++] = '\0';
+            }
+
+            static char const* Decode(uint8_t const* payload, size_t& offset)
+            {
+                size_t const length = payload[offset++];
+                char const* const value = reinterpret_cast<char const*>(payload + offset);
+                offset += length + 1;
+                return value;
+            }
+        };
+
+        template<>
+        struct Argument<char*> : Argument<char const*> {};
+
+        template<typename... Args>
+        void Format(char const* format, uint8_t const* payload, char* text, size_t textSize)
+        {
+            // A braced initialiser is evaluated left to right, so the arguments come back out in the order they went in
+            size_t offset = 0;
+            std::tuple<decltype(Argument<Args>::Decode(payload, offset))...> const values{ Argument<Args>::Decode(payload, offset)... };
+            (void)payload;
+            (void)offset;
+
+            if constexpr (sizeof...(Args) == 0)
+            {
+                snprintf(text, textSize, "%s", format);
+            }
+            else
+            {
+                std::apply([format, text, textSize](auto... arguments)
+                {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+                    snprintf(text, textSize, format, arguments...);
+#pragma GCC diagnostic pop
+                }, values);
+            }
+        }
+
+        // Returns where to write payloadSize bytes of arguments, or nullptr if the message has to be dropped. Every
+        // non-null Begin() must be followed by an End() on the same thread
+        uint8_t* Begin(int const priority, FormatFunction formatter, char const* format, size_t const payloadSize);
+        void End();
+    }
+
+    inline bool IsEnabled(int const priority)
+    {
+        return priority <= Detail::g_Level.load(std::memory_order_relaxed);
+    }
+
+    // Use DOORBELLPI_LOG, which checks the level first and the format at compile time. format must be a string
+    // literal, or at least outlive the process's logging
+    template<typename... Args>
+    void Write(int const priority, char const* format, Args... args)
+    {
+        size_t const payloadSize = (Detail::Argument<Args>::Size(args) + ... + 0);
+        uint8_t* const payload = Detail::Begin(priority, &Detail::Format<Args...>, format, payloadSize);
+        if (payload == nullptr)
+        {
+            return;
+        }
+
+        size_t offset = 0;
+        (Detail::Argument<Args>::Encode(args, payload, offset), ...);
+        (void)offset;
+        Detail::End();
+    }
+}
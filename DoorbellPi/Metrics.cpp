@@ -0,0 +1,225 @@
+#include "Metrics.h"
+
+#include "Log.h"
+
+#include <stdio.h>
+
+namespace
+{
+    void AppendDouble(std::string& output, double const value)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.9g", value);
+        output += text;
+    }
+
+    char const* const c_LatencyModeLabels[Flic::Codec::c_LatencyModeCount] =
+    {
+        "mode=\"normal\"",
+        "mode=\"low\"",
+        "mode=\"high\"",
+    };
+
+    void RenderCounter(std::string& output, char const* name, char const* help, Metrics::Counter const& counter)
+    {
+        output += "# HELP ";
+        output += name;
+        output += " ";
+        output += help;
+        output += "\n# TYPE ";
+        output += name;
+        output += " counter\n";
+        output += name;
+        output += " " + std::to_string(counter.Value()) + "\n";
+    }
+
+    void RenderGauge(std::string& output, char const* name, char const* help, Metrics::Gauge const& gauge)
+    {
+        output += "# HELP ";
+        output += name;
+        output += " ";
+        output += help;
+        output += "\n# TYPE ";
+        output += name;
+        output += " gauge\n";
+        output += name;
+        output += " " + std::to_string(gauge.Value()) + "\n";
+    }
+}
+
+namespace Metrics
+{
+    Histogram::Histogram(double const unitScale, std::initializer_list<uint64_t> upperBounds)
+        : m_UnitScale(unitScale)
+    {
+        for (uint64_t const upperBound : upperBounds)
+        {
+            if (m_BoundCount == c_MaxBuckets)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Histogram has more than %zu buckets, ignoring the rest", c_MaxBuckets);
+                break;
+            }
+            m_UpperBounds[m_BoundCount++] = upperBound;
+        }
+
+        for (std::atomic<uint64_t>& count : m_Counts)
+        {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::Render(std::string& output, char const* name, char const* help) const
+    {
+        output += "# HELP ";
+        output += name;
+        output += " ";
+        output += help;
+        output += "\n# TYPE ";
+        output += name;
+        output += " histogram\n";
+        RenderSeries(output, name, "");
+    }
+
+    void Histogram::RenderSeries(std::string& output, char const* name, char const* labels) const
+    {
+        bool const hasLabels = labels[0] != '\0';
+
+        // Prometheus buckets are cumulative. The counts are read one at a time while they may be changing, so a
+        // scrape is only consistent to within the observations made while it was running
+        uint64_t cumulative = 0;
+        for (size_t bucket = 0; bucket <= m_BoundCount; ++bucket)
+        {
+            cumulative += m_Counts[bucket].load(std::memory_order_relaxed);
+            output += name;
+            output += "_bucket{";
+            if (hasLabels)
+            {
+                output += labels;
+                output += ",";
+            }
+            output += "le=\"";
+            if (bucket < m_BoundCount)
+            {
+                AppendDouble(output, static_cast<double>(m_UpperBounds[bucket]) * m_UnitScale);
+            }
+            else
+            {
+                output += "+Inf";
+            }
+            output += "\"} " + std::to_string(cumulative) + "\n";
+        }
+
+        std::string const labelSet = hasLabels ? std::string("{") + labels + "}" : std::string();
+        output += name;
+        output += "_sum" + labelSet + " ";
+        AppendDouble(output, static_cast<double>(m_Sum.load(std::memory_order_relaxed)) * m_UnitScale);
+        output += "\n";
+        output += name;
+        output += "_count" + labelSet + " " + std::to_string(cumulative) + "\n";
+    }
+
+    LatencyHistogram::LatencyHistogram()
+        : Histogram(1e-9,
+            {
+                1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+                1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000, 250000000, 500000000,
+                1000000000,
+            })
+    {
+    }
+
+    EventAgeHistogram::EventAgeHistogram()
+        : Histogram(1.0, { 0, 1, 2, 5, 10, 30, 60, 300 })
+    {
+    }
+
+    Daemon& Global()
+    {
+        static Daemon s_Metrics;
+        return s_Metrics;
+    }
+
+    std::string RenderPrometheus(Daemon const& metrics)
+    {
+        std::string output;
+        output.reserve(8192);
+
+        metrics.readableToDecoded.Render(output, "doorbellpi_press_decoded_seconds",
+            "Time from the flicd socket becoming readable to the button event being decoded");
+        metrics.readableToScheduled.Render(output, "doorbellpi_press_scheduled_seconds",
+            "Time from the flicd socket becoming readable to the ring being scheduled");
+        metrics.readableToFirstEdge.Render(output, "doorbellpi_press_first_edge_seconds",
+            "Time from the flicd socket becoming readable to the first GPIO edge of the ring being written");
+        metrics.edgeLateness.Render(output, "doorbellpi_ring_edge_lateness_seconds",
+            "How late each ring edge was written compared to its deadline");
+        metrics.pingRoundTrip.Render(output, "doorbellpi_flicd_ping_seconds",
+            "Round trip time of pings to flicd");
+
+        output += "# HELP doorbellpi_button_time_diff_seconds Button event time_diff as flicd reports it, in whole seconds, by the channel's latency mode\n";
+        output += "# TYPE doorbellpi_button_time_diff_seconds histogram\n";
+        for (size_t mode = 0; mode < metrics.buttonTimeDiff.size(); ++mode)
+        {
+            metrics.buttonTimeDiff[mode].RenderSeries(output, "doorbellpi_button_time_diff_seconds", c_LatencyModeLabels[mode]);
+        }
+
+        metrics.reconnectTime.Render(output, "doorbellpi_flicd_reconnect_seconds",
+            "Time from losing the connection to flicd to being connected again");
+
+        output += "# HELP doorbellpi_flicd_packets_total Packets received from flicd, by opcode\n";
+        output += "# TYPE doorbellpi_flicd_packets_total counter\n";
+        for (size_t opcode = 0; opcode < metrics.packetsByOpcode.size(); ++opcode)
+        {
+            output += "doorbellpi_flicd_packets_total{opcode=\"" + std::to_string(opcode) + "\"} "
+                + std::to_string(metrics.packetsByOpcode[opcode].Value()) + "\n";
+        }
+        output += "doorbellpi_flicd_packets_total{opcode=\"unknown\"} " + std::to_string(metrics.unknownPackets.Value()) + "\n";
+
+        RenderCounter(output, "doorbellpi_flicd_truncated_packets_total", "Packets from flicd too short for their opcode", metrics.truncatedPackets);
+        RenderCounter(output, "doorbellpi_flicd_connections_total", "Successful connections to flicd", metrics.connections);
+        RenderCounter(output, "doorbellpi_flicd_reconnects_total", "Connections to flicd after the first", metrics.reconnects);
+        RenderCounter(output, "doorbellpi_flicd_disconnections_total", "Connections to flicd that were lost or closed", metrics.disconnections);
+        RenderCounter(output, "doorbellpi_flicd_connect_failures_total", "Attempts to connect to flicd that failed", metrics.connectFailures);
+        RenderCounter(output, "doorbellpi_flicd_channels_recreated_total", "Connection channels created again after flicd removed them", metrics.channelsRecreated);
+
+        output += "# HELP doorbellpi_flicd_channels Connection channels, by the latency mode asked of flicd\n";
+        output += "# TYPE doorbellpi_flicd_channels gauge\n";
+        for (size_t mode = 0; mode < metrics.channelsByLatencyMode.size(); ++mode)
+        {
+            output += std::string("doorbellpi_flicd_channels{") + c_LatencyModeLabels[mode] + "} "
+                + std::to_string(metrics.channelsByLatencyMode[mode].Value()) + "\n";
+        }
+        RenderCounter(output, "doorbellpi_flicd_latency_mode_changes_total", "Changes of a channel's latency mode sent to flicd", metrics.latencyModeChanges);
+
+        RenderCounter(output, "doorbellpi_flicd_pings_missed_total", "Pings to flicd not answered before the next was due", metrics.pingsMissed);
+        RenderCounter(output, "doorbellpi_flicd_liveness_timeouts_total", "Connections to flicd dropped because it stopped answering pings", metrics.livenessTimeouts);
+        RenderGauge(output, "doorbellpi_bluetooth_controller_state", "flicd's Bluetooth controller: 0 detached, 1 resetting, 2 attached", metrics.bluetoothControllerState);
+        RenderCounter(output, "doorbellpi_bluetooth_controller_state_changes_total", "Changes of state reported for flicd's Bluetooth controller", metrics.bluetoothControllerStateChanges);
+
+        output += "# HELP doorbellpi_presses_ignored_total Button presses that didn't ring, by reason\n";
+        output += "# TYPE doorbellpi_presses_ignored_total counter\n";
+        output += "doorbellpi_presses_ignored_total{reason=\"stale\"} " + std::to_string(metrics.pressesStale.Value()) + "\n";
+        output += "doorbellpi_presses_ignored_total{reason=\"unknown_channel\"} " + std::to_string(metrics.pressesUnknownChannel.Value()) + "\n";
+        output += "doorbellpi_presses_ignored_total{reason=\"cooldown\"} " + std::to_string(metrics.pressesCooldown.Value()) + "\n";
+        output += "doorbellpi_presses_ignored_total{reason=\"busy\"} " + std::to_string(metrics.pressesBusy.Value()) + "\n";
+        RenderCounter(output, "doorbellpi_rings_total", "Rings started", metrics.rings);
+        RenderCounter(output, "doorbellpi_rings_escalated_total", "Escalation rings played after repeated presses", metrics.ringsEscalated);
+        RenderGauge(output, "doorbellpi_ring_queue_depth_max", "The most presses waiting for the ring thread at once", metrics.ringQueueDepthMax);
+
+        RenderCounter(output, "doorbellpi_journal_failures_total", "Press journal records that couldn't be written", metrics.journalFailures);
+
+        RenderGauge(output, "doorbellpi_memory_locked", "1 if the daemon's memory is locked and prefaulted", metrics.memoryLocked);
+        RenderGauge(output, "doorbellpi_ring_thread_realtime", "1 if the ring thread runs under SCHED_FIFO on its own core as configured", metrics.ringThreadRealTime);
+
+        output += "# HELP doorbellpi_config_reloads_total Settings reloaded, by whether they were applied or rejected and the old ones kept\n";
+        output += "# TYPE doorbellpi_config_reloads_total counter\n";
+        output += "doorbellpi_config_reloads_total{result=\"applied\"} " + std::to_string(metrics.configReloads.Value()) + "\n";
+        output += "doorbellpi_config_reloads_total{result=\"rejected\"} " + std::to_string(metrics.configReloadsRejected.Value()) + "\n";
+
+        RenderCounter(output, "doorbellpi_notifications_delivered_total", "Presses acknowledged by the cloud service", metrics.notificationsDelivered);
+        RenderCounter(output, "doorbellpi_notifications_dropped_total", "Presses dropped because the notification queue was full", metrics.notificationsDropped);
+
+        RenderCounter(output, "doorbellpi_log_messages_dropped_total", "Log messages dropped because a thread's log buffer was full", metrics.logMessagesDropped);
+
+        return output;
+    }
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "FlicCodec.h"
+
+namespace Metrics
+{
+    // Every update is a single relaxed atomic add on memory allocated up front, so they can be left in the hot path.
+    // Only rendering them, which happens off the hot path, allocates
+    class Counter
+    {
+    public:
+        void Increment(uint64_t const amount = 1)
+        {
+            m_Value.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        uint64_t Value() const
+        {
+            return m_Value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> m_Value{ 0 };
+    };
+
+    // A value that can go down as well as up
+    class Gauge
+    {
+    public:
+        void Set(int64_t const value)
+        {
+            m_Value.store(value, std::memory_order_relaxed);
+        }
+
+        int64_t Value() const
+        {
+            return m_Value.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<int64_t> m_Value{ 0 };
+    };
+
+    // Counts observations into fixed buckets, Prometheus style. Values are integers in whatever unit suits the caller
+    // (nanoseconds for latencies) and unitScale converts them to the unit they're reported in
+    class Histogram
+    {
+    public:
+        static size_t const c_MaxBuckets = 24;
+
+        Histogram(double const unitScale, std::initializer_list<uint64_t> upperBounds);
+
+        Histogram(Histogram const&) = delete;
+        Histogram& operator=(Histogram const&) = delete;
+
+        void Record(uint64_t const value)
+        {
+            // A short linear scan beats a binary search at this size, and there's no cheaper way to the bucket for
+            // bounds that aren't powers of two
+            size_t bucket = 0;
+            while (bucket < m_BoundCount && value > m_UpperBounds[bucket])
+            {
+                ++bucket;
+            }
+
+            m_Counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            m_Sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        void Record(std::chrono::nanoseconds const duration)
+        {
+            Record(static_cast<uint64_t>(duration.count() < 0 ? 0 : duration.count()));
+        }
+
+        // Appends the _bucket, _sum and _count series, preceded by the HELP and TYPE lines
+        void Render(std::string& output, char const* name, char const* help) const;
+        // Just the series, with labels such as mode="low" added to each, for one of several histograms sharing a name
+        void RenderSeries(std::string& output, char const* name, char const* labels) const;
+
+    private:
+        double const m_UnitScale;
+        size_t m_BoundCount = 0;
+        std::array<uint64_t, c_MaxBuckets> m_UpperBounds;
+        // One more than the bounds, the last being +Inf
+        std::array<std::atomic<uint64_t>, c_MaxBuckets + 1> m_Counts;
+        std::atomic<uint64_t> m_Sum{ 0 };
+    };
+
+    // Latency buckets from 1 us to 1 s, recorded in nanoseconds and reported in seconds
+    class LatencyHistogram : public Histogram
+    {
+    public:
+        LatencyHistogram();
+    };
+
+    // Button event ages as flicd reports them, in whole seconds
+    class EventAgeHistogram : public Histogram
+    {
+    public:
+        EventAgeHistogram();
+    };
+
+    // Everything the daemon measures. The press latencies are all measured from the moment the flicd socket was
+    // reported readable, so each stage includes the ones before it
+    struct Daemon
+    {
+        LatencyHistogram readableToDecoded;
+        LatencyHistogram readableToScheduled;
+        LatencyHistogram readableToFirstEdge;
+        LatencyHistogram edgeLateness;
+        LatencyHistogram pingRoundTrip;
+        // How old flicd says a button event was when it was sent, by the latency mode of its channel. Whole seconds,
+        // so it shows events held back while a button was out of range rather than what a mode costs in latency;
+        // flicd gives no finer press time, so that's measured against the fake flicd by LatencyModeBenchmark
+        std::array<EventAgeHistogram, Flic::Codec::c_LatencyModeCount> buttonTimeDiff;
+        // From losing the connection to flicd to having it back, in milliseconds
+        Histogram reconnectTime{ 1e-3, { 1, 5, 10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000, 300000 } };
+
+        std::array<Counter, Flic::Codec::c_EventOpcodeCount> packetsByOpcode;
+        Counter unknownPackets;
+        Counter truncatedPackets;
+        Counter connections;
+        Counter reconnects;
+        Counter disconnections;
+        Counter connectFailures;
+        Counter channelsRecreated;
+        std::array<Gauge, Flic::Codec::c_LatencyModeCount> channelsByLatencyMode;
+        Counter latencyModeChanges;
+        Counter pingsMissed;
+        Counter livenessTimeouts;
+        // As FlicClientProtocol::BluetoothControllerState: 0 detached, 1 resetting, 2 attached
+        Gauge bluetoothControllerState;
+        Counter bluetoothControllerStateChanges;
+
+        Counter pressesStale;
+        Counter pressesUnknownChannel;
+        Counter pressesCooldown;
+        Counter pressesBusy;
+        Counter rings;
+        Counter ringsEscalated;
+        // The most presses waiting for the ring thread at once
+        Gauge ringQueueDepthMax;
+
+        Counter journalFailures;
+
+        // 1 if the memory is locked, and if the ring thread got all of its real-time policy
+        Gauge memoryLocked;
+        Gauge ringThreadRealTime;
+
+        Counter configReloads;
+        Counter configReloadsRejected;
+
+        Counter notificationsDelivered;
+        Counter notificationsDropped;
+
+        Counter logMessagesDropped;
+    };
+
+    Daemon& Global();
+
+    // Prometheus text exposition format (version 0.0.4)
+    std::string RenderPrometheus(Daemon const& metrics);
+}
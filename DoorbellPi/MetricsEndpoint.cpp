@@ -0,0 +1,193 @@
+#include "MetricsEndpoint.h"
+
+#include "EventLoop.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    size_t const c_MaxClients = 8;
+    size_t const c_MaxRequestSize = 4096;
+}
+
+namespace Metrics
+{
+    Endpoint::Endpoint(EventLoop& eventLoop, Daemon const& metrics)
+        : m_EventLoop(eventLoop)
+        , m_Metrics(metrics)
+    {
+    }
+
+    Endpoint::~Endpoint()
+    {
+        Close();
+    }
+
+    bool Endpoint::Listen(std::string const& socketPath)
+    {
+        Close();
+
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Metrics socket path '%s' is too long", socketPath.c_str());
+            return false;
+        }
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        m_ListenHandle = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_ListenHandle < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to create metrics socket [%s]", strerror(errno));
+            m_ListenHandle = -1;
+            return false;
+        }
+
+        // A socket left behind by an earlier run would stop the bind
+        unlink(socketPath.c_str());
+        if (bind(m_ListenHandle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+            || listen(m_ListenHandle, static_cast<int>(c_MaxClients)) < 0)
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to listen on metrics socket '%s' [%s]", socketPath.c_str(), strerror(errno));
+            Close();
+            return false;
+        }
+        m_SocketPath = socketPath;
+
+        if (!m_EventLoop.AddDescriptor(m_ListenHandle, EPOLLIN, [this](uint32_t) { OnAcceptable(); }))
+        {
+            Close();
+            return false;
+        }
+
+        DOORBELLPI_LOG(LOG_NOTICE, "Serving metrics on '%s'", socketPath.c_str());
+        return true;
+    }
+
+    void Endpoint::Close()
+    {
+        while (!m_Clients.empty())
+        {
+            CloseClient(m_Clients.begin()->first);
+        }
+
+        if (m_ListenHandle >= 0)
+        {
+            m_EventLoop.RemoveDescriptor(m_ListenHandle);
+            close(m_ListenHandle);
+            m_ListenHandle = -1;
+        }
+
+        if (!m_SocketPath.empty())
+        {
+            unlink(m_SocketPath.c_str());
+            m_SocketPath.clear();
+        }
+    }
+
+    void Endpoint::OnAcceptable()
+    {
+        while (true)
+        {
+            int const clientHandle = accept4(m_ListenHandle, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (clientHandle < 0)
+            {
+                return;
+            }
+
+            // Scrapes are rare, so a pile of idle clients can only be a misbehaving one
+            if (m_Clients.size() >= c_MaxClients)
+            {
+                close(clientHandle);
+                continue;
+            }
+
+            m_Clients[clientHandle];
+            if (!m_EventLoop.AddDescriptor(clientHandle, EPOLLIN | EPOLLRDHUP, [this, clientHandle](uint32_t) { OnClientReadable(clientHandle); }))
+            {
+                m_Clients.erase(clientHandle);
+                close(clientHandle);
+            }
+        }
+    }
+
+    void Endpoint::OnClientReadable(int clientHandle)
+    {
+        auto const client = m_Clients.find(clientHandle);
+        if (client == m_Clients.end())
+        {
+            return;
+        }
+
+        char buffer[512];
+        while (true)
+        {
+            ssize_t const result = recv(clientHandle, buffer, sizeof(buffer), 0);
+            if (result > 0)
+            {
+                client->second.append(buffer, static_cast<size_t>(result));
+                if (client->second.find("\r\n\r\n") != std::string::npos)
+                {
+                    Respond(clientHandle);
+                    return;
+                }
+
+                if (client->second.size() > c_MaxRequestSize)
+                {
+                    CloseClient(clientHandle);
+                    return;
+                }
+            }
+            else if (result == 0)
+            {
+                // The client has said all it's going to
+                Respond(clientHandle);
+                return;
+            }
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    CloseClient(clientHandle);
+                }
+                return;
+            }
+        }
+    }
+
+    void Endpoint::Respond(int clientHandle)
+    {
+        std::string const body = RenderPrometheus(m_Metrics);
+        std::string const response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+        // The response is far smaller than the socket buffer, so one send is enough. If it somehow isn't, the client
+        // just gets a short response rather than holding up the event loop
+        ssize_t const sent = send(clientHandle, response.data(), response.size(), MSG_NOSIGNAL);
+        if (sent != static_cast<ssize_t>(response.size()))
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Only sent %zd of %zu bytes of metrics", sent, response.size());
+        }
+
+        CloseClient(clientHandle);
+    }
+
+    void Endpoint::CloseClient(int clientHandle)
+    {
+        m_EventLoop.RemoveDescriptor(clientHandle);
+        close(clientHandle);
+        m_Clients.erase(clientHandle);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "Metrics.h"
+
+class EventLoop;
+
+namespace Metrics
+{
+    // Serves the metrics in Prometheus text format on a local Unix socket, from the event loop. Any HTTP request gets
+    // the metrics back, e.g. curl --unix-socket /run/doorbellpi/metrics.sock http://localhost/metrics, as does just
+    // connecting and closing the write side
+    class Endpoint
+    {
+    public:
+        Endpoint(EventLoop& eventLoop, Daemon const& metrics);
+        ~Endpoint();
+
+        Endpoint(Endpoint const&) = delete;
+        Endpoint& operator=(Endpoint const&) = delete;
+
+        bool Listen(std::string const& socketPath);
+        void Close();
+
+    private:
+        void OnAcceptable();
+        void OnClientReadable(int clientHandle);
+        void Respond(int clientHandle);
+        void CloseClient(int clientHandle);
+
+        EventLoop& m_EventLoop;
+        Daemon const& m_Metrics;
+        std::string m_SocketPath;
+        int m_ListenHandle = -1;
+        // What each client has sent so far, until the end of its request headers
+        std::unordered_map<int, std::string> m_Clients;
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Shares an immutable value between one writer thread and one reader thread, read-copy-update style. The writer
+// builds a whole new value and publishes it with a single pointer swap; the reader never blocks or takes a lock, it
+// just brackets its reads with a ReadGuard. A replaced value is only freed once the reader has been seen outside a
+// guard, so a reader never sees one half built or half freed
+template<typename Value>
+class RcuSnapshot
+{
+public:
+    // Reader only, and not nested. Everything read through the guard stays valid until it goes out of scope
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(RcuSnapshot& snapshot)
+            : m_Snapshot(snapshot)
+        {
+            // Odd while reading
+            m_Snapshot.m_ReaderEpoch.fetch_add(1, std::memory_order_seq_cst);
+            m_Value = m_Snapshot.m_Current.load(std::memory_order_seq_cst);
+        }
+
+        ~ReadGuard()
+        {
+            m_Snapshot.m_ReaderEpoch.fetch_add(1, std::memory_order_release);
+        }
+
+        ReadGuard(ReadGuard const&) = delete;
+        ReadGuard& operator=(ReadGuard const&) = delete;
+
+        Value const& operator*() const
+        {
+            return *m_Value;
+        }
+
+        Value const* operator->() const
+        {
+            return m_Value;
+        }
+
+    private:
+        RcuSnapshot& m_Snapshot;
+        Value const* m_Value;
+    };
+
+    explicit RcuSnapshot(std::unique_ptr<Value const> initial)
+        : m_Current(initial.release())
+    {
+    }
+
+    ~RcuSnapshot()
+    {
+        delete m_Current.load(std::memory_order_relaxed);
+        for (Retired const& retired : m_Retired)
+        {
+            delete retired.value;
+        }
+    }
+
+    RcuSnapshot(RcuSnapshot const&) = delete;
+    RcuSnapshot& operator=(RcuSnapshot const&) = delete;
+
+    // Writer only. The value the writer last published, which it can always read without a guard
+    Value const& Current() const
+    {
+        return *m_Current.load(std::memory_order_relaxed);
+    }
+
+    // Writer only. The reader sees the new value from its next guard on
+    void Publish(std::unique_ptr<Value const> value)
+    {
+        Value const* const previous = m_Current.exchange(value.release(), std::memory_order_seq_cst);
+        m_Retired.push_back(Retired{ previous, m_ReaderEpoch.load(std::memory_order_seq_cst) });
+        Reclaim();
+    }
+
+    // Writer only. Frees the replaced values the reader can no longer be looking at. Publish does this too, so at
+    // most one old value is left over between publishes
+    void Reclaim()
+    {
+        uint64_t const readerEpoch = m_ReaderEpoch.load(std::memory_order_acquire);
+        auto retired = m_Retired.begin();
+        while (retired != m_Retired.end())
+        {
+            // Retired while the reader was outside a guard, or it has left the guard it was in
+            if ((retired->readerEpoch & 1) == 0 || retired->readerEpoch != readerEpoch)
+            {
+                delete retired->value;
+                retired = m_Retired.erase(retired);
+            }
+            else
+            {
+                ++retired;
+            }
+        }
+    }
+
+private:
+    struct Retired
+    {
+        Value const* value;
+        uint64_t readerEpoch;
+    };
+
+    std::atomic<Value const*> m_Current;
+    std::atomic<uint64_t> m_ReaderEpoch{ 0 };
+    // Only touched by the writer
+    std::vector<Retired> m_Retired;
+};
@@ -0,0 +1,186 @@
+#include "RealTime.h"
+
+#include "Log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+namespace
+{
+    // Far more than the ring thread uses, and small next to a thread's default stack
+    size_t const c_StackReserve = 128 * 1024;
+
+    size_t PageSize()
+    {
+        long const pageSize = sysconf(_SC_PAGESIZE);
+        return pageSize > 0 ? static_cast<size_t>(pageSize) : 4096;
+    }
+
+    // Not inlined, so the buffer is below the caller's frame, where the stack will grow into
+    __attribute__((noinline)) void PrefaultStack()
+    {
+        volatile uint8_t buffer[c_StackReserve];
+        size_t const pageSize = PageSize();
+        for (size_t offset = 0; offset < sizeof(buffer); offset += pageSize)
+        {
+            buffer[offset] = 0;
+        }
+    }
+}
+
+namespace RealTime
+{
+    int LastCpu()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return 0;
+        }
+
+        for (int cpu = CPU_SETSIZE - 1; cpu > 0; --cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                return cpu;
+            }
+        }
+        return 0;
+    }
+
+    bool LockMemory(size_t const heapReserve)
+    {
+        // Freed memory is kept rather than given back, and every thread allocates from the one heap rather than
+        // mappings of their own, so that once faulted in it stays faulted in
+        mallopt(M_TRIM_THRESHOLD, -1);
+        mallopt(M_MMAP_MAX, 0);
+        mallopt(M_ARENA_MAX, 1);
+
+        if (mlockall(MCL_CURRENT) != 0)
+        {
+            DOORBELLPI_LOG(LOG_WARNING, "Failed to lock memory [%s], carrying on without", strerror(errno));
+            return false;
+        }
+
+        // Locking what's mapped later only as it's touched stops each thread's stack being faulted in whole. Older
+        // kernels don't have MCL_ONFAULT, and lock future mappings in full
+#ifdef MCL_ONFAULT
+        int result = mlockall(MCL_FUTURE | MCL_ONFAULT);
+        if (result != 0 && errno == EINVAL)
+        {
+            result = mlockall(MCL_FUTURE);
+        }
+#else
+        int const result = mlockall(MCL_FUTURE);
+#endif
+        if (result != 0)
+        {
+            DOORBELLPI_LOG(LOG_WARNING, "Failed to lock future memory [%s], carrying on without", strerror(errno));
+            munlockall();
+            return false;
+        }
+
+        uint8_t* const reserve = static_cast<uint8_t*>(malloc(heapReserve));
+        if (reserve != nullptr)
+        {
+            size_t const pageSize = PageSize();
+            for (size_t offset = 0; offset < heapReserve; offset += pageSize)
+            {
+                static_cast<uint8_t volatile*>(reserve)[offset] = 0;
+            }
+            free(reserve);
+        }
+
+        DOORBELLPI_LOG(LOG_NOTICE, "Locked memory, with %zu bytes of heap in reserve", heapReserve);
+        return true;
+    }
+
+    bool KeepOffCpu(int const cpu)
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (cpu < 0 || cpu >= CPU_SETSIZE || sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !CPU_ISSET(cpu, &allowed))
+        {
+            DOORBELLPI_LOG(LOG_WARNING, "Core %d isn't available, so it can't be kept for the ring thread", cpu);
+            return false;
+        }
+
+        CPU_CLR(cpu, &allowed);
+        if (CPU_COUNT(&allowed) == 0)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Core %d is the only one, so the ring thread shares it", cpu);
+            return false;
+        }
+
+        // Threads only inherit the affinity of the thread that started them, so each existing one is moved in turn
+        DIR* const tasks = opendir("/proc/self/task");
+        if (tasks == nullptr)
+        {
+            DOORBELLPI_LOG(LOG_WARNING, "Failed to list threads [%s], so core %d isn't kept for the ring thread", strerror(errno), cpu);
+            return false;
+        }
+
+        bool moved = true;
+        while (dirent const* const task = readdir(tasks))
+        {
+            pid_t const threadId = static_cast<pid_t>(atoi(task->d_name));
+            if (threadId > 0 && sched_setaffinity(threadId, sizeof(allowed), &allowed) != 0)
+            {
+                DOORBELLPI_LOG(LOG_WARNING, "Failed to move thread %d off core %d [%s]", threadId, cpu, strerror(errno));
+                moved = false;
+            }
+        }
+        closedir(tasks);
+        return moved;
+    }
+
+    bool ApplyToThread(ThreadPolicy const& policy, char const* name)
+    {
+        PrefaultStack();
+
+        // Timers on this thread fire as near to when they're due as the kernel can manage
+        prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+
+        bool applied = true;
+        if (policy.cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(policy.cpu, &cpus);
+            int const result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (result != 0)
+            {
+                DOORBELLPI_LOG(LOG_WARNING, "Failed to pin the %s thread to core %d [%s], leaving it on any", name, policy.cpu, strerror(result));
+                applied = false;
+            }
+        }
+
+        if (policy.priority > 0)
+        {
+            sched_param parameters = {};
+            parameters.sched_priority = policy.priority;
+            int const result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+            if (result != 0)
+            {
+                DOORBELLPI_LOG(LOG_WARNING, "Failed to run the %s thread under SCHED_FIFO [%s], carrying on with normal scheduling", name, strerror(result));
+                applied = false;
+            }
+        }
+
+        if (applied)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Running the %s thread at SCHED_FIFO priority %d on core %d", name, policy.priority, policy.cpu);
+        }
+        return applied;
+    }
+}
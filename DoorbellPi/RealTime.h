@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+// Opt in real-time execution, so a busy Pi can't stretch the strikes of a ring. Memory is locked and prefaulted so a
+// ring never waits on a page fault, and the ring thread runs under SCHED_FIFO on a core that the daemon's other
+// threads are kept off. Each part needs a privilege (CAP_IPC_LOCK, CAP_SYS_NICE) the daemon may not have: whatever
+// can't be done is logged and skipped, leaving things as they would have been without it
+namespace RealTime
+{
+    struct ThreadPolicy
+    {
+        // SCHED_FIFO priority, 1 to 99. 0 leaves the thread's scheduling alone
+        int priority = 0;
+        // -1 leaves the thread free to run on any core
+        int cpu = -1;
+    };
+
+    // The highest numbered core the process may run on
+    int LastCpu();
+
+    // Locks and faults in everything mapped now, and locks anything mapped later as it's first touched. The heap is
+    // grown by heapReserve bytes and never trimmed back, so allocating afterwards doesn't fault either. Best called
+    // before starting any threads, so their stacks are only locked as far as they're used
+    bool LockMemory(size_t const heapReserve);
+
+    // Moves every thread in the process off the core, and so any threads they start afterwards. Does nothing if it's
+    // the only core the process has
+    bool KeepOffCpu(int const cpu);
+
+    // Applies the policy to the calling thread, having faulted in the top of its stack. Returns false if any of it
+    // couldn't be applied
+    bool ApplyToThread(ThreadPolicy const& policy, char const* name);
+}
@@ -0,0 +1,210 @@
+#include "Resolver.h"
+
+#include "EventLoop.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+
+Resolver::Resolver(EventLoop& eventLoop)
+    : m_EventLoop(eventLoop)
+{
+}
+
+Resolver::~Resolver()
+{
+    Stop();
+}
+
+bool Resolver::Start()
+{
+    if (m_Thread.joinable())
+    {
+        return true;
+    }
+
+    m_WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_WakeHandle < 0)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to create resolver wake descriptor [%s]", strerror(errno));
+        return false;
+    }
+
+    if (!m_EventLoop.AddDescriptor(m_WakeHandle, EPOLLIN, [this](uint32_t) { OnCompleted(); }))
+    {
+        close(m_WakeHandle);
+        m_WakeHandle = -1;
+        return false;
+    }
+
+    m_Running = true;
+    try
+    {
+        m_Thread = std::thread(&Resolver::Run, this);
+    }
+    catch (std::system_error const& error)
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start the resolver thread [%s]", error.what());
+        m_Running = false;
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+void Resolver::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Running = false;
+        ++m_Generation;
+    }
+    m_Changed.notify_all();
+
+    // A getaddrinfo call in progress can't be interrupted, so this waits for it to time out on its own
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+
+    if (m_WakeHandle >= 0)
+    {
+        m_EventLoop.RemoveDescriptor(m_WakeHandle);
+        close(m_WakeHandle);
+        m_WakeHandle = -1;
+    }
+    m_Handler = nullptr;
+}
+
+bool Resolver::Resolve(std::string const& hostname, uint16_t const port, ResultHandler handler)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_Running)
+        {
+            return false;
+        }
+
+        ++m_Generation;
+        m_RequestPending = true;
+        m_Hostname = hostname;
+        m_Port = port;
+    }
+    m_Handler = std::move(handler);
+    m_Changed.notify_all();
+    return true;
+}
+
+void Resolver::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        ++m_Generation;
+        m_RequestPending = false;
+    }
+    m_Handler = nullptr;
+}
+
+bool Resolver::ResolveNow(std::string const& hostname, uint16_t const port, Addresses& addresses)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+
+    addrinfo* results = nullptr;
+    std::string const service = std::to_string(port);
+    int const lookupResult = getaddrinfo(hostname.c_str(), service.c_str(), &hints, &results);
+    if (lookupResult != 0)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Failed to resolve '%s' [%s]", hostname.c_str(), gai_strerror(lookupResult));
+        return false;
+    }
+
+    addresses.clear();
+    for (addrinfo const* result = results; result != nullptr; result = result->ai_next)
+    {
+        if (result->ai_addrlen <= sizeof(sockaddr_storage))
+        {
+            Address address;
+            memset(&address.storage, 0, sizeof(address.storage));
+            memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+            address.length = result->ai_addrlen;
+            addresses.push_back(address);
+        }
+    }
+    freeaddrinfo(results);
+    return !addresses.empty();
+}
+
+void Resolver::Run()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (true)
+    {
+        m_Changed.wait(lock, [this]() { return !m_Running || m_RequestPending; });
+        if (!m_Running)
+        {
+            break;
+        }
+
+        uint64_t const generation = m_Generation;
+        std::string const hostname = m_Hostname;
+        uint16_t const port = m_Port;
+        m_RequestPending = false;
+
+        lock.unlock();
+        Addresses addresses;
+        ResolveNow(hostname, port, addresses);
+        lock.lock();
+
+        // Only the latest request's result is kept
+        if (generation == m_Generation)
+        {
+            m_Result = std::move(addresses);
+            m_CompletedGeneration = generation;
+
+            uint64_t const wake = 1;
+            if (write(m_WakeHandle, &wake, sizeof(wake)) < 0)
+            {
+                DOORBELLPI_LOG(LOG_ERR, "Failed to wake the event loop with a resolved address [%s]", strerror(errno));
+            }
+        }
+    }
+}
+
+void Resolver::OnCompleted()
+{
+    uint64_t wakes = 0;
+    if (read(m_WakeHandle, &wakes, sizeof(wakes)) < 0)
+    {
+        return;
+    }
+
+    Addresses addresses;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_CompletedGeneration != m_Generation)
+        {
+            return;
+        }
+        addresses = std::move(m_Result);
+        m_Result.clear();
+        // Don't hand the same result over twice
+        m_CompletedGeneration = 0;
+    }
+
+    if (m_Handler)
+    {
+        ResultHandler const handler = std::move(m_Handler);
+        m_Handler = nullptr;
+        handler(addresses);
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+class EventLoop;
+
+// Resolves host names with getaddrinfo on a thread of its own, so that a slow or unreachable DNS server can't hold up
+// the event loop. Results are handed back on the event loop's thread. One request is outstanding at a time
+class Resolver
+{
+public:
+    struct Address
+    {
+        sockaddr_storage storage;
+        socklen_t length;
+    };
+
+    using Addresses = std::vector<Address>;
+    // An empty list means the name didn't resolve
+    using ResultHandler = std::function<void(Addresses const& addresses)>;
+
+    explicit Resolver(EventLoop& eventLoop);
+    ~Resolver();
+
+    Resolver(Resolver const&) = delete;
+    Resolver& operator=(Resolver const&) = delete;
+
+    // The thread has to be started after any signals are blocked
+    bool Start();
+    void Stop();
+
+    // Replaces any request still outstanding, whose handler will then never be called
+    bool Resolve(std::string const& hostname, uint16_t const port, ResultHandler handler);
+    void Cancel();
+
+    // Blocking, for callers that can afford to wait
+    static bool ResolveNow(std::string const& hostname, uint16_t const port, Addresses& addresses);
+
+private:
+    void Run();
+    void OnCompleted();
+
+    EventLoop& m_EventLoop;
+    int m_WakeHandle = -1;
+    std::thread m_Thread;
+    ResultHandler m_Handler;
+
+    // Shared with the resolver thread
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    bool m_Running = false;
+    // Bumped by every request and cancellation, so a result that comes back late can be recognised and dropped
+    uint64_t m_Generation = 0;
+    bool m_RequestPending = false;
+    std::string m_Hostname;
+    uint16_t m_Port = 0;
+    uint64_t m_CompletedGeneration = 0;
+    Addresses m_Result;
+};
@@ -0,0 +1,370 @@
+#include "Rings.h"
+
+#include "EventLoop.h"
+#include "Log.h"
+#include "Metrics.h"
+
+#include <ctype.h>
+#include <fstream>
+#include <stdlib.h>
+
+namespace
+{
+    int const c_MaxGroupDepth = 8;
+    // Groups are expanded as they're parsed, so this bounds what a single line can ask for. With the step duration
+    // also bounded, the total can't overflow while it's added up, and is checked against its own cap after
+    size_t const c_MaxSteps = 10000;
+    std::chrono::milliseconds const c_MaxStepDuration = std::chrono::minutes(1);
+    std::chrono::milliseconds const c_MaxDuration = std::chrono::minutes(5);
+
+    void SkipWhitespace(std::string const& text, size_t& position)
+    {
+        while (position < text.size() && isspace(static_cast<unsigned char>(text[position])))
+        {
+            ++position;
+        }
+    }
+
+    bool ParseNumber(std::string const& text, size_t& position, long& number)
+    {
+        size_t const start = position;
+        while (position < text.size() && isdigit(static_cast<unsigned char>(text[position])))
+        {
+            ++position;
+        }
+
+        if (position == start || position - start > 9)
+        {
+            return false;
+        }
+
+        number = strtol(text.c_str() + start, nullptr, 10);
+        return true;
+    }
+
+    // Parses steps until the end of the text, or the ']' closing the current group
+    bool ParseSequence(std::string const& text, size_t& position, int const depth, Rings::Pattern& pattern)
+    {
+        while (true)
+        {
+            SkipWhitespace(text, position);
+            if (position >= text.size() || text[position] == ']')
+            {
+                return true;
+            }
+
+            char const token = static_cast<char>(toupper(static_cast<unsigned char>(text[position++])));
+            long number = 0;
+            switch (token)
+            {
+            case '[':
+            {
+                Rings::Pattern group;
+                if (depth >= c_MaxGroupDepth || !ParseSequence(text, position, depth + 1, group))
+                {
+                    return false;
+                }
+
+                if (position + 1 >= text.size() || text[position] != ']' || tolower(static_cast<unsigned char>(text[position + 1])) != 'x')
+                {
+                    return false;
+                }
+                position += 2;
+
+                if (!ParseNumber(text, position, number))
+                {
+                    return false;
+                }
+
+                // Written so as not to overflow, pattern never holds more than c_MaxSteps
+                if (!group.empty() && static_cast<size_t>(number) > (c_MaxSteps - pattern.size()) / group.size())
+                {
+                    return false;
+                }
+
+                for (long repeat = 0; repeat < number; ++repeat)
+                {
+                    pattern.insert(pattern.end(), group.begin(), group.end());
+                }
+                break;
+            }
+            case 'H':
+            case 'L':
+            case 'W':
+            {
+                if (!ParseNumber(text, position, number) || number > c_MaxStepDuration.count() || pattern.size() >= c_MaxSteps)
+                {
+                    return false;
+                }
+
+                Rings::Output const output = token == 'H' ? Rings::Output::High : (token == 'L' ? Rings::Output::Low : Rings::Output::Unchanged);
+                pattern.push_back({ output, std::chrono::milliseconds(number) });
+                break;
+            }
+            default:
+            {
+                return false;
+            }
+            }
+        }
+    }
+
+    std::string Trim(std::string const& text)
+    {
+        size_t const start = text.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos)
+        {
+            return std::string();
+        }
+
+        size_t const end = text.find_last_not_of(" \t\r\n");
+        return text.substr(start, end - start + 1);
+    }
+}
+
+namespace Rings
+{
+    void Once(Pattern& pattern, std::chrono::milliseconds const strikeDuration)
+    {
+        pattern.push_back({ Output::High, strikeDuration });
+        pattern.push_back({ Output::Low, strikeDuration });
+    }
+
+    void Pause(Pattern& pattern, std::chrono::milliseconds const pauseDuration)
+    {
+        pattern.push_back({ Output::Unchanged, pauseDuration });
+    }
+
+    Pattern Once(std::chrono::milliseconds const strikeDuration)
+    {
+        Pattern pattern;
+        Once(pattern, strikeDuration);
+        return pattern;
+    }
+
+    Pattern Classic(std::chrono::milliseconds const strikeDuration)
+    {
+        Pattern pattern;
+        for (int externalCounter = 0; externalCounter < 2; ++externalCounter)
+        {
+            for (int counter = 0; counter < 2; ++counter)
+            {
+                for (int internalCounter = 0; internalCounter < 5; ++internalCounter)
+                {
+                    Once(pattern, strikeDuration);
+                }
+
+                Pause(pattern, std::chrono::milliseconds(500));
+            }
+
+            Pause(pattern, std::chrono::seconds(2));
+        }
+        return pattern;
+    }
+
+    bool Parse(std::string const& specification, Pattern& pattern)
+    {
+        Pattern parsed;
+        size_t position = 0;
+        if (!ParseSequence(specification, position, 0, parsed) || position != specification.size())
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Invalid ring pattern '%s' at position %zu", specification.c_str(), position);
+            return false;
+        }
+
+        // A ring has to strike, and take some time doing it, but not so long that it holds up every press after it
+        bool hasEdges = false;
+        std::chrono::milliseconds duration(0);
+        for (Step const& step : parsed)
+        {
+            hasEdges = hasEdges || step.output != Output::Unchanged;
+            duration += step.duration;
+        }
+        if (!hasEdges || duration.count() == 0 || duration > c_MaxDuration)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Ring pattern '%s' never changes the output, takes no time or takes too long", specification.c_str());
+            return false;
+        }
+
+        pattern = std::move(parsed);
+        return true;
+    }
+
+    std::shared_ptr<Timeline const> Compile(Pattern const& pattern, std::string const& name)
+    {
+        auto timeline = std::make_shared<Timeline>();
+        timeline->duration = std::chrono::nanoseconds(0);
+        timeline->name = name;
+
+        for (Step const& step : pattern)
+        {
+            if (step.output != Output::Unchanged)
+            {
+                bool const level = step.output == Output::High;
+                if (!timeline->edges.empty() && timeline->edges.back().offset == timeline->duration)
+                {
+                    // A zero length step, only the last level at this offset matters
+                    timeline->edges.back().level = level;
+                }
+                else
+                {
+                    timeline->edges.push_back({ timeline->duration, level });
+                }
+            }
+
+            timeline->duration += step.duration;
+        }
+
+        return timeline;
+    }
+
+    bool LoadLibrary(std::string const& path, Library& library)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Failed to open ring patterns '%s'", path.c_str());
+            return false;
+        }
+
+        Library loaded;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+            line = Trim(line.substr(0, line.find('#')));
+            if (line.empty())
+            {
+                continue;
+            }
+
+            size_t const separator = line.find('=');
+            std::string const name = separator != std::string::npos ? Trim(line.substr(0, separator)) : std::string();
+            Pattern pattern;
+            if (name.empty() || !Parse(Trim(line.substr(separator + 1)), pattern))
+            {
+                DOORBELLPI_LOG(LOG_NOTICE, "Invalid ring pattern on line %d of '%s'", lineNumber, path.c_str());
+                return false;
+            }
+
+            loaded[name] = Compile(pattern, name);
+        }
+
+        for (auto& entry : loaded)
+        {
+            library[entry.first] = std::move(entry.second);
+        }
+        return true;
+    }
+
+    Player::Player(EventLoop& eventLoop, Gpio::Backend& gpio, Gpio::LineMask const outputLines)
+        : m_EventLoop(eventLoop)
+        , m_Gpio(gpio)
+        , m_OutputLines(outputLines)
+    {
+        m_TimerHandle = m_EventLoop.CreateTimer([this]() { OnDeadline(); });
+    }
+
+    Player::~Player()
+    {
+        if (m_TimerHandle != EventLoop::c_InvalidHandle)
+        {
+            m_EventLoop.DestroyTimer(m_TimerHandle);
+        }
+
+        if (IsPlaying())
+        {
+            m_Gpio.SetLines(m_OutputLines, 0);
+        }
+    }
+
+    void Player::SetEdgeObserver(EdgeObserver observer)
+    {
+        m_EdgeObserver = std::move(observer);
+    }
+
+    void Player::SetFinishedObserver(FinishedObserver observer)
+    {
+        m_FinishedObserver = std::move(observer);
+    }
+
+    bool Player::IsPlaying() const
+    {
+        return m_Playing;
+    }
+
+    bool Player::Play(std::shared_ptr<Timeline const> timeline, std::chrono::steady_clock::time_point const requestTime)
+    {
+        if (IsPlaying() || m_TimerHandle == EventLoop::c_InvalidHandle || !timeline)
+        {
+            return false;
+        }
+
+        m_Timeline = std::move(timeline);
+        m_StartTime = std::chrono::steady_clock::now();
+        m_RequestTime = requestTime;
+        m_NextEdge = 0;
+        m_Playing = true;
+        OnDeadline();
+        return m_Playing;
+    }
+
+    void Player::OnDeadline()
+    {
+        if (!IsPlaying())
+        {
+            return;
+        }
+
+        // Write every edge that is due. Normally that's just one, but if we were held up it brings the output back
+        // in line with the timeline rather than shifting the rest of the ring
+        auto const now = std::chrono::steady_clock::now();
+        std::vector<Edge> const& edges = m_Timeline->edges;
+        while (m_NextEdge < edges.size() && m_StartTime + edges[m_NextEdge].offset <= now)
+        {
+            Edge const& edge = edges[m_NextEdge++];
+            m_Gpio.SetLines(m_OutputLines, edge.level ? m_OutputLines : 0);
+
+            auto const written = std::chrono::steady_clock::now();
+            Metrics::Daemon& metrics = Metrics::Global();
+            metrics.edgeLateness.Record(written - (m_StartTime + edge.offset));
+            if (m_NextEdge == 1 && m_RequestTime != std::chrono::steady_clock::time_point())
+            {
+                metrics.readableToFirstEdge.Record(written - m_RequestTime);
+            }
+
+            if (m_EdgeObserver)
+            {
+                m_EdgeObserver(written - (m_StartTime + edge.offset));
+            }
+        }
+
+        // The ring is only finished once the whole timeline has elapsed
+        if (m_NextEdge >= edges.size() && m_StartTime + m_Timeline->duration <= now)
+        {
+            m_Playing = false;
+            m_Timeline.reset();
+        }
+        else if (!ArmNextDeadline())
+        {
+            DOORBELLPI_LOG(LOG_ERR, "Failed to arm ring timer, abandoning ring");
+            m_Gpio.SetLines(m_OutputLines, 0);
+            m_Playing = false;
+            m_Timeline.reset();
+        }
+
+        // Last, as the observer may well start another ring
+        if (!m_Playing && m_FinishedObserver)
+        {
+            m_FinishedObserver();
+        }
+    }
+
+    bool Player::ArmNextDeadline()
+    {
+        std::vector<Edge> const& edges = m_Timeline->edges;
+        std::chrono::nanoseconds const nextOffset = m_NextEdge < edges.size() ? edges[m_NextEdge].offset : m_Timeline->duration;
+        return m_EventLoop.ArmTimerAt(m_TimerHandle, m_StartTime + nextOffset);
+    }
+}
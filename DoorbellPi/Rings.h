@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EventLoop;
+
+#include "Gpio.h"
+
+namespace Rings
+{
+    enum class Output
+    {
+        High,
+        Low,
+        Unchanged
+    };
+
+    // One step of a ring: drive the output to the given level, then hold for the duration
+    struct Step
+    {
+        Output output;
+        std::chrono::milliseconds duration;
+    };
+
+    using Pattern = std::vector<Step>;
+
+    void Once(Pattern& pattern, std::chrono::milliseconds const strikeDuration);
+    void Pause(Pattern& pattern, std::chrono::milliseconds const pauseDuration);
+
+    Pattern Once(std::chrono::milliseconds const strikeDuration);
+    Pattern Classic(std::chrono::milliseconds const strikeDuration);
+
+    // Parses a textual pattern. Steps are H<ms> (high), L<ms> (low) and W<ms> (wait, output unchanged), separated
+    // by whitespace, and [ ... ]x<count> repeats a group. Classic with 20ms strikes is
+    // "[[[H20 L20]x5 W500]x2 W2000]x2". Patterns that expand to more than 10000 steps, have a step over a minute,
+    // last over five minutes in all, never drive the output or take no time at all are rejected
+    bool Parse(std::string const& specification, Pattern& pattern);
+
+    // A compiled pattern: every level change at its offset from the start of the ring
+    struct Edge
+    {
+        std::chrono::nanoseconds offset;
+        bool level;
+    };
+
+    struct Timeline
+    {
+        std::vector<Edge> edges;
+        std::chrono::nanoseconds duration;
+        // As the pattern is known in the library, for the press journal
+        std::string name;
+    };
+
+    std::shared_ptr<Timeline const> Compile(Pattern const& pattern, std::string const& name = std::string());
+
+    // Named patterns. Loading reads "name = specification" lines, ignoring blank lines and # comments, and adds to
+    // (or replaces entries in) the library. Nothing is changed if any line is invalid
+    using Library = std::map<std::string, std::shared_ptr<Timeline const>>;
+    bool LoadLibrary(std::string const& path, Library& library);
+
+    // Plays a timeline on a set of output lines using event loop timers, so the loop is never blocked while a ring is in
+    // progress. Every edge is scheduled against an absolute deadline from the start of the ring, so timer latency
+    // on one edge doesn't push back the ones after it
+    class Player
+    {
+    public:
+        // Called after each edge is written with how late it was compared to its deadline
+        using EdgeObserver = std::function<void(std::chrono::nanoseconds lateness)>;
+        // Called once a ring has finished or been abandoned, when the player is free to play another
+        using FinishedObserver = std::function<void()>;
+
+        Player(EventLoop& eventLoop, Gpio::Backend& gpio, Gpio::LineMask const outputLines);
+        ~Player();
+
+        Player(Player const&) = delete;
+        Player& operator=(Player const&) = delete;
+
+        void SetEdgeObserver(EdgeObserver observer);
+        void SetFinishedObserver(FinishedObserver observer);
+
+        bool IsPlaying() const;
+
+        // Returns false if a ring is already in progress or the timer could not be armed. If given, the time the ring
+        // was requested is used to measure the latency to its first edge
+        bool Play(std::shared_ptr<Timeline const> timeline, std::chrono::steady_clock::time_point const requestTime = std::chrono::steady_clock::time_point());
+
+    private:
+        void OnDeadline();
+        bool ArmNextDeadline();
+
+        EventLoop& m_EventLoop;
+        Gpio::Backend& m_Gpio;
+        Gpio::LineMask const m_OutputLines;
+        int m_TimerHandle;
+        EdgeObserver m_EdgeObserver;
+        FinishedObserver m_FinishedObserver;
+
+        std::shared_ptr<Timeline const> m_Timeline;
+        std::chrono::steady_clock::time_point m_StartTime;
+        std::chrono::steady_clock::time_point m_RequestTime;
+        size_t m_NextEdge = 0;
+        bool m_Playing = false;
+    };
+}
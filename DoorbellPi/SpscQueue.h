@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <utility>
+
+// Bounded, lock free queue between exactly one producer thread and one consumer thread. Neither side ever blocks or
+// allocates: TryPush fails when the queue is full and TryPop fails when it is empty. The slots are allocated up
+// front, with the capacity rounded up to a power of two
+template<typename Value>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t const capacity)
+        : m_Capacity(RoundUp(capacity))
+        , m_Slots(new Value[m_Capacity])
+    {
+    }
+
+    SpscQueue(SpscQueue const&) = delete;
+    SpscQueue& operator=(SpscQueue const&) = delete;
+
+    // Producer only
+    bool TryPush(Value value)
+    {
+        size_t const tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail - m_CachedHead == m_Capacity)
+        {
+            m_CachedHead = m_Head.load(std::memory_order_acquire);
+            if (tail - m_CachedHead == m_Capacity)
+            {
+                return false;
+            }
+        }
+
+        m_Slots[tail & (m_Capacity - 1)] = std::move(value);
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool TryPop(Value& value)
+    {
+        size_t const head = m_Head.load(std::memory_order_relaxed);
+        if (head == m_CachedTail)
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head == m_CachedTail)
+            {
+                return false;
+            }
+        }
+
+        value = std::move(m_Slots[head & (m_Capacity - 1)]);
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Only a snapshot, as the other side may be running
+    size_t SizeApprox() const
+    {
+        return m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const
+    {
+        return m_Capacity;
+    }
+
+private:
+    static size_t const c_CacheLineSize = 64;
+
+    static size_t RoundUp(size_t const capacity)
+    {
+        size_t rounded = 2;
+        while (rounded < capacity)
+        {
+            rounded *= 2;
+        }
+        return rounded;
+    }
+
+    size_t const m_Capacity;
+    std::unique_ptr<Value[]> const m_Slots;
+
+    // The producer and consumer indices live on separate cache lines, each next to the copy of the other index that
+    // its own side caches, so the two threads only share a line when one actually needs to see the other's progress
+    alignas(c_CacheLineSize) std::atomic<size_t> m_Head{ 0 };
+    size_t m_CachedTail = 0;
+    alignas(c_CacheLineSize) std::atomic<size_t> m_Tail{ 0 };
+    size_t m_CachedHead = 0;
+};
@@ -0,0 +1,118 @@
+// Measures the per-event cost of routing a button event to its button's action, decode included, as the number of
+// buttons sharing one connection grows. The cost should stay flat.
+
+#include "../FlicChannelTable.h"
+#include "../FlicCodec.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+    volatile uint32_t s_Sink = 0;
+
+    struct Action
+    {
+        int outputPin;
+        uint32_t presses;
+    };
+
+    struct RoutingHandler : private Flic::Codec::IgnoreEvents
+    {
+        using IgnoreEvents::OnEvent;
+
+        explicit RoutingHandler(Flic::ChannelTable<Action>& table)
+            : m_Table(table)
+        {
+        }
+
+        void OnEvent(Flic::Codec::EventTag<EVT_BUTTON_UP_OR_DOWN_OPCODE>, FlicClientProtocol::EvtButtonEvent const& event)
+        {
+            Action* const action = m_Table.Find(event.base.conn_id);
+            if (action != nullptr)
+            {
+                ++action->presses;
+                s_Sink += action->outputPin;
+            }
+        }
+
+        Flic::ChannelTable<Action>& m_Table;
+    };
+
+    Flic::ButtonAddress MakeAddress(uint32_t const index)
+    {
+        uint8_t address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0, 0, 0, 0x80 };
+        address[2] = static_cast<uint8_t>(index);
+        address[3] = static_cast<uint8_t>(index >> 8);
+        address[4] = static_cast<uint8_t>(index >> 16);
+        return Flic::ButtonAddress(address);
+    }
+
+    void Run(uint32_t const buttonCount, size_t const eventCount)
+    {
+        Flic::ChannelTable<Action> table;
+        std::vector<Flic::ConnectionId> connectionIds;
+        for (uint32_t buttonIndex = 0; buttonIndex < buttonCount; ++buttonIndex)
+        {
+            connectionIds.push_back(table.Add(MakeAddress(buttonIndex), Action{ static_cast<int>(buttonIndex % 28), 0 }));
+        }
+
+        // Presses arrive from random buttons
+        std::mt19937 generator(buttonCount);
+        std::uniform_int_distribution<uint32_t> buttonDistribution(0, buttonCount - 1);
+        std::vector<FlicClientProtocol::EvtButtonEvent> events(eventCount);
+        std::vector<uint32_t> buttonIndices(eventCount);
+        for (size_t eventIndex = 0; eventIndex < eventCount; ++eventIndex)
+        {
+            buttonIndices[eventIndex] = buttonDistribution(generator);
+            FlicClientProtocol::EvtButtonEvent& event = events[eventIndex];
+            event.base.opcode = EVT_BUTTON_UP_OR_DOWN_OPCODE;
+            event.base.conn_id = connectionIds[buttonIndices[eventIndex]];
+            event.click_type = FlicClientProtocol::ButtonDown;
+            event.was_queued = 0;
+            event.time_diff = 0;
+        }
+
+        RoutingHandler handler(table);
+        auto const dispatchStart = std::chrono::steady_clock::now();
+        for (FlicClientProtocol::EvtButtonEvent const& event : events)
+        {
+            Flic::PacketView const packet = { reinterpret_cast<uint8_t const*>(&event), sizeof(event) };
+            Flic::Codec::Dispatcher<RoutingHandler>::Dispatch(handler, packet);
+        }
+        auto const dispatchEnd = std::chrono::steady_clock::now();
+
+        std::vector<Flic::ButtonAddress> addresses;
+        for (uint32_t const buttonIndex : buttonIndices)
+        {
+            addresses.push_back(MakeAddress(buttonIndex));
+        }
+
+        auto const addressStart = std::chrono::steady_clock::now();
+        for (Flic::ButtonAddress const& address : addresses)
+        {
+            s_Sink += table.Find(address);
+        }
+        auto const addressEnd = std::chrono::steady_clock::now();
+
+        double const dispatchNanoseconds = std::chrono::duration<double, std::nano>(dispatchEnd - dispatchStart).count() / eventCount;
+        double const addressNanoseconds = std::chrono::duration<double, std::nano>(addressEnd - addressStart).count() / eventCount;
+        std::cout << buttonCount << " buttons: " << dispatchNanoseconds << " ns/event by conn_id, "
+            << addressNanoseconds << " ns/lookup by address" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const eventCount = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 2000000;
+
+    for (uint32_t const buttonCount : { 1u, 10u, 100u, 1000u, 10000u })
+    {
+        Run(buttonCount, eventCount);
+    }
+
+    return 0;
+}
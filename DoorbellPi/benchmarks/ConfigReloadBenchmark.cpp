@@ -0,0 +1,225 @@
+// Reloads the settings over and over while a fake flicd presses a button continuously, the way the daemon does: the
+// settings file is replaced, Config::Watcher notices, and a new snapshot is loaded, checked and swapped in. The file
+// cycles through two valid versions with different ring patterns, one with an unknown pattern and one that changes
+// the button's output, which needs a restart. Every press should be accounted for as a ring or folded into one, the
+// connection to flicd should never drop, the invalid versions should be rejected and both patterns should have rung.
+// Exits non-zero if any of that doesn't hold.
+// Usage: ConfigReloadBenchmark [cycles] [presses per second]
+
+#include "../Config.h"
+#include "../Doorbell.h"
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../GpioMock.h"
+#include "../Log.h"
+#include "../Metrics.h"
+#include "../tools/FakeFlicd.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    char const* const c_Versions[] =
+    {
+        "ring_cooldown_ms = 0\n[button 80:E4:DA:73:BF:40]\noutputs = 23\npattern = Short\n",
+        "ring_cooldown_ms = 0\n[button 80:E4:DA:73:BF:40]\noutputs = 23\npattern = Long\n",
+        // Rejected: no such pattern
+        "ring_cooldown_ms = 0\n[button 80:E4:DA:73:BF:40]\noutputs = 23\npattern = Missing\n",
+        // Rejected: needs a restart
+        "ring_cooldown_ms = 0\n[button 80:E4:DA:73:BF:40]\noutputs = 24\npattern = Long\n",
+    };
+    size_t const c_ValidVersions = 2;
+
+    // Written alongside and renamed into place, as an editor would
+    bool Replace(std::string const& path, std::string const& contents)
+    {
+        std::string const temporaryPath = path + ".new";
+        {
+            std::ofstream file(temporaryPath);
+            file << contents;
+            if (!file)
+            {
+                return false;
+            }
+        }
+        return rename(temporaryPath.c_str(), path.c_str()) == 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const cycles = argc > 1 ? strtoul(argv[1], nullptr, 10) : 3;
+    double const pressesPerSecond = argc > 2 ? atof(argv[2]) : 20;
+    // Longer than Config::Watcher takes to settle, so every version is loaded
+    std::chrono::milliseconds const c_VersionTime = std::chrono::milliseconds(500);
+
+    Log::Start();
+
+    char directoryTemplate[] = "/tmp/ConfigReloadBenchmark.XXXXXX";
+    if (mkdtemp(directoryTemplate) == nullptr)
+    {
+        std::cerr << "Failed to create a directory for the settings" << std::endl;
+        return 1;
+    }
+    std::string const directory = directoryTemplate;
+    std::string const settingsPath = directory + "/doorbellpi.conf";
+    std::string const patternsPath = directory + "/rings.conf";
+    std::string const settingsPrefix = "ring_patterns = " + patternsPath + "\n";
+    if (!Replace(patternsPath, "Short = H5 L5\nLong = H15 L5\n") || !Replace(settingsPath, settingsPrefix + c_Versions[0]))
+    {
+        std::cerr << "Failed to write the settings" << std::endl;
+        return 1;
+    }
+
+    Config::Settings settings;
+    if (!Config::Load(settingsPath, settings))
+    {
+        std::cerr << "Failed to load the settings" << std::endl;
+        return 1;
+    }
+
+    FakeFlicd fake;
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+
+    EventLoop eventLoop;
+    Gpio::MockBackend gpio;
+    gpio.RequestOutputs({ 23, 24 });
+    Doorbell doorbell(gpio);
+    Flic::Connection connection(eventLoop);
+    std::unordered_map<Flic::ButtonAddress, ButtonAction> actions = Config::ButtonActions(settings);
+    for (Config::Button const& button : settings.buttons)
+    {
+        Flic::ConnectionId const connectionId = doorbell.AddButton(button.address, std::move(actions.at(button.address)));
+        connection.AddChannel(connectionId, button.address);
+    }
+    doorbell.Start();
+
+    // As the daemon reloads, less the latency policy
+    Config::Watcher watcher(eventLoop);
+    watcher.Watch({ settingsPath, patternsPath }, [&]()
+    {
+        Config::Settings loaded;
+        if (!Config::Load(settingsPath, loaded) || Config::NeedsRestart(settings, loaded) || !doorbell.Reconfigure(Config::ButtonActions(loaded)))
+        {
+            Metrics::Global().configReloadsRejected.Increment();
+            return;
+        }
+
+        connection.SetLivenessCheck(loaded.flicdPingInterval, loaded.flicdMaxMissedPings);
+        settings = std::move(loaded);
+        Metrics::Global().configReloads.Increment();
+    });
+
+    size_t pressesSeen = 0;
+    auto const onRing = [&](Flic::ConnectionId connectionId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)
+    {
+        doorbell.OnPress(connectionId, readableTime, timeDiff);
+        ++pressesSeen;
+    };
+
+    if (!connection.Connect("127.0.0.1", fake.Port(), onRing, [&eventLoop]() { eventLoop.Stop(); })
+        || !fake.WaitForChannels(1, std::chrono::seconds(5)))
+    {
+        std::cerr << "Failed to connect to the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // Presses for as long as the versions take, and a little more
+    size_t const versionsWritten = cycles * (sizeof(c_Versions) / sizeof(c_Versions[0]));
+    size_t const presses = static_cast<size_t>(pressesPerSecond * std::chrono::duration<double>(c_VersionTime * (versionsWritten + 1)).count());
+
+    std::atomic<bool> finished{ false };
+    bool failed = false;
+    std::thread driver([&]()
+    {
+        fake.Play(FakeFlicd::Presses(presses, pressesPerSecond));
+        for (size_t version = 0; version < versionsWritten; ++version)
+        {
+            std::this_thread::sleep_for(c_VersionTime);
+            if (!Replace(settingsPath, settingsPrefix + c_Versions[(version + 1) % (sizeof(c_Versions) / sizeof(c_Versions[0]))]))
+            {
+                failed = true;
+            }
+        }
+
+        if (!fake.WaitForScript(std::chrono::seconds(60)))
+        {
+            failed = true;
+        }
+
+        // Long enough for the last press to arrive and its ring to finish
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        finished = true;
+    });
+
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if (finished)
+        {
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    eventLoop.Run();
+    eventLoop.DestroyTimer(pollTimer);
+    driver.join();
+    doorbell.Stop();
+
+    // Each ring is one high pulse, 5 ms for Short and 15 ms for Long
+    size_t shortRings = 0;
+    size_t longRings = 0;
+    std::vector<Gpio::MockBackend::Edge> const edges = gpio.Edges();
+    for (size_t edgeIndex = 0; edgeIndex + 1 < edges.size(); ++edgeIndex)
+    {
+        if (edges[edgeIndex].values != 0 && edges[edgeIndex + 1].values == 0)
+        {
+            auto const high = edges[edgeIndex + 1].time - edges[edgeIndex].time;
+            ++(high < std::chrono::milliseconds(10) ? shortRings : longRings);
+        }
+    }
+
+    Metrics::Daemon const& metrics = Metrics::Global();
+    uint64_t const rings = metrics.rings.Value();
+    uint64_t const folded = metrics.pressesBusy.Value() + metrics.pressesCooldown.Value();
+    uint64_t const applied = metrics.configReloads.Value();
+    uint64_t const rejected = metrics.configReloadsRejected.Value();
+    uint64_t const expectedApplied = versionsWritten * c_ValidVersions / (sizeof(c_Versions) / sizeof(c_Versions[0]));
+    uint64_t const expectedRejected = versionsWritten - expectedApplied;
+    uint64_t const connections = fake.GetStatistics().clientsAccepted;
+
+    std::cout << presses << " presses at " << pressesPerSecond << "/s, " << pressesSeen << " seen, " << rings << " rang ("
+        << shortRings << " short, " << longRings << " long), " << folded << " folded" << std::endl;
+    std::cout << versionsWritten << " settings written, " << applied << " applied (expected " << expectedApplied << "), "
+        << rejected << " rejected (expected " << expectedRejected << "), " << connections << " connections to flicd" << std::endl;
+
+    unlink(settingsPath.c_str());
+    unlink(patternsPath.c_str());
+    rmdir(directory.c_str());
+    Log::Stop();
+
+    bool const passed = !failed
+        && pressesSeen == presses
+        && rings + folded == pressesSeen
+        && applied == expectedApplied
+        && rejected == expectedRejected
+        && connections == 1
+        && shortRings > 0
+        && longRings > 0;
+    return passed ? 0 : 1;
+}
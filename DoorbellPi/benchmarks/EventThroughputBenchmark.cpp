@@ -0,0 +1,92 @@
+// Measures how many button events a Flic::Connection can take from a fake flicd streaming them as fast as it can,
+// from receipt through decode to the ring handler, for different numbers of buttons on the connection. Exits non-zero
+// if any event doesn't reach the ring handler.
+// Usage: EventThroughputBenchmark [presses]
+
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../Log.h"
+#include "../tools/FakeFlicd.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+
+namespace
+{
+    Flic::ButtonAddress MakeAddress(uint32_t const index)
+    {
+        uint8_t address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0, 0, 0, 0x80 };
+        address[2] = static_cast<uint8_t>(index);
+        address[3] = static_cast<uint8_t>(index >> 8);
+        return Flic::ButtonAddress(address);
+    }
+
+    bool Run(uint32_t const buttonCount, size_t const presses)
+    {
+        FakeFlicd fake;
+        if (!fake.Start(0))
+        {
+            std::cerr << "Failed to start the fake flicd" << std::endl;
+            return false;
+        }
+
+        EventLoop eventLoop;
+        Flic::Connection connection(eventLoop);
+        for (uint32_t buttonIndex = 0; buttonIndex < buttonCount; ++buttonIndex)
+        {
+            connection.AddChannel(buttonIndex + 1, MakeAddress(buttonIndex));
+        }
+
+        size_t rings = 0;
+        auto const onRing = [&rings, &eventLoop, presses](Flic::ConnectionId, std::chrono::steady_clock::time_point, uint32_t)
+        {
+            if (++rings == presses)
+            {
+                eventLoop.Stop();
+            }
+        };
+
+        if (!connection.Connect("127.0.0.1", fake.Port(), onRing, [&eventLoop]() { eventLoop.Stop(); })
+            || !fake.WaitForChannels(buttonCount, std::chrono::seconds(5)))
+        {
+            std::cerr << "Failed to connect to the fake flicd" << std::endl;
+            return false;
+        }
+
+        int const timeoutTimer = eventLoop.CreateTimer([&eventLoop]() { eventLoop.Stop(); });
+        eventLoop.ArmTimer(timeoutTimer, std::chrono::seconds(60));
+
+        auto const start = std::chrono::steady_clock::now();
+        fake.Play(FakeFlicd::Presses(presses, 0));
+        eventLoop.Run();
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        eventLoop.DestroyTimer(timeoutTimer);
+
+        // Every press is a down and an up event
+        double const events = static_cast<double>(rings) * 2;
+        std::cout << buttonCount << " buttons: " << rings << " presses in " << seconds << " s, "
+            << events / seconds << " events/s, " << seconds * 1e9 / events << " ns per event" << std::endl;
+        return rings == presses;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const presses = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+
+    // Log as the daemon does, from the formatter thread
+    Log::Start();
+    for (uint32_t const buttonCount : { 1u, 10u, 100u })
+    {
+        if (!Run(buttonCount, presses))
+        {
+            Log::Stop();
+            return 1;
+        }
+    }
+
+    std::cout << Log::DroppedCount() << " log messages dropped" << std::endl;
+    Log::Stop();
+    return 0;
+}
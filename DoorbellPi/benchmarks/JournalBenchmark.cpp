@@ -0,0 +1,176 @@
+// Appends records to a press journal as fast as it can, rotating through its files, then reads back what's left and
+// checks every record is there in order and intact. Reopens the journal afterwards, as the daemon does on a restart,
+// and checks appending carries on where it left off. Exits non-zero if anything is missing or wrong.
+// Usage: JournalBenchmark [records] [records per file] [files]
+
+#include "../Journal.h"
+#include "../Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    // Every field is derived from the sequence number, so a record in the wrong place or half written shows up
+    Journal::Record MakeRecord(uint64_t const sequence)
+    {
+        Journal::Record record = {};
+        record.time = static_cast<int64_t>(1600000000000000ull + sequence * 1000);
+        for (size_t index = 0; index < sizeof(record.buttonAddress); ++index)
+        {
+            record.buttonAddress[index] = static_cast<uint8_t>(sequence >> (index * 8));
+        }
+        record.clickType = static_cast<uint8_t>(sequence % 2);
+        record.outcome = static_cast<Journal::Outcome>(sequence % 4);
+        record.timeDiff = static_cast<uint32_t>(sequence % 60);
+        record.presses = static_cast<uint32_t>(sequence);
+        record.decodeLatency = static_cast<uint32_t>(sequence * 3);
+        record.ringLatency = static_cast<uint32_t>(sequence * 7);
+        Journal::SetPattern(record, sequence % 2 == 0 ? "Classic" : "Once");
+        return record;
+    }
+
+    bool Matches(Journal::Record const& record, uint64_t const sequence)
+    {
+        Journal::Record const expected = MakeRecord(sequence);
+        return memcmp(&record, &expected, sizeof(record)) == 0;
+    }
+
+    // Checks the files hold the records from first onwards, oldest first, and returns how many there were
+    bool Verify(std::vector<std::string> const& files, uint64_t const first, uint64_t& records)
+    {
+        records = 0;
+        for (std::string const& path : files)
+        {
+            Journal::Reader reader;
+            if (!reader.Open(path))
+            {
+                std::cerr << "Failed to read '" << path << "'" << std::endl;
+                return false;
+            }
+
+            for (size_t index = 0; index < reader.Size(); ++index, ++records)
+            {
+                if (!Matches(reader[index], first + records))
+                {
+                    std::cerr << "Record " << index << " of '" << path << "' isn't record " << first + records << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t const records = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    size_t const recordsPerFile = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000000;
+    size_t const files = argc > 3 ? strtoul(argv[3], nullptr, 10) : 4;
+    uint64_t const c_ResumedRecords = 1000;
+
+    Log::Start();
+
+    char directoryTemplate[] = "/tmp/JournalBenchmark.XXXXXX";
+    if (mkdtemp(directoryTemplate) == nullptr)
+    {
+        std::cerr << "Failed to create a directory for the journal" << std::endl;
+        return 1;
+    }
+    std::string const directory = directoryTemplate;
+    std::string const path = directory + "/presses.journal";
+
+    // The records are made up front, so only the appending is timed
+    std::vector<Journal::Record> source;
+    source.reserve(recordsPerFile);
+    for (uint64_t sequence = 0; sequence < recordsPerFile; ++sequence)
+    {
+        source.push_back(MakeRecord(sequence));
+    }
+
+    bool passed = true;
+    double appendSeconds = 0;
+    uint64_t appendFailures = 0;
+    {
+        Journal::Writer writer;
+        if (!writer.Open(path, recordsPerFile, files))
+        {
+            std::cerr << "Failed to open the journal" << std::endl;
+            return 1;
+        }
+
+        // Refreshed between batches, outside the timing, as the source only holds a file's worth. The next file is
+        // waited for too, as nothing real fills one in the time it takes to prepare another
+        for (uint64_t batchStart = 0; batchStart < records; batchStart += recordsPerFile)
+        {
+            if (!writer.WaitForNextFile(std::chrono::seconds(5)))
+            {
+                std::cerr << "The next journal file wasn't prepared in time" << std::endl;
+                passed = false;
+            }
+            for (uint64_t index = 0; batchStart > 0 && index < recordsPerFile; ++index)
+            {
+                source[index] = MakeRecord(batchStart + index);
+            }
+
+            auto const start = std::chrono::steady_clock::now();
+            uint64_t const batchEnd = std::min<uint64_t>(records, batchStart + recordsPerFile);
+            for (uint64_t sequence = batchStart; sequence < batchEnd; ++sequence)
+            {
+                appendFailures += writer.Append(source[sequence - batchStart]) ? 0 : 1;
+            }
+            appendSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    // Only the newest files are kept
+    uint64_t const filesWritten = (records + recordsPerFile - 1) / recordsPerFile;
+    uint64_t const filesKept = std::min<uint64_t>(filesWritten, files);
+    uint64_t const expectedRecords = records - (filesWritten - filesKept) * recordsPerFile;
+    uint64_t keptRecords = 0;
+    auto const readStart = std::chrono::steady_clock::now();
+    passed = Verify(Journal::Files(path, files), records - expectedRecords, keptRecords) && passed;
+    double const readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+
+    std::cout << records << " records of " << sizeof(Journal::Record) << " bytes in " << appendSeconds << " s, "
+        << records / appendSeconds << " records/s appended, including " << filesWritten - 1 << " rotations" << std::endl;
+    std::cout << keptRecords << " records kept in " << filesKept << " files (expected " << expectedRecords << "), read back in "
+        << readSeconds << " s, " << keptRecords / readSeconds << " records/s" << std::endl;
+    passed = passed && appendFailures == 0 && keptRecords == expectedRecords;
+
+    // A restart part way through a file carries on from its end, or starts the next file if it's full
+    {
+        Journal::Writer writer;
+        passed = writer.Open(path, recordsPerFile, files) && passed;
+        for (uint64_t sequence = records; sequence < records + c_ResumedRecords; ++sequence)
+        {
+            passed = writer.Append(MakeRecord(sequence)) && passed;
+        }
+    }
+
+    std::vector<std::string> const resumedFiles = Journal::Files(path, files);
+    Journal::Reader newest;
+    uint64_t resumedRecords = 0;
+    if (!resumedFiles.empty() && newest.Open(resumedFiles.back()))
+    {
+        uint64_t const first = records + c_ResumedRecords - newest.Size();
+        passed = Verify({ resumedFiles.back() }, first, resumedRecords) && passed;
+    }
+    std::cout << "reopened and appended " << c_ResumedRecords << ", newest file holds " << resumedRecords << std::endl;
+    passed = passed && resumedRecords >= c_ResumedRecords;
+
+    for (std::string const& file : Journal::Files(path, files))
+    {
+        unlink(file.c_str());
+    }
+    unlink((path + ".next").c_str());
+    rmdir(directory.c_str());
+    Log::Stop();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// Measures press latency in each Flic latency mode and checks that Flic::LatencyPolicy moves the buttons between
+// them. A fake flicd holds back each channel's events by a delay for its mode, standing in for the Bluetooth link,
+// and latency is from the simulated press to the daemon's socket becoming readable. Two buttons share a group and
+// are pressed in turn, first by day and then by night: the first press of each finds them in their day or night
+// mode, and should switch both to low latency for the rest; any press made before the first has got through is
+// still in the old mode. Exits non-zero if the modes don't switch that way or a press goes missing.
+// Usage: LatencyModeBenchmark [presses per phase] [low ms] [normal ms] [high ms]
+
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../FlicLatencyPolicy.h"
+#include "../Log.h"
+#include "../tools/FakeFlicd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    char const* const c_ModeNames[] = { "normal", "low", "high" };
+
+    void Report(char const* name, std::vector<std::chrono::nanoseconds> latencies)
+    {
+        if (latencies.empty())
+        {
+            std::cout << name << ": no presses" << std::endl;
+            return;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto const percentile = [&latencies](double const fraction)
+        {
+            size_t const index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+            return std::chrono::duration<double, std::milli>(latencies[index]).count();
+        };
+
+        std::cout << name << ": " << latencies.size() << " presses, p50 " << percentile(0.5) << " ms, p99 "
+            << percentile(0.99) << " ms, max " << std::chrono::duration<double, std::milli>(latencies.back()).count() << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const pressesPerPhase = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20;
+    std::chrono::milliseconds const modeDelays[] =
+    {
+        std::chrono::milliseconds(argc > 3 ? strtoul(argv[3], nullptr, 10) : 50),
+        std::chrono::milliseconds(argc > 2 ? strtoul(argv[2], nullptr, 10) : 10),
+        std::chrono::milliseconds(argc > 4 ? strtoul(argv[4], nullptr, 10) : 200),
+    };
+    std::chrono::milliseconds const c_PressGap = std::chrono::milliseconds(100);
+    std::chrono::milliseconds const c_ActiveTime = std::chrono::milliseconds(500);
+
+    Log::Start();
+
+    FakeFlicd fake;
+    for (size_t mode = 0; mode < Flic::Codec::c_LatencyModeCount; ++mode)
+    {
+        fake.SetLatencyModeDelay(static_cast<FlicClientProtocol::LatencyMode>(mode), modeDelays[mode]);
+    }
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+
+    EventLoop eventLoop;
+    Flic::Connection connection(eventLoop);
+    Flic::LatencyPolicy::Schedule schedule;
+    schedule.activeTime = c_ActiveTime;
+    Flic::LatencyPolicy policy(eventLoop, connection, schedule);
+
+    // Only read on the event loop's thread, which the policy runs on
+    std::atomic<int> timeOfDay{ 12 * 60 };
+    policy.SetTimeOfDaySource([&timeOfDay]() { return std::chrono::minutes(timeOfDay.load()); });
+
+    Flic::LatencyPolicy::ButtonModes modes;
+    modes.group = 1;
+    for (Flic::ConnectionId connectionId = 1; connectionId <= 2; ++connectionId)
+    {
+        uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, static_cast<uint8_t>(connectionId), 0, 0, 0x80 };
+        connection.AddChannel(connectionId, Flic::ButtonAddress(address));
+        policy.AddButton(connectionId, modes);
+    }
+    policy.Start();
+
+    std::vector<std::chrono::steady_clock::time_point> readableTimes;
+    auto const onRing = [&](Flic::ConnectionId connectionId, std::chrono::steady_clock::time_point readableTime, uint32_t)
+    {
+        readableTimes.push_back(readableTime);
+        policy.OnActivity(connectionId);
+    };
+
+    if (!connection.Connect("127.0.0.1", fake.Port(), onRing, [&eventLoop]() { eventLoop.Stop(); })
+        || !fake.WaitForChannels(2, std::chrono::seconds(5)))
+    {
+        std::cerr << "Failed to connect to the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // The buttons pressed in turn, each press a down and an up
+    FakeFlicd::Script script;
+    for (size_t press = 0; press < pressesPerPhase; ++press)
+    {
+        script.push_back(FakeFlicd::ScriptEvent{ c_PressGap, press % 2, FlicClientProtocol::ButtonDown, 0 });
+        script.push_back(FakeFlicd::ScriptEvent{ std::chrono::milliseconds(20), press % 2, FlicClientProtocol::ButtonUp, 0 });
+    }
+
+    std::atomic<bool> finished{ false };
+    bool failed = false;
+    fake.SetRecordSendTimes(true);
+    std::thread driver([&]()
+    {
+        for (int const phaseTime : { 12 * 60, 23 * 60 })
+        {
+            // Set before the last phase's active time runs out, so the buttons drop straight into this phase's mode
+            timeOfDay = phaseTime;
+            std::this_thread::sleep_for(c_ActiveTime + std::chrono::milliseconds(200));
+
+            fake.Play(script);
+            if (!fake.WaitForScript(std::chrono::seconds(60)))
+            {
+                failed = true;
+                break;
+            }
+        }
+
+        // Everything has been sent, so give it a moment to arrive
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        finished = true;
+    });
+
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if (finished)
+        {
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    eventLoop.Run();
+    driver.join();
+
+    // The downs, in the order they were sent, are the presses the connection saw
+    std::vector<std::chrono::nanoseconds> latencies[Flic::Codec::c_LatencyModeCount];
+    size_t pressIndex = 0;
+    for (FakeFlicd::Delivery const& delivery : fake.Deliveries())
+    {
+        if (delivery.clickType != FlicClientProtocol::ButtonDown)
+        {
+            continue;
+        }
+
+        if (pressIndex < readableTimes.size() && delivery.latencyMode < Flic::Codec::c_LatencyModeCount)
+        {
+            latencies[delivery.latencyMode].push_back(readableTimes[pressIndex] - delivery.pressTime);
+        }
+        ++pressIndex;
+    }
+
+    std::cout << pressesPerPhase << " presses by day and by night, " << readableTimes.size() << " seen, "
+        << fake.GetStatistics().latencyModeChanges << " mode changes" << std::endl;
+    for (size_t mode = 0; mode < Flic::Codec::c_LatencyModeCount; ++mode)
+    {
+        std::string const name = std::string(c_ModeNames[mode]) + " (" + std::to_string(modeDelays[mode].count()) + " ms link)";
+        Report(name.c_str(), latencies[mode]);
+    }
+
+    // Each phase starts in its own mode, and the first press moves the rest to low latency
+    bool const switched = !latencies[FlicClientProtocol::NormalLatency].empty() && !latencies[FlicClientProtocol::HighLatency].empty()
+        && latencies[FlicClientProtocol::LowLatency].size() * 2 >= readableTimes.size();
+    if (!switched)
+    {
+        std::cout << "FAILED: the buttons weren't moved between the modes as expected" << std::endl;
+    }
+
+    policy.Stop();
+    Log::Stop();
+    return !failed && switched && readableTimes.size() == 2 * pressesPerPhase ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+// Measures what a log call costs the calling thread: syslog() directly, as the daemon used to on every packet, against
+// DOORBELLPI_LOG with the formatter thread running, both in bursts the buffer can take and flat out (where messages are
+// dropped), plus a message below the current level. Everything logged really goes to syslog, under "LogBenchmark".
+// Usage: LogBenchmark [messages] [burst]
+
+#include "../Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+namespace
+{
+    template<typename Operation>
+    double NanosecondsPerCall(size_t const messages, size_t const burst, Operation operation)
+    {
+        // Only the calls are timed, not the pauses between bursts that give the formatter time to catch up
+        std::chrono::nanoseconds elapsed(0);
+        for (size_t sent = 0; sent < messages; sent += burst)
+        {
+            size_t const count = std::min(burst, messages - sent);
+            auto const start = std::chrono::steady_clock::now();
+            for (size_t message = 0; message < count; ++message)
+            {
+                operation(static_cast<uint32_t>(sent + message));
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+
+            if (burst < messages)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        }
+
+        return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(messages);
+    }
+
+    void Report(char const* name, double const nanoseconds, uint64_t const droppedBefore)
+    {
+        std::cout << name << ": " << nanoseconds << " ns per call, " << Log::DroppedCount() - droppedBefore << " dropped" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const messages = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t const burst = argc > 2 ? strtoul(argv[2], nullptr, 10) : 256;
+    std::string const hostname = "localhost";
+
+    openlog("LogBenchmark", LOG_PID | LOG_NDELAY, LOG_USER);
+    Log::SetLevel(LOG_NOTICE);
+
+    auto const direct = [](uint32_t const message)
+    {
+        syslog(LOG_NOTICE, "Saw a button click event of click type %d on channel %u", 1, message);
+    };
+    auto const buffered = [](uint32_t const message)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Saw a button click event of click type %d on channel %u", 1, message);
+    };
+    auto const bufferedString = [&hostname](uint32_t const message)
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Connected to '%s:%u'", hostname.c_str(), message);
+    };
+    auto const filtered = [](uint32_t const message)
+    {
+        DOORBELLPI_LOG(LOG_DEBUG, "Got a message of type %u from socket", message);
+    };
+
+    std::cout << messages << " messages, bursts of " << burst << std::endl;
+    Report("syslog", NanosecondsPerCall(messages, burst, direct), Log::DroppedCount());
+
+    if (!Log::Start())
+    {
+        std::cerr << "Failed to start logging" << std::endl;
+        return 1;
+    }
+
+    uint64_t dropped = Log::DroppedCount();
+    Report("buffered, integers", NanosecondsPerCall(messages, burst, buffered), dropped);
+    dropped = Log::DroppedCount();
+    Report("buffered, string", NanosecondsPerCall(messages, burst, bufferedString), dropped);
+    dropped = Log::DroppedCount();
+    Report("buffered, flat out", NanosecondsPerCall(messages, messages, buffered), dropped);
+    dropped = Log::DroppedCount();
+    Report("below the level", NanosecondsPerCall(messages, messages, filtered), dropped);
+
+    Log::Stop();
+    closelog();
+    return 0;
+}
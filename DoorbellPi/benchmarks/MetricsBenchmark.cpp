@@ -0,0 +1,84 @@
+// Measures what the hot path instrumentation costs per update: a histogram record (with and without the clock read
+// that goes with it) and a counter increment, from one thread and from several at once, plus a Prometheus render.
+// Usage: MetricsBenchmark [iterations] [threads]
+
+#include "../Metrics.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    template<typename Operation>
+    double NanosecondsPerOperation(size_t const iterations, size_t const threadCount, Operation operation)
+    {
+        std::vector<std::thread> threads;
+        auto const start = std::chrono::steady_clock::now();
+        for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            threads.emplace_back([iterations, &operation]()
+            {
+                for (size_t iteration = 0; iteration < iterations; ++iteration)
+                {
+                    operation(iteration);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(iterations);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000000;
+    size_t const threadCount = argc > 2 ? strtoul(argv[2], nullptr, 10) : 4;
+
+    Metrics::Daemon metrics;
+
+    for (size_t const threads : { size_t(1), threadCount })
+    {
+        std::cout << threads << " thread(s)" << std::endl;
+
+        // Values spread across the buckets, so the scan length varies as it would in practice
+        double const record = NanosecondsPerOperation(iterations, threads, [&metrics](size_t iteration)
+        {
+            metrics.readableToFirstEdge.Record(std::chrono::nanoseconds((iteration * 7919) % 2000000));
+        });
+        std::cout << "  histogram record:         " << record << " ns" << std::endl;
+
+        double const timedRecord = NanosecondsPerOperation(iterations, threads, [&metrics](size_t)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            metrics.readableToDecoded.Record(std::chrono::steady_clock::now() - start);
+        });
+        std::cout << "  clock read + record:      " << timedRecord << " ns" << std::endl;
+
+        double const increment = NanosecondsPerOperation(iterations, threads, [&metrics](size_t iteration)
+        {
+            metrics.packetsByOpcode[iteration % metrics.packetsByOpcode.size()].Increment();
+        });
+        std::cout << "  counter increment:        " << increment << " ns" << std::endl;
+    }
+
+    size_t const renders = 1000;
+    auto const start = std::chrono::steady_clock::now();
+    size_t renderedBytes = 0;
+    for (size_t render = 0; render < renders; ++render)
+    {
+        renderedBytes += Metrics::RenderPrometheus(metrics).size();
+    }
+    std::cout << "prometheus render:          "
+        << std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / renders
+        << " us for " << renderedBytes / renders << " bytes" << std::endl;
+
+    return 0;
+}
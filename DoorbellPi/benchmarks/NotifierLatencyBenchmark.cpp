@@ -0,0 +1,360 @@
+// Measures ring latency (press to first edge, and how late the last edge is) while every ring is also reported to a
+// local stand-in cloud service that is up, slow, hung or down, to show the ring path doesn't wait on the network. For
+// comparison it also posts inline from the ring handler, as a synchronous curl_easy_perform would. Exits non-zero if,
+// with the queued notifier, any press didn't ring, the p99 of either latency is over the limit, or the service that's
+// up didn't acknowledge every press.
+// Usage: NotifierLatencyBenchmark [presses] [limit ms]
+
+#include "../CloudNotifier.h"
+#include "../Doorbell.h"
+#include "../EventLoop.h"
+#include "../GpioMock.h"
+#include "../HttpClient.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    enum class ServiceMode
+    {
+        Up,
+        Slow,
+        Hung,
+        Down,
+    };
+
+    char const* ToString(ServiceMode const mode)
+    {
+        switch (mode)
+        {
+        case ServiceMode::Up: return "up";
+        case ServiceMode::Slow: return "slow (1 s)";
+        case ServiceMode::Hung: return "hung";
+        case ServiceMode::Down: return "down";
+        }
+        return "?";
+    }
+
+    // Accepts one keep-alive connection at a time and answers each POST according to its mode
+    class StandInService
+    {
+    public:
+        explicit StandInService(ServiceMode const mode)
+            : m_Mode(mode)
+        {
+            m_ListenHandle = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t addressLength = sizeof(address);
+            bind(m_ListenHandle, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            getsockname(m_ListenHandle, reinterpret_cast<sockaddr*>(&address), &addressLength);
+            m_Port = ntohs(address.sin_port);
+
+            // A service that's down refuses connections: nothing is listening on the port
+            if (m_Mode == ServiceMode::Down)
+            {
+                close(m_ListenHandle);
+                m_ListenHandle = -1;
+                return;
+            }
+
+            listen(m_ListenHandle, 4);
+            m_Thread = std::thread(&StandInService::Run, this);
+        }
+
+        ~StandInService()
+        {
+            m_Running = false;
+            if (m_Thread.joinable())
+            {
+                m_Thread.join();
+            }
+            if (m_ListenHandle >= 0)
+            {
+                close(m_ListenHandle);
+            }
+        }
+
+        std::string Url() const
+        {
+            return "http://127.0.0.1:" + std::to_string(m_Port) + "/presses";
+        }
+
+        uint64_t PressesReceived() const { return m_PressesReceived; }
+        uint64_t RequestsReceived() const { return m_RequestsReceived; }
+
+    private:
+        bool WaitReadable(int const handle)
+        {
+            while (m_Running)
+            {
+                pollfd pollEntry = { handle, POLLIN, 0 };
+                if (poll(&pollEntry, 1, 50) > 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Run()
+        {
+            while (WaitReadable(m_ListenHandle))
+            {
+                int const connection = accept4(m_ListenHandle, nullptr, nullptr, SOCK_CLOEXEC);
+                if (connection >= 0)
+                {
+                    Serve(connection);
+                    close(connection);
+                }
+            }
+        }
+
+        void Serve(int const connection)
+        {
+            std::string received;
+            char buffer[4096];
+            while (WaitReadable(connection))
+            {
+                ssize_t const result = recv(connection, buffer, sizeof(buffer), 0);
+                if (result <= 0)
+                {
+                    return;
+                }
+                received.append(buffer, static_cast<size_t>(result));
+
+                size_t const headerEnd = received.find("\r\n\r\n");
+                size_t const lengthStart = received.find("Content-Length: ");
+                if (headerEnd == std::string::npos || lengthStart == std::string::npos)
+                {
+                    continue;
+                }
+
+                size_t const requestLength = headerEnd + 4 + strtoul(received.c_str() + lengthStart + 16, nullptr, 10);
+                if (received.size() < requestLength)
+                {
+                    continue;
+                }
+
+                std::string const body = received.substr(headerEnd + 4, requestLength - headerEnd - 4);
+                received.erase(0, requestLength);
+                ++m_RequestsReceived;
+                for (size_t position = body.find("\"button\""); position != std::string::npos; position = body.find("\"button\"", position + 1))
+                {
+                    ++m_PressesReceived;
+                }
+
+                if (m_Mode == ServiceMode::Hung)
+                {
+                    continue;
+                }
+
+                if (m_Mode == ServiceMode::Slow)
+                {
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                }
+
+                char const c_Response[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+                send(connection, c_Response, sizeof(c_Response) - 1, MSG_NOSIGNAL);
+            }
+        }
+
+        ServiceMode const m_Mode;
+        int m_ListenHandle = -1;
+        uint16_t m_Port = 0;
+        std::atomic<bool> m_Running{ true };
+        std::atomic<uint64_t> m_PressesReceived{ 0 };
+        std::atomic<uint64_t> m_RequestsReceived{ 0 };
+        std::thread m_Thread;
+    };
+
+    struct RingLatencies
+    {
+        std::vector<std::chrono::nanoseconds> pressToEdge;
+        std::vector<std::chrono::nanoseconds> endLateness;
+    };
+
+    void Report(char const* name, char const* measure, std::vector<std::chrono::nanoseconds> latencies)
+    {
+        if (latencies.empty())
+        {
+            std::cout << "  " << name << ": no rings" << std::endl;
+            return;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto const percentile = [&latencies](double const fraction)
+        {
+            size_t const index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+            return std::chrono::duration<double, std::micro>(latencies[index]).count();
+        };
+
+        std::cout << "  " << name << ": " << latencies.size() << " rings, " << measure << " p50 " << percentile(0.5) << " us, p99 "
+            << percentile(0.99) << " us, max " << std::chrono::duration<double, std::micro>(latencies.back()).count() << " us" << std::endl;
+    }
+
+    void Report(char const* name, RingLatencies const& latencies)
+    {
+        Report(name, "press to first edge", latencies.pressToEdge);
+        Report(name, "last edge lateness", latencies.endLateness);
+    }
+
+    std::chrono::nanoseconds Percentile99(std::vector<std::chrono::nanoseconds> latencies)
+    {
+        std::sort(latencies.begin(), latencies.end());
+        return latencies.empty() ? std::chrono::nanoseconds::max() : latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    }
+
+    // Every press rang, and the network didn't hold any of the rings up
+    bool Check(RingLatencies const& latencies, int const presses, std::chrono::milliseconds const limit)
+    {
+        if (static_cast<int>(latencies.pressToEdge.size()) != presses)
+        {
+            std::cout << "  FAILED: only " << latencies.pressToEdge.size() << " of " << presses << " presses rang" << std::endl;
+            return false;
+        }
+        if (Percentile99(latencies.pressToEdge) > limit || Percentile99(latencies.endLateness) > limit)
+        {
+            std::cout << "  FAILED: p99 latency over " << limit.count() << " ms" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Presses the button every interval and measures how long each press took to reach the first edge of its ring,
+    // and how late the ring's final edge was
+    RingLatencies Ring(int const presses, Doorbell::RingHandler ringHandler)
+    {
+        std::chrono::milliseconds const c_PressInterval = std::chrono::milliseconds(20);
+        std::chrono::milliseconds const c_RingDuration = std::chrono::milliseconds(2);
+
+        EventLoop eventLoop;
+        Gpio::MockBackend gpio;
+        gpio.RequestOutputs({ 23 });
+
+        Doorbell doorbell(gpio);
+        doorbell.SetRingHandler(std::move(ringHandler));
+        uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0x73, 0xDA, 0xE4, 0x80 };
+        Flic::ConnectionId const connectionId = doorbell.AddButton(Flic::ButtonAddress(address),
+            ButtonAction{ { 23 }, Rings::Compile(Rings::Once(c_RingDuration)), std::chrono::milliseconds(0) });
+        doorbell.Start();
+
+        std::vector<std::chrono::steady_clock::time_point> pressTimes;
+        int pressTimer = EventLoop::c_InvalidHandle;
+        pressTimer = eventLoop.CreateTimer([&]()
+        {
+            if (static_cast<int>(pressTimes.size()) == presses)
+            {
+                eventLoop.Stop();
+                return;
+            }
+
+            pressTimes.push_back(std::chrono::steady_clock::now());
+            doorbell.OnPress(connectionId, pressTimes.back());
+            eventLoop.ArmTimer(pressTimer, c_PressInterval);
+        });
+        eventLoop.ArmTimer(pressTimer, c_PressInterval);
+        eventLoop.Run();
+        eventLoop.DestroyTimer(pressTimer);
+        doorbell.Stop();
+
+        // Every ring is a rising edge then a falling one. A press that didn't start a ring (it was still ringing) is
+        // left out
+        RingLatencies latencies;
+        std::vector<Gpio::MockBackend::Edge> const edges = gpio.Edges();
+        size_t edgeIndex = 0;
+        for (size_t pressIndex = 0; pressIndex < pressTimes.size(); ++pressIndex)
+        {
+            auto const nextPress = pressIndex + 1 < pressTimes.size() ? pressTimes[pressIndex + 1] : std::chrono::steady_clock::time_point::max();
+            while (edgeIndex < edges.size() && (edges[edgeIndex].values == 0 || edges[edgeIndex].time < pressTimes[pressIndex]))
+            {
+                ++edgeIndex;
+            }
+
+            if (edgeIndex + 1 < edges.size() && edges[edgeIndex].time < nextPress)
+            {
+                latencies.pressToEdge.push_back(edges[edgeIndex].time - pressTimes[pressIndex]);
+                latencies.endLateness.push_back(edges[edgeIndex + 1].time - (edges[edgeIndex].time + c_RingDuration));
+                edgeIndex += 2;
+            }
+        }
+
+        return latencies;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int const presses = argc > 1 ? atoi(argv[1]) : 100;
+    std::chrono::milliseconds const limit = std::chrono::milliseconds(argc > 2 ? atoi(argv[2]) : 20);
+    std::string const spoolPath = "/tmp/NotifierLatencyBenchmark." + std::to_string(getpid()) + ".spool";
+
+    std::cout << "no cloud notification" << std::endl;
+    Report("baseline", Ring(presses, Doorbell::RingHandler()));
+
+    bool passed = true;
+    for (ServiceMode const mode : { ServiceMode::Up, ServiceMode::Slow, ServiceMode::Hung, ServiceMode::Down })
+    {
+        StandInService service(mode);
+        std::cout << "service " << ToString(mode) << std::endl;
+
+        RingLatencies latencies;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        {
+            Cloud::Notifier notifier(service.Url(), spoolPath);
+            notifier.Start();
+            latencies = Ring(presses, [&notifier](Flic::ButtonAddress const& buttonAddress)
+            {
+                notifier.Notify(buttonAddress);
+            });
+
+            // Let the last batch go out before stopping
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            notifier.Stop();
+            delivered = notifier.DeliveredCount();
+            dropped = notifier.DroppedCount();
+        }
+        unlink(spoolPath.c_str());
+
+        Report("queued notifier", latencies);
+        std::cout << "  " << service.RequestsReceived() << " requests carried " << service.PressesReceived() << " presses, "
+            << delivered << " acknowledged, " << dropped << " dropped, the rest spooled" << std::endl;
+        passed = Check(latencies, presses, limit) && passed;
+        if (mode == ServiceMode::Up && delivered != static_cast<uint64_t>(presses))
+        {
+            std::cout << "  FAILED: the service is up, but only " << delivered << " presses were acknowledged" << std::endl;
+            passed = false;
+        }
+    }
+
+    // The alternative: post from the ring handler itself. Only a few presses, as each one can stall for seconds
+    {
+        int const inlinePresses = std::min(presses, 5);
+        StandInService service(ServiceMode::Slow);
+        HttpClient client(std::chrono::seconds(5));
+        client.SetUrl(service.Url());
+        std::cout << "service " << ToString(ServiceMode::Slow) << std::endl;
+        Report("inline post", Ring(inlinePresses, [&client](Flic::ButtonAddress const&)
+        {
+            client.Post("application/json", "{\"presses\":[{\"button\":\"80:E4:DA:73:BF:40\",\"time\":0}]}");
+        }));
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// Fuzzes Flic::Codec with truncated and random packets, checking that nothing shorter than an event's wire size is
+// ever handed to a handler, then compares dispatch cost against the original unchecked switch/reinterpret_cast.
+// Exits non-zero if a packet that should have been rejected wasn't.
+// Usage: PacketCodecBenchmark [iterations]
+
+#include "../FlicCodec.h"
+
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+    volatile uint32_t s_Sink = 0;
+
+    template<size_t... Opcodes>
+    constexpr std::array<size_t, sizeof...(Opcodes)> MakeWireSizes(std::index_sequence<Opcodes...>)
+    {
+        return {{ Flic::Codec::Event<static_cast<uint8_t>(Opcodes)>::c_WireSize... }};
+    }
+
+    constexpr std::array<size_t, Flic::Codec::c_EventOpcodeCount> c_WireSizes = MakeWireSizes(std::make_index_sequence<Flic::Codec::c_EventOpcodeCount>());
+
+    struct CheckingHandler
+    {
+        template<uint8_t Opcode, typename Type>
+        void OnEvent(Flic::Codec::EventTag<Opcode>, Type const& event)
+        {
+            if (m_PacketLength < c_WireSizes[Opcode])
+            {
+                std::cerr << "Opcode " << static_cast<int>(Opcode) << " dispatched with only " << m_PacketLength << " bytes" << std::endl;
+                exit(1);
+            }
+            ++m_Handled;
+            s_Sink += reinterpret_cast<uint8_t const*>(&event)[0];
+        }
+
+        size_t m_PacketLength = 0;
+        uint64_t m_Handled = 0;
+    };
+
+    struct ButtonHandler : private Flic::Codec::IgnoreEvents
+    {
+        using IgnoreEvents::OnEvent;
+
+        void OnEvent(Flic::Codec::EventTag<EVT_BUTTON_UP_OR_DOWN_OPCODE>, FlicClientProtocol::EvtButtonEvent const& event)
+        {
+            s_Sink += event.time_diff + event.click_type;
+        }
+
+        void OnEvent(Flic::Codec::EventTag<EVT_CONNECTION_STATUS_CHANGED_OPCODE>, FlicClientProtocol::EvtConnectionStatusChanged const& event)
+        {
+            s_Sink += event.connection_status;
+        }
+    };
+
+    // The original decoding: switch on the opcode and reinterpret without looking at the length
+    void DispatchLegacy(Flic::PacketView const& packet)
+    {
+        switch (packet.data[0])
+        {
+        case EVT_BUTTON_UP_OR_DOWN_OPCODE:
+        {
+            auto eventData = reinterpret_cast<FlicClientProtocol::EvtButtonEvent const*>(packet.data);
+            s_Sink += eventData->time_diff + eventData->click_type;
+            break;
+        }
+        case EVT_CONNECTION_STATUS_CHANGED_OPCODE:
+        {
+            auto eventData = reinterpret_cast<FlicClientProtocol::EvtConnectionStatusChanged const*>(packet.data);
+            s_Sink += eventData->connection_status;
+            break;
+        }
+        default:
+        {
+            break;
+        }
+        }
+    }
+
+    bool FuzzTruncatedPackets()
+    {
+        uint8_t buffer[64] = {};
+        for (size_t opcode = 0; opcode < Flic::Codec::c_EventOpcodeCount; ++opcode)
+        {
+            buffer[0] = static_cast<uint8_t>(opcode);
+            for (size_t length = 1; length <= c_WireSizes[opcode]; ++length)
+            {
+                CheckingHandler handler;
+                handler.m_PacketLength = length;
+                Flic::PacketView const packet = { buffer, static_cast<uint16_t>(length) };
+                Flic::Codec::DispatchResult const result = Flic::Codec::Dispatcher<CheckingHandler>::Dispatch(handler, packet);
+                Flic::Codec::DispatchResult const expected = length < c_WireSizes[opcode] ? Flic::Codec::DispatchResult::Truncated : Flic::Codec::DispatchResult::Handled;
+                if (result != expected)
+                {
+                    std::cerr << "Opcode " << opcode << " with " << length << " bytes was not " << (length < c_WireSizes[opcode] ? "rejected" : "accepted") << std::endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool FuzzRandomPackets(int const iterations)
+    {
+        std::mt19937 generator(12345);
+        std::uniform_int_distribution<int> byteDistribution(0, 255);
+        std::uniform_int_distribution<int> lengthDistribution(1, 48);
+
+        uint8_t buffer[64];
+        CheckingHandler handler;
+        uint64_t rejected = 0;
+        for (int iteration = 0; iteration < iterations; ++iteration)
+        {
+            size_t const length = static_cast<size_t>(lengthDistribution(generator));
+            for (size_t index = 0; index < length; ++index)
+            {
+                buffer[index] = static_cast<uint8_t>(byteDistribution(generator));
+            }
+            // Bias towards known opcodes so every decoder is exercised
+            buffer[0] %= Flic::Codec::c_EventOpcodeCount + 2;
+
+            handler.m_PacketLength = length;
+            Flic::PacketView const packet = { buffer, static_cast<uint16_t>(length) };
+            if (Flic::Codec::Dispatcher<CheckingHandler>::Dispatch(handler, packet) != Flic::Codec::DispatchResult::Handled)
+            {
+                ++rejected;
+            }
+        }
+
+        std::cout << "random packets: " << handler.m_Handled << " handled, " << rejected << " rejected" << std::endl;
+        return true;
+    }
+
+    std::vector<uint8_t> RecordStream(size_t const packetCount, std::vector<Flic::PacketView>& packets)
+    {
+        size_t const c_PacketSize = 16;
+        std::vector<uint8_t> stream(packetCount * c_PacketSize, 0);
+        for (size_t packetIndex = 0; packetIndex < packetCount; ++packetIndex)
+        {
+            uint8_t* const packet = stream.data() + packetIndex * c_PacketSize;
+            packet[0] = (packetIndex % 16 == 15) ? EVT_CONNECTION_STATUS_CHANGED_OPCODE : EVT_BUTTON_UP_OR_DOWN_OPCODE;
+            packet[5] = static_cast<uint8_t>(packetIndex & 1);
+            packets.push_back({ packet, static_cast<uint16_t>(packet[0] == EVT_BUTTON_UP_OR_DOWN_OPCODE ? 11 : 7) });
+        }
+        return stream;
+    }
+
+    template<typename Function>
+    void Time(char const* name, std::vector<Flic::PacketView> const& packets, Function dispatch)
+    {
+        auto const startTime = std::chrono::steady_clock::now();
+        for (int repeat = 0; repeat < 10; ++repeat)
+        {
+            for (Flic::PacketView const& packet : packets)
+            {
+                dispatch(packet);
+            }
+        }
+        auto const endTime = std::chrono::steady_clock::now();
+
+        double const nanoseconds = std::chrono::duration<double, std::nano>(endTime - startTime).count();
+        std::cout << name << ": " << nanoseconds / (10.0 * packets.size()) << " ns/packet" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int const iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    if (!FuzzTruncatedPackets())
+    {
+        return 1;
+    }
+    std::cout << "truncated packets: all rejected" << std::endl;
+
+    if (!FuzzRandomPackets(iterations))
+    {
+        return 1;
+    }
+
+    std::vector<Flic::PacketView> packets;
+    std::vector<uint8_t> const stream = RecordStream(static_cast<size_t>(iterations), packets);
+
+    ButtonHandler handler;
+    Time("legacy switch", packets, [](Flic::PacketView const& packet) { DispatchLegacy(packet); });
+    Time("Codec::Dispatcher", packets, [&handler](Flic::PacketView const& packet) { Flic::Codec::Dispatcher<ButtonHandler>::Dispatch(handler, packet); });
+
+    return 0;
+}
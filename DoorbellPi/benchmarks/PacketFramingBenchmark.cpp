@@ -0,0 +1,242 @@
+// Measures packets/sec, allocations per packet and reads per packet when framing a recorded flicd packet stream,
+// comparing the original per-packet read/allocate approach against Flic::PacketReader.
+
+#include "../FlicPacketReader.h"
+#include "../external/flic/client_protocol_packets.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    std::atomic<uint64_t> s_AllocationCount(0);
+    uint64_t s_ReadCount = 0;
+
+    // Keeps the packet contents live so the framing loops can't be optimised away
+    volatile uint8_t s_OpcodeSink = 0;
+
+    ssize_t CountedRead(int fileDescriptor, void* buffer, size_t length)
+    {
+        ++s_ReadCount;
+        return read(fileDescriptor, buffer, length);
+    }
+
+    template<typename Packet>
+    void AppendPacket(std::vector<uint8_t>& stream, Packet const& packet)
+    {
+        stream.push_back(static_cast<uint8_t>(sizeof(packet) & 0xff));
+        stream.push_back(static_cast<uint8_t>(sizeof(packet) >> 8));
+        uint8_t const* const bytes = reinterpret_cast<uint8_t const*>(&packet);
+        stream.insert(stream.end(), bytes, bytes + sizeof(packet));
+    }
+
+    // A recording of what flicd sends while a button is in use: mostly up/down events with the occasional
+    // connection status change
+    std::vector<uint8_t> RecordStream(int const packetCount)
+    {
+        std::vector<uint8_t> stream;
+        for (int packetIndex = 0; packetIndex < packetCount; ++packetIndex)
+        {
+            if (packetIndex % 16 == 15)
+            {
+                FlicClientProtocol::EvtConnectionStatusChanged statusChanged;
+                memset(&statusChanged, 0, sizeof(statusChanged));
+                statusChanged.base.opcode = EVT_CONNECTION_STATUS_CHANGED_OPCODE;
+                statusChanged.base.conn_id = 1;
+                statusChanged.connection_status = FlicClientProtocol::Ready;
+                AppendPacket(stream, statusChanged);
+            }
+            else
+            {
+                FlicClientProtocol::EvtButtonEvent buttonEvent;
+                memset(&buttonEvent, 0, sizeof(buttonEvent));
+                buttonEvent.base.opcode = EVT_BUTTON_UP_OR_DOWN_OPCODE;
+                buttonEvent.base.conn_id = 1;
+                buttonEvent.click_type = (packetIndex & 1) ? FlicClientProtocol::ButtonUp : FlicClientProtocol::ButtonDown;
+                AppendPacket(stream, buttonEvent);
+            }
+        }
+        return stream;
+    }
+
+    // The framing used by the original WaitForRing(): read the prefix, allocate, read the body
+    uint64_t FrameLegacy(int const fileDescriptor)
+    {
+        uint64_t packets = 0;
+        unsigned char lengthBuffer[2];
+        int bytesInLengthBuffer = 0;
+        while (true)
+        {
+            ssize_t nbytes = CountedRead(fileDescriptor, lengthBuffer + bytesInLengthBuffer, 2 - bytesInLengthBuffer);
+            if (nbytes <= 0)
+            {
+                break;
+            }
+
+            bytesInLengthBuffer += static_cast<int>(nbytes);
+            if (bytesInLengthBuffer != 2)
+            {
+                continue;
+            }
+            bytesInLengthBuffer = 0;
+
+            int const packetLength = lengthBuffer[0] | (lengthBuffer[1] << 8);
+            std::unique_ptr<unsigned char[]> readBuffer = std::make_unique<unsigned char[]>(packetLength);
+            int readPosition = 0;
+            int bytesLeft = packetLength;
+            while (bytesLeft > 0)
+            {
+                nbytes = CountedRead(fileDescriptor, readBuffer.get() + readPosition, bytesLeft);
+                if (nbytes <= 0)
+                {
+                    return packets;
+                }
+
+                readPosition += static_cast<int>(nbytes);
+                bytesLeft -= static_cast<int>(nbytes);
+            }
+
+            s_OpcodeSink = readBuffer[0];
+            ++packets;
+        }
+
+        return packets;
+    }
+
+    uint64_t FramePacketReader(int const fileDescriptor)
+    {
+        uint64_t packets = 0;
+        // The reader is allocated once per connection, so it isn't counted against the packets
+        std::unique_ptr<Flic::PacketReader> const packetReader = std::make_unique<Flic::PacketReader>();
+        s_AllocationCount = 0;
+
+        while (true)
+        {
+            ++s_ReadCount;
+            if (packetReader->Fill(fileDescriptor) != Flic::PacketReader::ReadResult::Data)
+            {
+                break;
+            }
+
+            Flic::PacketView packet;
+            while (packetReader->Next(packet) == Flic::PacketReader::FrameResult::Packet)
+            {
+                s_OpcodeSink = packet.data[0];
+                ++packets;
+            }
+        }
+
+        return packets;
+    }
+
+    template<typename Framer>
+    void Run(char const* name, std::vector<uint8_t> const& stream, Framer framer)
+    {
+        int sockets[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+        {
+            std::cerr << "Failed to create socket pair" << std::endl;
+            exit(1);
+        }
+
+        // Feed the stream in socket sized chunks from another thread, as flicd would
+        std::thread writer([&stream, &sockets]()
+        {
+            size_t const c_ChunkSize = 1500;
+            for (size_t offset = 0; offset < stream.size(); offset += c_ChunkSize)
+            {
+                size_t const chunkLength = std::min(c_ChunkSize, stream.size() - offset);
+                size_t written = 0;
+                while (written < chunkLength)
+                {
+                    ssize_t const result = write(sockets[1], stream.data() + offset + written, chunkLength - written);
+                    if (result <= 0)
+                    {
+                        return;
+                    }
+                    written += static_cast<size_t>(result);
+                }
+            }
+            close(sockets[1]);
+        });
+
+        s_ReadCount = 0;
+        s_AllocationCount = 0;
+        auto const startTime = std::chrono::steady_clock::now();
+        uint64_t const packets = framer(sockets[0]);
+        auto const endTime = std::chrono::steady_clock::now();
+        uint64_t const allocations = s_AllocationCount;
+
+        writer.join();
+        close(sockets[0]);
+
+        double const seconds = std::chrono::duration<double>(endTime - startTime).count();
+        std::cout << name << ": " << packets << " packets in " << seconds << " s, "
+            << static_cast<uint64_t>(packets / seconds) << " packets/s, "
+            << static_cast<double>(allocations) / packets << " allocations/packet, "
+            << static_cast<double>(s_ReadCount) / packets << " reads/packet" << std::endl;
+    }
+}
+
+// Count every allocation. The replacements are kept out of line so the compiler doesn't pair malloc/free across them
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++s_AllocationCount;
+    void* const memory = malloc(size ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size)
+{
+    ++s_AllocationCount;
+    void* const memory = malloc(size ? size : 1);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+int main(int argc, char** argv)
+{
+    int const packetCount = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::vector<uint8_t> const stream = RecordStream(packetCount);
+
+    Run("legacy read/allocate", stream, FrameLegacy);
+    Run("PacketReader", stream, FramePacketReader);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Checks that presses are dispatched promptly while a ring is playing: a fake flicd sends presses through
+// Flic::Connection while the Doorbell plays a long ring, and each press's time from being written to the socket to
+// reaching Doorbell::OnPress is measured. Exits non-zero if any press goes missing, the ring wasn't still playing
+// when the last press arrived, or the slowest dispatch took longer than the limit.
+// Usage: PressDispatchBenchmark [presses] [presses per second] [limit ms]
+
+#include "../Doorbell.h"
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../GpioMock.h"
+#include "../Log.h"
+#include "../tools/FakeFlicd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    size_t const presses = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+    double const pressesPerSecond = argc > 2 ? atof(argv[2]) : 50;
+    std::chrono::milliseconds const limit = std::chrono::milliseconds(argc > 3 ? atoi(argv[3]) : 20);
+
+    Log::Start();
+
+    FakeFlicd fake;
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // Strikes for a second longer than the presses take, and every press after the first is folded into it
+    std::chrono::duration<double> const pressingTime(presses / pressesPerSecond);
+    Rings::Pattern pattern;
+    while (std::chrono::duration<double>(std::chrono::milliseconds(100) * (pattern.size() / 2)) < pressingTime + std::chrono::seconds(1))
+    {
+        Rings::Once(pattern, std::chrono::milliseconds(50));
+        Rings::Pause(pattern, std::chrono::milliseconds(50));
+    }
+    std::shared_ptr<Rings::Timeline const> const timeline = Rings::Compile(pattern);
+
+    EventLoop eventLoop;
+    Gpio::MockBackend gpio;
+    gpio.RequestOutputs({ 23 });
+    Doorbell doorbell(gpio);
+    Flic::Connection connection(eventLoop);
+
+    uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0x73, 0xDA, 0xE4, 0x80 };
+    Flic::ConnectionId const connectionId = doorbell.AddButton(Flic::ButtonAddress(address),
+        ButtonAction{ { 23 }, timeline, std::chrono::milliseconds(0) });
+    connection.AddChannel(connectionId, Flic::ButtonAddress(address));
+    doorbell.Start();
+
+    std::vector<std::chrono::steady_clock::time_point> dispatchTimes;
+    dispatchTimes.reserve(presses);
+    auto const onPress = [&](Flic::ConnectionId pressedId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)
+    {
+        dispatchTimes.push_back(std::chrono::steady_clock::now());
+        doorbell.OnPress(pressedId, readableTime, timeDiff);
+    };
+
+    if (!connection.Connect("127.0.0.1", fake.Port(), onPress, [&eventLoop]() { eventLoop.Stop(); })
+        || !fake.WaitForChannels(1, std::chrono::seconds(5)))
+    {
+        std::cerr << "Failed to connect to the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // Stop once every press has arrived, or on a timeout
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10) + pressingTime;
+    bool playingAtLastPress = false;
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if (dispatchTimes.size() >= presses || std::chrono::steady_clock::now() > deadline)
+        {
+            size_t const edges = gpio.Edges().size();
+            playingAtLastPress = edges > 0 && edges < timeline->edges.size();
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(5));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(5));
+
+    fake.SetRecordSendTimes(true);
+    fake.Play(FakeFlicd::Presses(presses, pressesPerSecond));
+    eventLoop.Run();
+    eventLoop.DestroyTimer(pollTimer);
+    doorbell.Stop();
+
+    // Send times alternate button down, button up, and only the downs are dispatched
+    std::vector<std::chrono::steady_clock::time_point> const sendTimes = fake.SendTimes();
+    std::chrono::nanoseconds slowest(0);
+    for (size_t press = 0; press < dispatchTimes.size() && press * 2 < sendTimes.size(); ++press)
+    {
+        slowest = std::max<std::chrono::nanoseconds>(slowest, dispatchTimes[press] - sendTimes[press * 2]);
+    }
+
+    bool const passed = dispatchTimes.size() == presses && playingAtLastPress && slowest <= limit;
+    std::cout << presses << " presses at " << pressesPerSecond << "/s, " << dispatchTimes.size() << " dispatched, ring "
+        << (playingAtLastPress ? "still playing" : "not playing") << " at the last; slowest send to dispatch "
+        << std::chrono::duration<double, std::micro>(slowest).count() << " us, limit "
+        << std::chrono::duration<double, std::micro>(limit).count() << " us: " << (passed ? "passed" : "FAILED") << std::endl;
+    Log::Stop();
+    return passed ? 0 : 1;
+}
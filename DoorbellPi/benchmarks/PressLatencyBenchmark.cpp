@@ -0,0 +1,125 @@
+// Measures end to end press latency: from a fake flicd writing a button down event to its socket, through
+// Flic::Connection and Doorbell, to the first edge of the ring on the mock GPIO backend. Exits non-zero if any press
+// doesn't reach the Doorbell.
+// Usage: PressLatencyBenchmark [presses] [presses per second]
+
+#include "../Doorbell.h"
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../Log.h"
+#include "../GpioMock.h"
+#include "../tools/FakeFlicd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+
+namespace
+{
+    void Report(char const* name, std::vector<std::chrono::nanoseconds> latencies)
+    {
+        if (latencies.empty())
+        {
+            std::cout << name << ": no presses" << std::endl;
+            return;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto const percentile = [&latencies](double const fraction)
+        {
+            size_t const index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+            return std::chrono::duration<double, std::micro>(latencies[index]).count();
+        };
+
+        std::cout << name << ": " << latencies.size() << " presses, p50 " << percentile(0.5) << " us, p99 "
+            << percentile(0.99) << " us, max " << std::chrono::duration<double, std::micro>(latencies.back()).count() << " us" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t const presses = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+    double const pressesPerSecond = argc > 2 ? atof(argv[2]) : 50;
+    std::chrono::milliseconds const c_StrikeDuration = std::chrono::milliseconds(2);
+
+    // Log as the daemon does, from the formatter thread
+    Log::Start();
+
+    FakeFlicd fake;
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+
+    EventLoop eventLoop;
+    Gpio::MockBackend gpio;
+    gpio.RequestOutputs({ 23 });
+    Doorbell doorbell(gpio);
+    Flic::Connection connection(eventLoop);
+
+    uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0x73, 0xDA, 0xE4, 0x80 };
+    Flic::ConnectionId const connectionId = doorbell.AddButton(Flic::ButtonAddress(address),
+        ButtonAction{ { 23 }, Rings::Compile(Rings::Once(c_StrikeDuration)), std::chrono::milliseconds(0) });
+    connection.AddChannel(connectionId, Flic::ButtonAddress(address));
+    doorbell.Start();
+
+    size_t rings = 0;
+    auto const onRing = [&](Flic::ConnectionId pressedId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)
+    {
+        doorbell.OnPress(pressedId, readableTime, timeDiff);
+        ++rings;
+    };
+
+    if (!connection.Connect("127.0.0.1", fake.Port(), onRing, [&eventLoop]() { eventLoop.Stop(); })
+        || !fake.WaitForChannels(1, std::chrono::seconds(5)))
+    {
+        std::cerr << "Failed to connect to the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // Stop once every press has rung and its ring has finished, or on a timeout
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10) + std::chrono::duration<double>(presses / pressesPerSecond);
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if ((rings >= presses && gpio.State() == 0) || std::chrono::steady_clock::now() > deadline)
+        {
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+
+    fake.SetRecordSendTimes(true);
+    fake.Play(FakeFlicd::Presses(presses, pressesPerSecond));
+    eventLoop.Run();
+    eventLoop.DestroyTimer(pollTimer);
+    doorbell.Stop();
+
+    // Send times alternate button down, button up. Each down should be followed by one rising edge
+    std::vector<std::chrono::steady_clock::time_point> const sendTimes = fake.SendTimes();
+    std::vector<Gpio::MockBackend::Edge> const edges = gpio.Edges();
+    std::vector<std::chrono::nanoseconds> latencies;
+    size_t edgeIndex = 0;
+    for (size_t sendIndex = 0; sendIndex < sendTimes.size(); sendIndex += 2)
+    {
+        while (edgeIndex < edges.size() && (edges[edgeIndex].values == 0 || edges[edgeIndex].time < sendTimes[sendIndex]))
+        {
+            ++edgeIndex;
+        }
+
+        if (edgeIndex < edges.size())
+        {
+            latencies.push_back(edges[edgeIndex++].time - sendTimes[sendIndex]);
+        }
+    }
+
+    std::cout << presses << " presses at " << pressesPerSecond << "/s, " << rings << " rang" << std::endl;
+    Report("send to first edge", latencies);
+    Log::Stop();
+    return rings == presses ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Plays a ring pattern against the mock GPIO backend while other processes load every core and churn memory, and
+// reports how far each edge landed from where the pattern says it should be (p50/p99/max) and how many page faults
+// the ring thread took: first with normal scheduling, then with the daemon's real-time mode (memory locked, the ring
+// thread under SCHED_FIFO on a core of its own). Without the privileges for real-time mode the second run falls back
+// as the daemon does, and says so.
+// Usage: RealTimeJitterBenchmark [pattern] [repeats] [cpu hogs] [memory MB] [priority]
+
+#include "../EventLoop.h"
+#include "../GpioMock.h"
+#include "../Log.h"
+#include "../RealTime.h"
+#include "../Rings.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    struct Run
+    {
+        std::vector<std::chrono::nanoseconds> errors;
+        long minorFaults = 0;
+        long majorFaults = 0;
+        bool realTime = false;
+    };
+
+    // Spins until killed
+    pid_t StartCpuHog()
+    {
+        pid_t const processId = fork();
+        if (processId == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            uint64_t volatile spin = 0;
+            for (;;)
+            {
+                ++spin;
+            }
+        }
+        return processId;
+    }
+
+    // Maps, touches and unmaps megabytes over and over until killed, keeping the kernel busy faulting and zeroing
+    // pages and evicting everything else from the caches
+    pid_t StartMemoryChurn(size_t const megabytes)
+    {
+        pid_t const processId = fork();
+        if (processId == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            size_t const size = megabytes * 1024 * 1024;
+            for (;;)
+            {
+                void* const mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mapping == MAP_FAILED)
+                {
+                    continue;
+                }
+                for (size_t offset = 0; offset < size; offset += 4096)
+                {
+                    static_cast<uint8_t volatile*>(mapping)[offset] = 1;
+                }
+                munmap(mapping, size);
+            }
+        }
+        return processId;
+    }
+
+    // Each recorded edge against its offset in the timeline, measured from the first edge
+    void Collect(Rings::Timeline const& timeline, Gpio::MockBackend const& gpio, std::vector<std::chrono::nanoseconds>& errors)
+    {
+        std::vector<Gpio::MockBackend::Edge> const edges = gpio.Edges();
+        if (edges.empty())
+        {
+            return;
+        }
+
+        auto const startTime = edges.front().time;
+        for (size_t edgeIndex = 0; edgeIndex < timeline.edges.size() && edgeIndex < edges.size(); ++edgeIndex)
+        {
+            auto const ideal = startTime + (timeline.edges[edgeIndex].offset - timeline.edges.front().offset);
+            errors.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(edges[edgeIndex].time - ideal));
+        }
+    }
+
+    // On a thread of its own, as the daemon plays rings, with the policy applied the way Doorbell does
+    Run PlayRepeatedly(std::shared_ptr<Rings::Timeline const> const& timeline, int const repeats, RealTime::ThreadPolicy const& policy)
+    {
+        Run run;
+        std::thread ringThread([&]()
+        {
+            if (policy.priority > 0 || policy.cpu >= 0)
+            {
+                run.realTime = RealTime::ApplyToThread(policy, "ring");
+            }
+
+            rusage before;
+            getrusage(RUSAGE_THREAD, &before);
+            for (int repeat = 0; repeat < repeats; ++repeat)
+            {
+                Gpio::MockBackend gpio;
+                gpio.RequestOutputs({ 23 });
+                EventLoop eventLoop;
+                Rings::Player player(eventLoop, gpio, 1);
+
+                // Stop once the ring is over
+                int pollTimer = EventLoop::c_InvalidHandle;
+                pollTimer = eventLoop.CreateTimer([&eventLoop, &player, &pollTimer]()
+                {
+                    if (player.IsPlaying())
+                    {
+                        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(1));
+                    }
+                    else
+                    {
+                        eventLoop.Stop();
+                    }
+                });
+
+                player.Play(timeline);
+                eventLoop.ArmTimer(pollTimer, timeline->duration);
+                eventLoop.Run();
+                eventLoop.DestroyTimer(pollTimer);
+                Collect(*timeline, gpio, run.errors);
+            }
+
+            rusage after;
+            getrusage(RUSAGE_THREAD, &after);
+            run.minorFaults = after.ru_minflt - before.ru_minflt;
+            run.majorFaults = after.ru_majflt - before.ru_majflt;
+        });
+        ringThread.join();
+        return run;
+    }
+
+    void Report(char const* name, Run run)
+    {
+        if (run.errors.empty())
+        {
+            std::cout << name << ": no edges" << std::endl;
+            return;
+        }
+
+        std::sort(run.errors.begin(), run.errors.end());
+        auto const percentile = [&run](double const fraction)
+        {
+            size_t const index = std::min(run.errors.size() - 1, static_cast<size_t>(fraction * run.errors.size()));
+            return std::chrono::duration<double, std::micro>(run.errors[index]).count();
+        };
+
+        std::cout << name << ": " << run.errors.size() << " edges, error p50 " << percentile(0.5) << " us, p99 "
+            << percentile(0.99) << " us, max " << std::chrono::duration<double, std::micro>(run.errors.back()).count()
+            << " us; " << run.minorFaults << " minor and " << run.majorFaults << " major page faults" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string const specification = argc > 1 ? argv[1] : "[[H20 L20]x5 W100]x4";
+    int const repeats = argc > 2 ? atoi(argv[2]) : 5;
+    size_t const cpuHogs = argc > 3 ? strtoul(argv[3], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+    size_t const memoryMegabytes = argc > 4 ? strtoul(argv[4], nullptr, 10) : 64;
+    int const priority = argc > 5 ? atoi(argv[5]) : 50;
+
+    Rings::Pattern pattern;
+    if (!Rings::Parse(specification, pattern))
+    {
+        std::cerr << "Invalid pattern '" << specification << "'" << std::endl;
+        return 1;
+    }
+    std::shared_ptr<Rings::Timeline const> const timeline = Rings::Compile(pattern);
+    if (timeline->edges.empty())
+    {
+        std::cerr << "Pattern has no edges" << std::endl;
+        return 1;
+    }
+
+    // The stress is other processes, so it isn't moved off the ring thread's core along with this one's threads
+    std::vector<pid_t> stress;
+    for (size_t hog = 0; hog < cpuHogs; ++hog)
+    {
+        stress.push_back(StartCpuHog());
+    }
+    if (memoryMegabytes > 0)
+    {
+        stress.push_back(StartMemoryChurn(memoryMegabytes));
+    }
+
+    Log::Start();
+
+    std::cout << "pattern '" << specification << "', " << std::chrono::duration<double>(timeline->duration).count() << " s per ring, "
+        << repeats << " rings, under " << cpuHogs << " cpu hogs and " << memoryMegabytes << " MB of memory churn" << std::endl;
+    Report("normal scheduling", PlayRepeatedly(timeline, repeats, RealTime::ThreadPolicy()));
+
+    // As the daemon sets up real-time mode
+    RealTime::ThreadPolicy policy;
+    policy.priority = priority;
+    policy.cpu = RealTime::LastCpu();
+    bool const locked = RealTime::LockMemory(4 * 1024 * 1024);
+    RealTime::KeepOffCpu(policy.cpu);
+    Run const realTime = PlayRepeatedly(timeline, repeats, policy);
+    std::cout << "real-time mode: memory " << (locked ? "locked" : "not locked") << ", ring thread "
+        << (realTime.realTime ? "under SCHED_FIFO priority " + std::to_string(priority) + " on core " + std::to_string(policy.cpu) : std::string("not real-time (no privileges?)"))
+        << std::endl;
+    Report("real-time mode", realTime);
+
+    for (pid_t const processId : stress)
+    {
+        if (processId > 0)
+        {
+            kill(processId, SIGKILL);
+            waitpid(processId, nullptr, 0);
+        }
+    }
+
+    Log::Stop();
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Measures how long Flic::Supervisor takes to get every button back when flicd goes away: from the fake flicd
+// dropping the connection, from it being killed and restarted after a range of downtimes, from it removing every
+// connection channel while keeping the connection up, and from it hanging with the connection open, which only the
+// pings notice. Recovery is when the fake has seen all of the channels created again. Exits non-zero if any of them
+// don't recover.
+// Usage: ReconnectBenchmark [buttons] [repeats] [ping interval ms]
+
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../FlicSupervisor.h"
+#include "../tools/FakeFlicd.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    void Report(std::string const& name, std::vector<std::chrono::nanoseconds> durations, size_t const repeats)
+    {
+        if (durations.empty())
+        {
+            std::cout << name << ": no recoveries" << std::endl;
+            return;
+        }
+
+        std::sort(durations.begin(), durations.end());
+        auto const percentile = [&durations](double const fraction)
+        {
+            size_t const index = std::min(durations.size() - 1, static_cast<size_t>(fraction * durations.size()));
+            return std::chrono::duration<double, std::milli>(durations[index]).count();
+        };
+
+        std::cout << name << ": " << durations.size() << "/" << repeats << " recovered, p50 " << percentile(0.5) << " ms, p99 "
+            << percentile(0.99) << " ms, max " << std::chrono::duration<double, std::milli>(durations.back()).count() << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t const buttonCount = argc > 1 ? static_cast<uint32_t>(strtoul(argv[1], nullptr, 10)) : 10;
+    size_t const repeats = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+    std::chrono::milliseconds const pingInterval(argc > 3 ? strtoul(argv[3], nullptr, 10) : 100);
+    uint32_t const c_MaxMissedPings = 3;
+
+    FakeFlicd fake;
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+    uint16_t const port = fake.Port();
+
+    EventLoop eventLoop;
+    Flic::Connection connection(eventLoop);
+    for (uint32_t buttonIndex = 0; buttonIndex < buttonCount; ++buttonIndex)
+    {
+        uint8_t address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, 0, 0, 0, 0x80 };
+        address[2] = static_cast<uint8_t>(buttonIndex);
+        address[3] = static_cast<uint8_t>(buttonIndex >> 8);
+        connection.AddChannel(buttonIndex + 1, Flic::ButtonAddress(address));
+    }
+    connection.SetLivenessCheck(pingInterval, c_MaxMissedPings);
+
+    // The default policy, except that the connections here only need to last a moment to count as stable; each
+    // repeat waits longer than that before breaking the connection again
+    Flic::Supervisor::Policy policy;
+    policy.stableTime = std::chrono::milliseconds(50);
+    std::chrono::milliseconds const c_Settle = std::chrono::milliseconds(100);
+
+    Flic::Supervisor supervisor(eventLoop, connection, "127.0.0.1", port, policy);
+    if (!supervisor.Start(Flic::Connection::RingHandler()))
+    {
+        std::cerr << "Failed to start the supervisor" << std::endl;
+        return 1;
+    }
+
+    std::atomic<bool> finished{ false };
+    bool failed = false;
+    std::thread driver([&]()
+    {
+        auto const measure = [&](std::string const& name, std::function<std::chrono::steady_clock::time_point()> breakFlicd)
+        {
+            std::vector<std::chrono::nanoseconds> durations;
+            for (size_t repeat = 0; repeat < repeats; ++repeat)
+            {
+                if (!fake.WaitForChannels(buttonCount, std::chrono::seconds(10)))
+                {
+                    failed = true;
+                    break;
+                }
+                std::this_thread::sleep_for(c_Settle);
+
+                auto const broken = breakFlicd();
+                if (!fake.WaitForChannels(buttonCount, std::chrono::seconds(60)))
+                {
+                    failed = true;
+                    break;
+                }
+                durations.push_back(std::chrono::steady_clock::now() - broken);
+            }
+            Report(name, durations, repeats);
+        };
+
+        measure("connection dropped", [&]()
+        {
+            auto const dropped = std::chrono::steady_clock::now();
+            fake.DropClient();
+            return dropped;
+        });
+
+        for (std::chrono::milliseconds const downtime : { std::chrono::milliseconds(0), std::chrono::milliseconds(100), std::chrono::milliseconds(1000) })
+        {
+            // Timed from the restart, as the downtime itself can't be recovered from any faster
+            measure("killed, restarted after " + std::to_string(downtime.count()) + " ms", [&]()
+            {
+                fake.Stop();
+                std::this_thread::sleep_for(downtime);
+                auto const restarted = std::chrono::steady_clock::now();
+                if (!fake.Start(port))
+                {
+                    std::cerr << "Failed to restart the fake flicd on port " << port << std::endl;
+                }
+                return restarted;
+            });
+        }
+
+        measure("channels removed", [&]()
+        {
+            auto const removed = std::chrono::steady_clock::now();
+            fake.RemoveChannels(FlicClientProtocol::ForceDisconnectedByOtherClient);
+            return removed;
+        });
+
+        measure("hung, pinged every " + std::to_string(pingInterval.count()) + " ms", [&]()
+        {
+            auto const hung = std::chrono::steady_clock::now();
+            fake.HangClient();
+            return hung;
+        });
+
+        finished = true;
+    });
+
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if (finished)
+        {
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(5));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(5));
+    eventLoop.Run();
+    driver.join();
+    supervisor.Stop();
+
+    std::cout << buttonCount << " buttons" << std::endl;
+    return failed ? 1 : 0;
+}
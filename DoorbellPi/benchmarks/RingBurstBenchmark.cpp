@@ -0,0 +1,151 @@
+// Mashes several buttons at once: a fake flicd sends bursts of thousands of presses, spread across the buttons with
+// no gap between them, through Flic::Connection into the Doorbell. However many presses arrive, each button should
+// ring once per burst, plus one escalation if it has an escalation pattern, and the queue between the event loop and
+// the ring thread should never hold more than one entry per button. Exits non-zero if either doesn't hold.
+// Usage: RingBurstBenchmark [buttons] [bursts] [presses per burst]
+
+#include "../Doorbell.h"
+#include "../EventLoop.h"
+#include "../FlicConnection.h"
+#include "../GpioMock.h"
+#include "../Log.h"
+#include "../Metrics.h"
+#include "../tools/FakeFlicd.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    size_t const buttons = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+    size_t const bursts = argc > 2 ? strtoul(argv[2], nullptr, 10) : 5;
+    size_t const pressesPerBurst = argc > 3 ? strtoul(argv[3], nullptr, 10) : 5000;
+    std::chrono::milliseconds const c_RingDuration = std::chrono::milliseconds(50);
+    std::chrono::milliseconds const c_Cooldown = std::chrono::milliseconds(300);
+
+    Log::Start();
+
+    FakeFlicd fake;
+    if (!fake.Start(0))
+    {
+        std::cerr << "Failed to start the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // Every button has an output of its own, and every other one escalates
+    EventLoop eventLoop;
+    Gpio::MockBackend gpio;
+    std::vector<int> outputPins;
+    for (size_t button = 0; button < buttons; ++button)
+    {
+        outputPins.push_back(static_cast<int>(button + 2));
+    }
+    gpio.RequestOutputs(outputPins);
+
+    Doorbell doorbell(gpio);
+    Flic::Connection connection(eventLoop);
+    size_t escalatingButtons = 0;
+    for (size_t button = 0; button < buttons; ++button)
+    {
+        uint8_t const address[Flic::ButtonAddress::c_AddressLength] = { 0x40, 0xBF, static_cast<uint8_t>(button), 0, 0, 0x80 };
+        ButtonAction action{ { outputPins[button] }, Rings::Compile(Rings::Once(c_RingDuration)), c_Cooldown };
+        if (button % 2 == 0)
+        {
+            action.escalation = Rings::Compile(Rings::Once(c_RingDuration));
+            ++escalatingButtons;
+        }
+
+        Flic::ConnectionId const connectionId = doorbell.AddButton(Flic::ButtonAddress(address), std::move(action));
+        connection.AddChannel(connectionId, Flic::ButtonAddress(address));
+    }
+    doorbell.Start();
+
+    size_t pressesSeen = 0;
+    auto const onRing = [&](Flic::ConnectionId connectionId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)
+    {
+        doorbell.OnPress(connectionId, readableTime, timeDiff);
+        ++pressesSeen;
+    };
+
+    if (!connection.Connect("127.0.0.1", fake.Port(), onRing, [&eventLoop]() { eventLoop.Stop(); })
+        || !fake.WaitForChannels(buttons, std::chrono::seconds(5)))
+    {
+        std::cerr << "Failed to connect to the fake flicd" << std::endl;
+        return 1;
+    }
+
+    // The presses in a burst go round the buttons, each a down and an up
+    FakeFlicd::Script script;
+    for (size_t press = 0; press < pressesPerBurst; ++press)
+    {
+        script.push_back(FakeFlicd::ScriptEvent{ std::chrono::microseconds(0), press % buttons, FlicClientProtocol::ButtonDown, 0 });
+        script.push_back(FakeFlicd::ScriptEvent{ std::chrono::microseconds(0), press % buttons, FlicClientProtocol::ButtonUp, 0 });
+    }
+
+    std::atomic<bool> finished{ false };
+    bool failed = false;
+    std::vector<std::chrono::nanoseconds> burstTimes;
+    std::thread driver([&]()
+    {
+        for (size_t burst = 0; burst < bursts; ++burst)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            fake.Play(script);
+            if (!fake.WaitForScript(std::chrono::seconds(60)))
+            {
+                failed = true;
+                break;
+            }
+            burstTimes.push_back(std::chrono::steady_clock::now() - start);
+
+            // Long enough for the ring, its escalation and the cooldown, so the next burst starts afresh
+            std::this_thread::sleep_for(c_Cooldown + 3 * c_RingDuration);
+        }
+        finished = true;
+    });
+
+    int pollTimer = EventLoop::c_InvalidHandle;
+    pollTimer = eventLoop.CreateTimer([&]()
+    {
+        if (finished)
+        {
+            eventLoop.Stop();
+            return;
+        }
+        eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    });
+    eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(10));
+    eventLoop.Run();
+    eventLoop.DestroyTimer(pollTimer);
+    driver.join();
+    doorbell.Stop();
+
+    Metrics::Daemon const& metrics = Metrics::Global();
+    uint64_t const rings = metrics.rings.Value();
+    uint64_t const escalations = metrics.ringsEscalated.Value();
+    uint64_t const folded = metrics.pressesBusy.Value() + metrics.pressesCooldown.Value();
+    uint64_t const expectedRings = buttons * bursts;
+    uint64_t const expectedEscalations = escalatingButtons * bursts;
+
+    std::cout << buttons << " buttons, " << bursts << " bursts of " << pressesPerBurst << " presses, " << pressesSeen << " seen" << std::endl;
+    for (size_t burst = 0; burst < burstTimes.size(); ++burst)
+    {
+        std::cout << "  burst " << burst << " sent in " << std::chrono::duration<double, std::milli>(burstTimes[burst]).count() << " ms" << std::endl;
+    }
+    std::cout << rings << " rings (expected " << expectedRings << "), " << escalations << " escalations (expected "
+        << expectedEscalations << "), " << folded << " presses folded into them" << std::endl;
+    std::cout << "max queue depth " << doorbell.MaxQueueDepth() << " (at most " << buttons << ")" << std::endl;
+
+    Log::Stop();
+    bool const passed = !failed
+        && pressesSeen == bursts * pressesPerBurst
+        && rings == expectedRings
+        && escalations == expectedEscalations
+        && rings + folded == pressesSeen
+        && doorbell.MaxQueueDepth() <= buttons;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Plays a ring pattern against the mock GPIO backend and reports how far each edge landed from where the pattern
+// says it should be (p50/p99/max), for the original relative sleep_for playback and for Rings::Player's absolute
+// deadlines. Usage: RingTimingBenchmark [pattern] [repeats]
+
+#include "../EventLoop.h"
+#include "../GpioMock.h"
+#include "../Rings.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // The original playback: write, then sleep_for each step's duration
+    void PlayRelative(Rings::Pattern const& pattern, Gpio::Backend& gpio)
+    {
+        for (Rings::Step const& step : pattern)
+        {
+            if (step.output != Rings::Output::Unchanged)
+            {
+                gpio.SetLines(1, step.output == Rings::Output::High ? 1 : 0);
+            }
+            std::this_thread::sleep_for(step.duration);
+        }
+    }
+
+    void PlayDeadlines(std::shared_ptr<Rings::Timeline const> const& timeline, Gpio::Backend& gpio)
+    {
+        EventLoop eventLoop;
+        Rings::Player player(eventLoop, gpio, 1);
+
+        // Stop once the ring is over
+        int pollTimer = EventLoop::c_InvalidHandle;
+        pollTimer = eventLoop.CreateTimer([&eventLoop, &player, &pollTimer]()
+        {
+            if (player.IsPlaying())
+            {
+                eventLoop.ArmTimer(pollTimer, std::chrono::milliseconds(1));
+            }
+            else
+            {
+                eventLoop.Stop();
+            }
+        });
+
+        player.Play(timeline);
+        eventLoop.ArmTimer(pollTimer, timeline->duration);
+        eventLoop.Run();
+        eventLoop.DestroyTimer(pollTimer);
+    }
+
+    void Report(char const* name, std::vector<std::chrono::nanoseconds> errors)
+    {
+        if (errors.empty())
+        {
+            std::cout << name << ": no edges" << std::endl;
+            return;
+        }
+
+        std::sort(errors.begin(), errors.end());
+        auto const percentile = [&errors](double const fraction)
+        {
+            size_t const index = std::min(errors.size() - 1, static_cast<size_t>(fraction * errors.size()));
+            return std::chrono::duration<double, std::micro>(errors[index]).count();
+        };
+
+        std::cout << name << ": " << errors.size() << " edges, error p50 " << percentile(0.5) << " us, p99 "
+            << percentile(0.99) << " us, max " << std::chrono::duration<double, std::micro>(errors.back()).count() << " us" << std::endl;
+    }
+
+    // Each recorded edge against its offset in the timeline, measured from the first edge
+    void Collect(Rings::Timeline const& timeline, Gpio::MockBackend const& gpio, std::vector<std::chrono::nanoseconds>& errors)
+    {
+        std::vector<Gpio::MockBackend::Edge> const edges = gpio.Edges();
+        if (edges.empty())
+        {
+            return;
+        }
+
+        auto const startTime = edges.front().time;
+        for (size_t edgeIndex = 0; edgeIndex < timeline.edges.size() && edgeIndex < edges.size(); ++edgeIndex)
+        {
+            auto const ideal = startTime + (timeline.edges[edgeIndex].offset - timeline.edges.front().offset);
+            errors.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(edges[edgeIndex].time - ideal));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string const specification = argc > 1 ? argv[1] : "[[H20 L20]x5 W500]x2";
+    int const repeats = argc > 2 ? atoi(argv[2]) : 3;
+
+    Rings::Pattern pattern;
+    if (!Rings::Parse(specification, pattern))
+    {
+        std::cerr << "Invalid pattern '" << specification << "'" << std::endl;
+        return 1;
+    }
+    std::shared_ptr<Rings::Timeline const> const timeline = Rings::Compile(pattern);
+    if (timeline->edges.empty())
+    {
+        std::cerr << "Pattern has no edges" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::chrono::nanoseconds> relativeErrors;
+    std::vector<std::chrono::nanoseconds> deadlineErrors;
+    for (int repeat = 0; repeat < repeats; ++repeat)
+    {
+        Gpio::MockBackend relativeGpio;
+        relativeGpio.RequestOutputs({ 23 });
+        PlayRelative(pattern, relativeGpio);
+        Collect(*timeline, relativeGpio, relativeErrors);
+
+        Gpio::MockBackend deadlineGpio;
+        deadlineGpio.RequestOutputs({ 23 });
+        PlayDeadlines(timeline, deadlineGpio);
+        Collect(*timeline, deadlineGpio, deadlineErrors);
+    }
+
+    std::cout << "pattern '" << specification << "', " << std::chrono::duration<double>(timeline->duration).count() << " s per ring" << std::endl;
+    Report("relative sleep_for", relativeErrors);
+    Report("absolute deadlines", deadlineErrors);
+
+    return 0;
+}
@@ -1,317 +1,38 @@
-//#include <curl/curl.h>
-#include <wiringPi.h>
-
 #include <chrono>
+#include <algorithm>
+#include <functional>
 #include <iostream>
-#include <memory>
-#include <netdb.h>
-#include <thread>
 #include <signal.h>
 #include <string.h>
 #include <syslog.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-#include "external/flic/client_protocol_packets.h"
-
-static bool s_RunProgram = true;
-
-void exitHandler(int s)
-{
-    switch (s)
-    {
-    case SIGHUP:
-    {
-        break;
-    }
-    default:
-    {
-        syslog(LOG_NOTICE, "Handling signal %d by exiting", s);
-        s_RunProgram = false;
-        break;
-    }
-    }
-}
-
-namespace Rings
-{
-    void Once(int const outputPin, std::chrono::milliseconds const strikeDuration)
-    {
-        digitalWrite(outputPin, HIGH);
-        std::this_thread::sleep_for(strikeDuration);
-
-        digitalWrite(outputPin, LOW);
-        std::this_thread::sleep_for(strikeDuration);
-    }
-
-    void Classic(int const outputPin, std::chrono::milliseconds const strikeDuration)
-    {
-        for (int externalCounter = 0; externalCounter < 2; ++externalCounter)
-        {
-            for (int counter = 0; counter < 2; ++counter)
-            {
-                for (int internalCounter = 0; internalCounter < 5; ++internalCounter)
-                {
-                    Once(outputPin, strikeDuration);
-                }
-
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            }
-
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-        }
-    }
-}
-
-namespace Flic
-{
-    struct ButtonAddress 
-    {
-        static int const c_AddressLength = 6;
-        uint8_t addr[c_AddressLength];
-
-        ButtonAddress() 
-        {
-            memset(addr, 0, c_AddressLength);
-        }
-
-        ButtonAddress(const ButtonAddress& o) 
-        {
-            *this = o;
-        }
-
-        ButtonAddress(const uint8_t* a) 
-        {
-            *this = a;
-        }
-
-        ButtonAddress& operator=(const ButtonAddress& o) 
-        {
-            memcpy(addr, o.addr, c_AddressLength);
-            return *this;
-        }
-        ButtonAddress& operator=(const uint8_t* a) 
-        {
-            memcpy(addr, a, c_AddressLength);
-            return *this;
-        }
-
-        bool operator==(const ButtonAddress& o) const { return memcmp(addr, o.addr, c_AddressLength) == 0; }
-        bool operator!=(const ButtonAddress& o) const { return memcmp(addr, o.addr, c_AddressLength) != 0; }
-    };
-
-    class Connection
-    {
-    public:
-        int const c_InvalidHandle = -1;
-
-        bool Connect(std::string const& hostname, in_port_t const port, ButtonAddress const& buttonAddress)
-        {
-            m_SocketHandle = socket(AF_INET, SOCK_STREAM, 0);
-            if (m_SocketHandle < 0)
-            {
-                syslog(LOG_NOTICE, "Failed to create socket");
-                m_SocketHandle = c_InvalidHandle;
-                return false;
-            }
-
-            hostent const* serverHostEnt = gethostbyname(hostname.c_str());
-            if (serverHostEnt == NULL)
-            {
-                syslog(LOG_NOTICE, "Failed to resolve '%s' [%d]", hostname.c_str(), errno);
-                Disconnect();
-                return false;
-            }
-
-            sockaddr_in serverAddress;
-            memset(&serverAddress, 0, sizeof(serverAddress));
-            serverAddress.sin_family = AF_INET;
-            memcpy(&serverAddress.sin_addr.s_addr, serverHostEnt->h_addr, serverHostEnt->h_length);
-            serverAddress.sin_port = htons(port);
-
-            if (connect(m_SocketHandle, (struct sockaddr*)&serverAddress, sizeof(serverAddress)) < 0)
-            {
-                syslog(LOG_NOTICE, "Failed to connect to '%s:%d' [%s]", hostname.c_str(), port, GetErrorCodeString().c_str());
-                Disconnect();
-                return false;
-            }
-
-            syslog(LOG_NOTICE, "Connected to '%s:%d'", hostname.c_str(), port);
-
-            FlicClientProtocol::CmdCreateConnectionChannel cmd;
-            memcpy(cmd.bd_addr, buttonAddress.addr, ButtonAddress::c_AddressLength);
-            cmd.conn_id = m_ConnectionId;
-            cmd.latency_mode = FlicClientProtocol::NormalLatency;
-            cmd.auto_disconnect_time = 5;
-            if (!WritePacket(reinterpret_cast<uint8_t const*>(&cmd), sizeof(cmd)))
-            {
-                syslog(LOG_NOTICE, "Error %d sending CmdCreateConnectionChannel'", errno);
-                Disconnect();
-                return false;
-            }
-
-            return true;
-        }
-
-        bool IsConnected() const
-        {
-            return m_SocketHandle != c_InvalidHandle;
-        }
-
-        void Disconnect()
-        {
-            if (m_SocketHandle != c_InvalidHandle)
-            {
-                FlicClientProtocol::CmdRemoveConnectionChannel cmd;
-                cmd.conn_id = m_ConnectionId;
-                WritePacket(reinterpret_cast<uint8_t const*>(&cmd), sizeof(cmd));
-
-                close(m_SocketHandle);
-                m_SocketHandle = c_InvalidHandle;
-            }
-        }
-
-        bool WaitForRing()
-        {
-            unsigned char lengthBuffer[2];
-            int bytesInLengthBuffer = 0;
-            while (true)
-            {
-                int nbytes = read(m_SocketHandle, lengthBuffer + bytesInLengthBuffer, 2 - bytesInLengthBuffer);
-                if (nbytes < 0) 
-                {
-                    syslog(LOG_NOTICE, "Error %d reading from socket'", errno);
-                    Disconnect();
-                    return false;
-                }
-
-                // Wait until we have two bytes, which should be the length
-                bytesInLengthBuffer += nbytes;
-                if (bytesInLengthBuffer != 2)
-                {
-                    continue;
-                }
-                bytesInLengthBuffer = 0;
-
-                // Read the specified amount of data into a temporary buffer
-                int const packetLength = lengthBuffer[0] | (lengthBuffer[1] << 8);
-                std::unique_ptr<unsigned char[]> readBuffer = std::make_unique<unsigned char[]>(packetLength);
-                int readPosition = 0;
-                int bytesLeft = packetLength;
-                syslog(LOG_NOTICE, "Recieved packet header of %d bytes from socket'", packetLength);
-
-                while (bytesLeft > 0)
-                {
-                    nbytes = read(m_SocketHandle, readBuffer.get() + readPosition, bytesLeft);
-                    if (nbytes < 0) 
-                    {
-                        syslog(LOG_NOTICE, "Error %d reading from socket'", errno);
-                        Disconnect();
-                        return false;
-                    }
-
-                    readPosition += nbytes;
-                    bytesLeft -= nbytes;
-                }
-
-                uint8_t const opCode = *static_cast<uint8_t const*>(readBuffer.get());
-                syslog(LOG_NOTICE, "Got a message of type %d from socket'", opCode);
-
-                switch(opCode)
-                {
-                    case EVT_BUTTON_UP_OR_DOWN_OPCODE:
-                    {
-                        auto eventData = reinterpret_cast<FlicClientProtocol::EvtButtonEvent const*>(readBuffer.get());
-                        if (eventData->time_diff < 10 && eventData->click_type == FlicClientProtocol::ButtonDown)
-                        {
-                            syslog(LOG_NOTICE, "Saw a button click event of click type %d", eventData->click_type);
-                            return true;
-                        }
-                        else
-                        {
-                            syslog(LOG_NOTICE, "Saw a button click event, but it was %d seconds old and a click type of %d'", eventData->time_diff, eventData->click_type);
-                        }
-                        break;
-                    }
-                    case EVT_BUTTON_CLICK_OR_HOLD_OPCODE:
-                    case EVT_BUTTON_SINGLE_OR_DOUBLE_CLICK_OPCODE:
-                    case EVT_BUTTON_SINGLE_OR_DOUBLE_CLICK_OR_HOLD_OPCODE:
-                    {
-                        // Ignore the other button op codes. We just care about up/down events
-                        break;
-                    }
-                    default:
-                    {
-                        // Ignored
-                        break;
-                    }
-                }
-            }
-        }
-
-    private:
-        bool WritePacket(uint8_t const* buf, int len)
-        {
-            uint8_t const lengthPrefix[2] = { static_cast<uint8_t>(len & 0xff), static_cast<uint8_t>(len >> 8) };
-            if (WriteBuffer(lengthPrefix, 2))
-            {
-                return WriteBuffer(buf, len);
-            }
-            else
-            {
-                return false;
-            }
-        }
-
-        bool WriteBuffer(uint8_t const* buf, int len)
-        {
-            int pos = 0;
-            int left = len;
-            while (left) 
-            {
-                int res = write(m_SocketHandle, buf + pos, left);
-                if (res < 0) 
-                {
-                    if (errno == EINTR) 
-                    {
-                        return false;
-                    }
-                }
-                pos += res;
-                left -= res;
-            }
-
-            return true;
-        }
-
-        std::string GetErrorCodeString() const
-        {
-            int const errorCode = errno;
-            char const* errorMessage = strerror(errorCode);
-            return std::string(errorMessage);
-        }
-
-        int m_SocketHandle = c_InvalidHandle;
-        int const m_ConnectionId = 1;
-    };
-}
+#include "CloudNotifier.h"
+#include "Config.h"
+#include "Doorbell.h"
+#include "EventLoop.h"
+#include "FlicConnection.h"
+#include "FlicLatencyPolicy.h"
+#include "FlicSupervisor.h"
+#include "Gpio.h"
+#ifdef DOORBELLPI_MOCK_GPIO
+#include "GpioMock.h"
+#else
+#include "GpioCharacterDevice.h"
+#endif
+#include "Journal.h"
+#include "Log.h"
+#include "MetricsEndpoint.h"
+#include "RealTime.h"
 
 int main()
 {
-    // #ToDo: Read these inputs from a config file
-    int const c_OutputPin = 23;
     //std::chrono::milliseconds const c_MinimumTriggerDuration = std::chrono::milliseconds(200);
-    std::chrono::milliseconds const c_OutputDuration = std::chrono::milliseconds(20);
-    std::string const c_CloudServiceUrl = "http://192.168.0.17:8888";
-    std::string const c_FlicdHost = "localhost";
-    int const c_FlicdPort = 5551;
-    // Remember: the display order is big endian but the address needs to be little endian
-    uint8_t const c_ButtonAddressArray[] = { 0x40, 0xBF, 0x73, 0xDA, 0xE4, 0x80 };
-    Flic::ButtonAddress const c_ButtonAddress(c_ButtonAddressArray);
-    //bool const c_VerboseLibcurl = false;
+    std::string const c_SettingsPath = "/etc/doorbellpi/doorbellpi.conf";
+    // Heap faulted in up front in real-time mode, well beyond what the daemon allocates once running
+    size_t const c_RealTimeHeapReserve = 4 * 1024 * 1024;
 
     // Fork, so that the parent process can exit
     pid_t const processId = fork();
@@ -326,10 +47,11 @@ int main()
         return 0;
     }
 
-    // Start logging to syslog
-    setlogmask(LOG_UPTO(LOG_NOTICE));
+    // Start logging to syslog. The level is applied by Log rather than syslog so that it can be changed at runtime
+    setlogmask(LOG_UPTO(LOG_DEBUG));
+    Log::SetLevel(LOG_NOTICE);
     openlog("DoorbellPi", LOG_CONS | LOG_PID | LOG_NDELAY, LOG_DAEMON);
-    syslog(LOG_NOTICE, "Starting DoorbellPi daemon with process id %d", getpid());
+    DOORBELLPI_LOG(LOG_NOTICE, "Starting DoorbellPi daemon with process id %d", getpid());
 
     // Only the forked child process will reach this point. Finalise our environment
     umask(0);
@@ -337,14 +59,14 @@ int main()
     pid_t const signatureId = setsid();
     if (signatureId < 0)
     {
-        syslog(LOG_ERR, "Child process failed to change signature id");
+        DOORBELLPI_LOG(LOG_ERR, "Child process failed to change signature id");
         return -1;
     }
 
     int changeWorkingDirectoryResult = chdir("/");
     if (changeWorkingDirectoryResult < 0)
     {
-        syslog(LOG_ERR, "Child process failed to change working directory");
+        DOORBELLPI_LOG(LOG_ERR, "Child process failed to change working directory");
         return -1;
     }
 
@@ -352,94 +74,203 @@ int main()
     close(STDOUT_FILENO);
     close(STDERR_FILENO);
 
-    // Register to handle the "exit" signal
-    struct sigaction signalInteruptHandler;
+    // All signals are delivered through the event loop, so this must happen before any threads are created
+    EventLoop eventLoop;
+    if (!eventLoop.IsValid())
+    {
+        return -1;
+    }
 
-    signalInteruptHandler.sa_handler = exitHandler;
-    sigemptyset(&signalInteruptHandler.sa_mask);
-    signalInteruptHandler.sa_flags = 0;
+    // Set once everything it reconfigures exists
+    std::function<void()> reloadSettings;
+    eventLoop.HandleSignals({ SIGINT, SIGTERM, SIGHUP, SIGUSR1 }, [&eventLoop, &reloadSettings](int signalNumber)
+    {
+        switch (signalNumber)
+        {
+        case SIGHUP:
+        {
+            if (reloadSettings)
+            {
+                reloadSettings();
+            }
+            break;
+        }
+        case SIGUSR1:
+        {
+            // Toggles debug logging, which includes every packet from flicd
+            Log::SetLevel(Log::GetLevel() == LOG_DEBUG ? LOG_NOTICE : LOG_DEBUG);
+            DOORBELLPI_LOG(LOG_NOTICE, "Log level is now %d", Log::GetLevel());
+            break;
+        }
+        default:
+        {
+            DOORBELLPI_LOG(LOG_NOTICE, "Handling signal %d by exiting", signalNumber);
+            eventLoop.Stop();
+            break;
+        }
+        }
+    });
 
-    sigaction(SIGINT, &signalInteruptHandler, NULL);
+    Config::Settings settings;
+    if (!Config::Load(c_SettingsPath, settings))
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Invalid settings, exiting");
+        return -1;
+    }
 
-#ifdef ENABLE_LIBCURL
-    // Setup libcurl
-    curl_global_init(CURL_GLOBAL_SSL);
-    
-    // Verify libcurl
-    auto const* libcurlVersionInfo = curl_version_info(CURLVERSION_NOW);
-    bool const libcurlHasSslSupport = libcurlVersionInfo->features & CURL_VERSION_SSL;
-    if (!libcurlHasSslSupport)
+    // Before any threads are started, so that their stacks are only locked as far as they're used, and they all
+    // start off the ring thread's core
+    RealTime::ThreadPolicy ringPolicy;
+    if (settings.realTime)
     {
-        std::cerr << "Libcurl does not have SSL support" << std::endl;
-        return 1;
+        ringPolicy.priority = settings.realTimePriority;
+        ringPolicy.cpu = settings.ringCpu >= 0 ? settings.ringCpu : RealTime::LastCpu();
+        Metrics::Global().memoryLocked.Set(RealTime::LockMemory(c_RealTimeHeapReserve) ? 1 : 0);
+        RealTime::KeepOffCpu(ringPolicy.cpu);
     }
 
-    std::cout << "SSL support verified: " << libcurlVersionInfo->ssl_version << std::endl;
+    // Formatting and sending log messages happens on a thread of its own, off the packet hot path
+    if (!Log::Start())
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start the logging thread, logging directly");
+    }
 
-    // Proof of concept: Make a GET request using libcurl
-    auto libcurlEasyHandle = curl_easy_init();
-    curl_easy_setopt(libcurlEasyHandle, CURLOPT_URL, c_CloudServiceUrl.c_str());
-#ifndef _DEBUG
-    if (c_VerboseLibcurl)
+    // Presses are passed to the cloud service from a thread of its own, so a slow or missing service can't delay
+    // a ring
+    Cloud::Notifier notifier(settings.cloudServiceUrl, settings.notificationSpoolPath);
+    if (!notifier.Start())
     {
-        curl_easy_setopt(libcurlEasyHandle, CURLOPT_VERBOSE, 1);
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start cloud notifications, presses will not be reported");
     }
+
+    // Setup GPIO pins. Every output is claimed once, up front
+#ifdef DOORBELLPI_MOCK_GPIO
+    Gpio::MockBackend gpio;
+#else
+    Gpio::CharacterDeviceBackend gpio(settings.gpioChipPath);
 #endif
+    std::vector<int> outputPins;
+    for (Config::Button const& button : settings.buttons)
+    {
+        for (int const outputPin : button.outputPins)
+        {
+            if (std::find(outputPins.begin(), outputPins.end(), outputPin) == outputPins.end())
+            {
+                outputPins.push_back(outputPin);
+            }
+        }
+    }
+
+    if (!gpio.RequestOutputs(outputPins))
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to initialise GPIO");
+        return -1;
+    }
 
-    /*auto libcurlRegisterOutcome = curl_easy_perform(libcurlEasyHandle);
-    std::cout << std::endl;
+    // Written by the ring thread, so it has to outlive the Doorbell
+    Journal::Writer journal;
+    if (!settings.journalPath.empty() && !journal.Open(settings.journalPath, settings.journalRecords, settings.journalFiles))
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to open the press journal, carrying on without it");
+    }
+
+    Doorbell doorbell(gpio);
+    doorbell.SetJournal(journal.IsOpen() ? &journal : nullptr);
+    doorbell.SetRealTime(ringPolicy);
+    doorbell.SetRingHandler([&notifier](Flic::ButtonAddress const& buttonAddress)
+    {
+        notifier.Notify(buttonAddress);
+    });
+    Flic::Connection connection(eventLoop);
+    connection.SetLivenessCheck(settings.flicdPingInterval, settings.flicdMaxMissedPings);
+    Flic::LatencyPolicy latencyPolicy(eventLoop, connection, settings.latencySchedule);
+    std::unordered_map<Flic::ButtonAddress, ButtonAction> actions = Config::ButtonActions(settings);
+    for (Config::Button const& button : settings.buttons)
+    {
+        Flic::ConnectionId const connectionId = doorbell.AddButton(button.address, std::move(actions.at(button.address)));
+        if (connectionId != Flic::c_InvalidConnectionId)
+        {
+            connection.AddChannel(connectionId, button.address);
+            latencyPolicy.AddButton(connectionId, button.latency);
+        }
+    }
+
+    auto const onRing = [&doorbell, &latencyPolicy](Flic::ConnectionId connectionId, std::chrono::steady_clock::time_point readableTime, uint32_t timeDiff)
+    {
+        doorbell.OnPress(connectionId, readableTime, timeDiff);
+        latencyPolicy.OnActivity(connectionId);
+    };
 
-    if (libcurlRegisterOutcome != CURLE_OK)
+    Metrics::Endpoint metricsEndpoint(eventLoop, Metrics::Global());
+    if (!metricsEndpoint.Listen(settings.metricsSocketPath))
     {
-        std::cerr << "Failed to register with cloud service" << std::endl;
-        return 1;
-    }*/
-#endif // ENABLE_LIBCURL
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start the metrics endpoint, carrying on without it");
+    }
 
-    // Setup wiringPi for GPIO access. We need to be root so we can set the pull up/down state
-    wiringPiSetupGpio();
+    // Rings are played on a thread of their own, which like the rest has to start after the signals are blocked
+    if (!doorbell.Start())
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start the ring thread");
+        return -1;
+    }
 
-    // Setup GPIO pins
-    pinMode(c_OutputPin, OUTPUT);
+    // Started first, so the channels are created in the right mode
+    if (!latencyPolicy.Start())
+    {
+        DOORBELLPI_LOG(LOG_ERR, "Failed to start the latency policy, buttons will stay in normal latency");
+    }
 
-    // Connect to flic deamon
-    Flic::Connection doorbell;
-    if(doorbell.Connect(c_FlicdHost, c_FlicdPort, c_ButtonAddress))
+    // On SIGHUP, or when the settings or ring patterns change, a whole new set of settings is loaded and checked,
+    // then swapped in. Anything invalid, or that would need a restart, leaves the running settings as they are; the
+    // connection to flicd and any ring in progress carry on regardless
+    Config::Watcher settingsWatcher(eventLoop);
+    reloadSettings = [&]()
     {
-        while (doorbell.IsConnected())
+        Config::Settings loaded;
+        if (!Config::Load(c_SettingsPath, loaded) || Config::NeedsRestart(settings, loaded) || !doorbell.Reconfigure(Config::ButtonActions(loaded)))
         {
-            bool ring = doorbell.WaitForRing();
-            if (!ring)
-            {
-                // No action required?
-            }
-            else
-            {
-                // #ToDo: Select ring based upon time of day/night
-                bool const doNightRing = false;
-                if(doNightRing)
-                {
-                    Rings::Once(c_OutputPin, c_OutputDuration);
-                }
-                else
-                {
-                    Rings::Classic(c_OutputPin, c_OutputDuration);
-                }
+            Metrics::Global().configReloadsRejected.Increment();
+            DOORBELLPI_LOG(LOG_ERR, "Keeping the running settings");
+            return;
+        }
 
-                // #ToDo: Notify cloud service of doorbell press
+        std::vector<std::pair<Flic::ConnectionId, Flic::LatencyPolicy::ButtonModes>> buttonModes;
+        for (Config::Button const& button : loaded.buttons)
+        {
+            buttonModes.emplace_back(doorbell.FindButton(button.address), button.latency);
+        }
+        latencyPolicy.Reconfigure(loaded.latencySchedule, buttonModes);
+        connection.SetLivenessCheck(loaded.flicdPingInterval, loaded.flicdMaxMissedPings);
 
-                // #ToDo: Ignore further rings for a short period
-            }
+        bool const patternsMoved = loaded.ringPatternsPath != settings.ringPatternsPath;
+        settings = std::move(loaded);
+        if (patternsMoved)
+        {
+            settingsWatcher.Watch({ c_SettingsPath, settings.ringPatternsPath }, reloadSettings);
         }
+        Metrics::Global().configReloads.Increment();
+        DOORBELLPI_LOG(LOG_NOTICE, "Reloaded the settings");
+    };
+    if (!settingsWatcher.Watch({ c_SettingsPath, settings.ringPatternsPath }, reloadSettings))
+    {
+        DOORBELLPI_LOG(LOG_NOTICE, "Not watching the settings for changes, they can still be reloaded with SIGHUP");
+    }
+
+    // Connect to flic deamon, and keep reconnecting to it until told to exit
+    Flic::Supervisor supervisor(eventLoop, connection, settings.flicdHost, settings.flicdPort);
+    if (supervisor.Start(onRing))
+    {
+        eventLoop.Run();
     }
+    supervisor.Stop();
+    latencyPolicy.Stop();
+    reloadSettings = nullptr;
 
-#ifdef ENABLE_LIBCURL
-    // Cleanup libcurl
-    syslog(LOG_NOTICE, "Cleaning up libcurl");
-    curl_global_cleanup();
-#endif // ENABLE_LIBCURL
+    doorbell.Stop();
+    notifier.Stop();
 
-    syslog(LOG_NOTICE, "Closing PowerPi.Monitor daemon");
+    DOORBELLPI_LOG(LOG_NOTICE, "Closing PowerPi.Monitor daemon");
+    Log::Stop();
     closelog();
 
     return 0;
@@ -0,0 +1,747 @@
+#include "FakeFlicd.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sstream>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+    // Scripted events stop being generated while this much is waiting to be written, so a client that can't keep up
+    // applies back pressure rather than the fake buffering without limit
+    size_t const c_MaxOutgoing = 64 * 1024;
+
+    bool ParseClickType(std::string const& text, FlicClientProtocol::ClickType& clickType)
+    {
+        if (text == "down") { clickType = FlicClientProtocol::ButtonDown; return true; }
+        if (text == "up") { clickType = FlicClientProtocol::ButtonUp; return true; }
+        if (text == "click") { clickType = FlicClientProtocol::ButtonClick; return true; }
+        if (text == "hold") { clickType = FlicClientProtocol::ButtonHold; return true; }
+        return false;
+    }
+}
+
+bool FakeFlicd::LoadScript(std::string const& path, Script& script)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        return false;
+    }
+
+    Script loaded;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        double delay = 0;
+        size_t channel = 0;
+        std::string click;
+        if (!(fields >> delay))
+        {
+            // Blank or comment only
+            continue;
+        }
+
+        ScriptEvent event = { std::chrono::microseconds(static_cast<int64_t>(delay * 1000)), 0, FlicClientProtocol::ButtonDown, 0 };
+        if (!(fields >> channel >> click) || !ParseClickType(click, event.clickType))
+        {
+            return false;
+        }
+        event.channel = channel;
+        fields >> event.timeDiff;
+        loaded.push_back(event);
+    }
+
+    script = std::move(loaded);
+    return true;
+}
+
+FakeFlicd::Script FakeFlicd::Presses(size_t const presses, double const pressesPerSecond)
+{
+    std::chrono::microseconds const interval(pressesPerSecond > 0 ? static_cast<int64_t>(1000000 / pressesPerSecond) : 0);
+
+    Script script;
+    script.reserve(presses * 2);
+    for (size_t press = 0; press < presses; ++press)
+    {
+        script.push_back({ press == 0 ? std::chrono::microseconds(0) : interval, press, FlicClientProtocol::ButtonDown, 0 });
+        script.push_back({ std::chrono::microseconds(0), press, FlicClientProtocol::ButtonUp, 0 });
+    }
+    return script;
+}
+
+FakeFlicd::FakeFlicd() = default;
+
+FakeFlicd::~FakeFlicd()
+{
+    Stop();
+}
+
+bool FakeFlicd::Start(uint16_t const port)
+{
+    m_ListenHandle = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int const reuse = 1;
+    setsockopt(m_ListenHandle, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t addressLength = sizeof(address);
+    if (m_ListenHandle < 0
+        || bind(m_ListenHandle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(m_ListenHandle, 4) < 0
+        || getsockname(m_ListenHandle, reinterpret_cast<sockaddr*>(&address), &addressLength) < 0)
+    {
+        Stop();
+        return false;
+    }
+    m_Port = ntohs(address.sin_port);
+
+    m_WakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_WakeHandle < 0)
+    {
+        Stop();
+        return false;
+    }
+
+    m_Running = true;
+    m_Thread = std::thread(&FakeFlicd::Run, this);
+    return true;
+}
+
+void FakeFlicd::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Running = false;
+    }
+
+    if (m_Thread.joinable())
+    {
+        Wake();
+        m_Thread.join();
+    }
+
+    if (m_ListenHandle >= 0)
+    {
+        close(m_ListenHandle);
+        m_ListenHandle = -1;
+    }
+
+    if (m_WakeHandle >= 0)
+    {
+        close(m_WakeHandle);
+        m_WakeHandle = -1;
+    }
+}
+
+uint16_t FakeFlicd::Port() const
+{
+    return m_Port;
+}
+
+bool FakeFlicd::WaitForChannels(size_t const count, std::chrono::milliseconds const timeout)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    return m_Changed.wait_for(lock, timeout, [this, count]() { return m_Channels.size() >= count; });
+}
+
+void FakeFlicd::Play(Script script, double const speed, size_t const repeats)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_NextScript = std::move(script);
+        m_NextSpeed = speed;
+        m_NextRepeats = repeats;
+        m_ScriptPending = true;
+        m_ScriptPlaying = true;
+    }
+    Wake();
+}
+
+bool FakeFlicd::WaitForScript(std::chrono::milliseconds const timeout)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    return m_Changed.wait_for(lock, timeout, [this]() { return !m_ScriptPlaying; });
+}
+
+void FakeFlicd::DropClient()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DropRequested = true;
+    Wake();
+    m_Changed.wait(lock, [this]() { return !m_DropRequested || !m_Running; });
+}
+
+void FakeFlicd::RemoveChannels(FlicClientProtocol::RemovedReason const reason)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_RemoveRequested = true;
+    m_RemoveReason = reason;
+    Wake();
+    m_Changed.wait(lock, [this]() { return !m_RemoveRequested || !m_Running; });
+}
+
+void FakeFlicd::HangClient()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_ClientHung = true;
+    // None of them will ring again, so only a new connection counts towards WaitForChannels
+    m_Channels.clear();
+    m_Changed.notify_all();
+}
+
+void FakeFlicd::SetControllerState(FlicClientProtocol::BluetoothControllerState const state)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_ControllerState = state;
+        m_ControllerStateChanged = true;
+    }
+    Wake();
+}
+
+void FakeFlicd::SetLatencyModeDelay(FlicClientProtocol::LatencyMode const latencyMode, std::chrono::microseconds const delay)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (latencyMode < m_LatencyModeDelays.size())
+    {
+        m_LatencyModeDelays[latencyMode] = delay;
+    }
+}
+
+FlicClientProtocol::LatencyMode FakeFlicd::GetLatencyMode(Flic::ConnectionId const connectionId) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (Channel const& channel : m_Channels)
+    {
+        if (channel.connectionId == connectionId)
+        {
+            return channel.latencyMode;
+        }
+    }
+
+    return FlicClientProtocol::NormalLatency;
+}
+
+void FakeFlicd::SetRecordSendTimes(bool const record)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_RecordSendTimes = record;
+    m_Deliveries.clear();
+}
+
+std::vector<std::chrono::steady_clock::time_point> FakeFlicd::SendTimes() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<std::chrono::steady_clock::time_point> sendTimes;
+    sendTimes.reserve(m_Deliveries.size());
+    for (Delivery const& delivery : m_Deliveries)
+    {
+        sendTimes.push_back(delivery.sendTime);
+    }
+    return sendTimes;
+}
+
+std::vector<FakeFlicd::Delivery> FakeFlicd::Deliveries() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Deliveries;
+}
+
+FakeFlicd::Statistics FakeFlicd::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Statistics;
+}
+
+void FakeFlicd::Run()
+{
+    while (true)
+    {
+        bool dropClient = false;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Running)
+            {
+                break;
+            }
+
+            dropClient = m_DropRequested;
+
+            if (m_ControllerStateChanged)
+            {
+                FlicClientProtocol::EvtBluetoothControllerStateChange stateChange;
+                memset(&stateChange, 0, sizeof(stateChange));
+                stateChange.state = m_ControllerState;
+                if (m_ClientHandle >= 0 && !m_ClientHung)
+                {
+                    Send<EVT_BLUETOOTH_CONTROLLER_STATE_CHANGE_OPCODE>(stateChange);
+
+                    // The buttons come straight back once the controller does
+                    if (m_ControllerState == FlicClientProtocol::Attached)
+                    {
+                        for (Channel const& channel : m_Channels)
+                        {
+                            FlicClientProtocol::EvtConnectionStatusChanged statusChanged;
+                            memset(&statusChanged, 0, sizeof(statusChanged));
+                            statusChanged.base.conn_id = channel.connectionId;
+                            statusChanged.connection_status = FlicClientProtocol::Ready;
+                            statusChanged.disconnect_reason = FlicClientProtocol::Unspecified;
+                            Send<EVT_CONNECTION_STATUS_CHANGED_OPCODE>(statusChanged);
+                        }
+                    }
+                }
+                m_ControllerStateChanged = false;
+            }
+
+            if (m_RemoveRequested)
+            {
+                for (Channel const& channel : m_Channels)
+                {
+                    FlicClientProtocol::EvtConnectionChannelRemoved removed;
+                    memset(&removed, 0, sizeof(removed));
+                    removed.base.conn_id = channel.connectionId;
+                    removed.removed_reason = m_RemoveReason;
+                    Send<EVT_CONNECTION_CHANNEL_REMOVED_OPCODE>(removed);
+                }
+                m_Channels.clear();
+                m_RemoveRequested = false;
+                m_Changed.notify_all();
+            }
+
+            if (m_ScriptPending)
+            {
+                m_Script = std::move(m_NextScript);
+                m_Speed = m_NextSpeed > 0 ? m_NextSpeed : 1.0;
+                m_RepeatsLeft = m_Script.empty() ? 0 : m_NextRepeats;
+                m_ScriptPosition = 0;
+                m_ScriptPending = false;
+                m_ScriptPlaying = m_RepeatsLeft > 0;
+                if (m_ScriptPlaying)
+                {
+                    m_NextEventTime = std::chrono::steady_clock::now()
+                        + std::chrono::duration_cast<std::chrono::nanoseconds>(m_Script.front().delay / m_Speed);
+                }
+                else
+                {
+                    m_Changed.notify_all();
+                }
+            }
+        }
+
+        if (dropClient)
+        {
+            CloseClient();
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_DropRequested = false;
+            m_Changed.notify_all();
+        }
+
+        // Sleep until the next scripted or held back event is due, unless there's nothing to send it to yet
+        bool const canSend = (m_RepeatsLeft > 0 || !m_Pending.empty()) && m_ClientHandle >= 0 && m_Outgoing.size() < c_MaxOutgoing;
+        timespec timeout = { 0, 0 };
+        timespec* timeoutPointer = nullptr;
+        if (canSend)
+        {
+            auto nextTime = m_RepeatsLeft > 0 ? m_NextEventTime : std::chrono::steady_clock::time_point::max();
+            if (!m_Pending.empty())
+            {
+                nextTime = std::min(nextTime, m_Pending.front().delivery.sendTime);
+            }
+            auto const remaining = std::max(std::chrono::nanoseconds(0), nextTime - std::chrono::steady_clock::now());
+            timeout.tv_sec = static_cast<time_t>(std::chrono::duration_cast<std::chrono::seconds>(remaining).count());
+            timeout.tv_nsec = static_cast<long>((remaining % std::chrono::seconds(1)).count());
+            timeoutPointer = &timeout;
+        }
+
+        pollfd pollEntries[3] =
+        {
+            { m_WakeHandle, POLLIN, 0 },
+            { m_ListenHandle, POLLIN, 0 },
+            { m_ClientHandle, static_cast<short>(POLLIN | (m_Outgoing.empty() ? 0 : POLLOUT)), 0 },
+        };
+        int const pollCount = m_ClientHandle >= 0 ? 3 : 2;
+        if (ppoll(pollEntries, pollCount, timeoutPointer, nullptr) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (pollEntries[0].revents & POLLIN)
+        {
+            uint64_t wakes = 0;
+            read(m_WakeHandle, &wakes, sizeof(wakes));
+        }
+
+        if (pollEntries[1].revents & POLLIN)
+        {
+            AcceptClient();
+        }
+
+        if (pollCount == 3 && m_ClientHandle >= 0 && (pollEntries[2].revents & (POLLIN | POLLHUP | POLLERR)))
+        {
+            ReadClient();
+        }
+
+        SendDueEvents(std::chrono::steady_clock::now());
+        Flush();
+    }
+
+    CloseClient();
+}
+
+void FakeFlicd::Wake()
+{
+    uint64_t const wake = 1;
+    write(m_WakeHandle, &wake, sizeof(wake));
+}
+
+void FakeFlicd::AcceptClient()
+{
+    int const clientHandle = accept4(m_ListenHandle, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (clientHandle < 0)
+    {
+        return;
+    }
+
+    // Like flicd, a new client doesn't inherit anything from the last one
+    CloseClient();
+
+    // Events are small and latency matters more than packing them together
+    int const noDelay = 1;
+    setsockopt(clientHandle, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    m_ClientHandle = clientHandle;
+    m_PacketReader.Reset();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Statistics.clientsAccepted;
+    m_ClientHung = false;
+}
+
+void FakeFlicd::CloseClient()
+{
+    if (m_ClientHandle < 0)
+    {
+        return;
+    }
+
+    close(m_ClientHandle);
+    m_ClientHandle = -1;
+    m_Outgoing.clear();
+    m_Pending.clear();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Channels.clear();
+    if (m_ScriptPlaying && m_RepeatsLeft == 0)
+    {
+        m_ScriptPlaying = false;
+    }
+    m_Changed.notify_all();
+}
+
+void FakeFlicd::ReadClient()
+{
+    while (m_ClientHandle >= 0)
+    {
+        switch (m_PacketReader.Fill(m_ClientHandle))
+        {
+        case Flic::PacketReader::ReadResult::Data:
+        {
+            break;
+        }
+        case Flic::PacketReader::ReadResult::WouldBlock:
+        {
+            return;
+        }
+        case Flic::PacketReader::ReadResult::EndOfStream:
+        case Flic::PacketReader::ReadResult::Error:
+        {
+            CloseClient();
+            return;
+        }
+        }
+
+        Flic::PacketView packet;
+        Flic::PacketReader::FrameResult frameResult;
+        while ((frameResult = m_PacketReader.Next(packet)) == Flic::PacketReader::FrameResult::Packet)
+        {
+            HandleCommand(packet);
+        }
+
+        if (frameResult == Flic::PacketReader::FrameResult::Oversized)
+        {
+            CloseClient();
+            return;
+        }
+    }
+}
+
+void FakeFlicd::HandleCommand(Flic::PacketView const& packet)
+{
+    namespace Protocol = FlicClientProtocol;
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    ++m_Statistics.commandsReceived;
+    if (m_ClientHung)
+    {
+        return;
+    }
+
+    switch (packet.data[0])
+    {
+    case CMD_GET_INFO_OPCODE:
+    {
+        Protocol::EvtGetInfoResponse response;
+        memset(&response, 0, sizeof(response));
+        response.bluetooth_controller_state = m_ControllerState;
+        response.my_bd_addr_type = Protocol::PublicBdAddrType;
+        response.max_pending_connections = 8;
+        response.max_concurrently_connected_buttons = -1;
+        Send<EVT_GET_INFO_RESPONSE_OPCODE>(response);
+        break;
+    }
+    case CMD_CREATE_CONNECTION_CHANNEL_OPCODE:
+    {
+        Protocol::CmdCreateConnectionChannel storage;
+        Protocol::CmdCreateConnectionChannel const* const command = Flic::Codec::DecodeCommand(packet, storage);
+        if (command == nullptr)
+        {
+            break;
+        }
+
+        Channel channel;
+        channel.connectionId = command->conn_id;
+        memcpy(channel.buttonAddress, command->bd_addr, sizeof(channel.buttonAddress));
+        channel.latencyMode = command->latency_mode;
+        m_Channels.push_back(channel);
+        ++m_Statistics.channelsCreated;
+        m_Changed.notify_all();
+
+        // flicd reports the channel as connected straight away when the button is already connected, then ready once
+        // it has been verified
+        Protocol::EvtCreateConnectionChannelResponse response;
+        memset(&response, 0, sizeof(response));
+        response.base.conn_id = command->conn_id;
+        response.error = Protocol::NoError;
+        response.connection_status = Protocol::Connected;
+        Send<EVT_CREATE_CONNECTION_CHANNEL_RESPONSE_OPCODE>(response);
+
+        Protocol::EvtConnectionStatusChanged statusChanged;
+        memset(&statusChanged, 0, sizeof(statusChanged));
+        statusChanged.base.conn_id = command->conn_id;
+        statusChanged.connection_status = Protocol::Ready;
+        statusChanged.disconnect_reason = Protocol::Unspecified;
+        Send<EVT_CONNECTION_STATUS_CHANGED_OPCODE>(statusChanged);
+        break;
+    }
+    case CMD_REMOVE_CONNECTION_CHANNEL_OPCODE:
+    {
+        Protocol::CmdRemoveConnectionChannel storage;
+        Protocol::CmdRemoveConnectionChannel const* const command = Flic::Codec::DecodeCommand(packet, storage);
+        if (command == nullptr)
+        {
+            break;
+        }
+
+        Flic::ConnectionId const connectionId = command->conn_id;
+        auto const removed = std::remove_if(m_Channels.begin(), m_Channels.end(),
+            [connectionId](Channel const& channel) { return channel.connectionId == connectionId; });
+        if (removed != m_Channels.end())
+        {
+            m_Channels.erase(removed, m_Channels.end());
+            m_Changed.notify_all();
+
+            Protocol::EvtConnectionChannelRemoved response;
+            memset(&response, 0, sizeof(response));
+            response.base.conn_id = connectionId;
+            response.removed_reason = Protocol::RemovedByThisClient;
+            Send<EVT_CONNECTION_CHANNEL_REMOVED_OPCODE>(response);
+        }
+        break;
+    }
+    case CMD_CHANGE_MODE_PARAMETERS_OPCODE:
+    {
+        Protocol::CmdChangeModeParameters storage;
+        Protocol::CmdChangeModeParameters const* const command = Flic::Codec::DecodeCommand(packet, storage);
+        if (command == nullptr)
+        {
+            break;
+        }
+
+        for (Channel& channel : m_Channels)
+        {
+            if (channel.connectionId == command->conn_id && channel.latencyMode != command->latency_mode)
+            {
+                channel.latencyMode = command->latency_mode;
+                ++m_Statistics.latencyModeChanges;
+            }
+        }
+        break;
+    }
+    case CMD_PING_OPCODE:
+    {
+        Protocol::CmdPing storage;
+        Protocol::CmdPing const* const command = Flic::Codec::DecodeCommand(packet, storage);
+        if (command == nullptr)
+        {
+            break;
+        }
+
+        Protocol::EvtPingResponse response;
+        memset(&response, 0, sizeof(response));
+        response.ping_id = command->ping_id;
+        Send<EVT_PING_RESPONSE_OPCODE>(response);
+        break;
+    }
+    case CMD_CREATE_BATTERY_STATUS_LISTENER_OPCODE:
+    {
+        Protocol::CmdCreateBatteryStatusListener storage;
+        Protocol::CmdCreateBatteryStatusListener const* const command = Flic::Codec::DecodeCommand(packet, storage);
+        if (command == nullptr)
+        {
+            break;
+        }
+
+        Protocol::EvtBatteryStatus response;
+        memset(&response, 0, sizeof(response));
+        response.listener_id = command->listener_id;
+        response.battery_percentage = 100;
+        response.timestamp = static_cast<int64_t>(time(nullptr));
+        Send<EVT_BATTERY_STATUS_OPCODE>(response);
+        break;
+    }
+    default:
+    {
+        // Nothing DoorbellPi relies on an answer to
+        break;
+    }
+    }
+}
+
+void FakeFlicd::SendDueEvents(std::chrono::steady_clock::time_point const now)
+{
+    if ((m_RepeatsLeft == 0 && m_Pending.empty()) || m_ClientHandle < 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_ClientHung)
+    {
+        return;
+    }
+
+    // Anything held back that's due goes first, so that events go out in the order they're due
+    while (!m_Pending.empty() && m_Pending.front().delivery.sendTime <= now && m_Outgoing.size() < c_MaxOutgoing)
+    {
+        SendButtonEvent(m_Pending.front());
+        m_Pending.pop_front();
+    }
+
+    while (!m_Channels.empty() && m_RepeatsLeft > 0 && m_NextEventTime <= now && m_Outgoing.size() < c_MaxOutgoing)
+    {
+        ScriptEvent const& scripted = m_Script[m_ScriptPosition];
+        Channel const& channel = m_Channels[scripted.channel % m_Channels.size()];
+
+        PendingEvent pending;
+        memset(&pending.event, 0, sizeof(pending.event));
+        pending.event.base.conn_id = channel.connectionId;
+        pending.event.click_type = scripted.clickType;
+        pending.event.was_queued = scripted.timeDiff > 0 ? 1 : 0;
+        pending.event.time_diff = scripted.timeDiff;
+        pending.delivery.pressTime = m_NextEventTime;
+        pending.delivery.sendTime = m_NextEventTime
+            + (channel.latencyMode < m_LatencyModeDelays.size() ? m_LatencyModeDelays[channel.latencyMode] : std::chrono::microseconds(0));
+        pending.delivery.connectionId = channel.connectionId;
+        pending.delivery.latencyMode = channel.latencyMode;
+        pending.delivery.clickType = scripted.clickType;
+
+        // Everything still held back is due after now, so an event that's already due can't overtake one
+        if (pending.delivery.sendTime <= now)
+        {
+            SendButtonEvent(pending);
+        }
+        else
+        {
+            auto const position = std::upper_bound(m_Pending.begin(), m_Pending.end(), pending.delivery.sendTime,
+                [](std::chrono::steady_clock::time_point const sendTime, PendingEvent const& other) { return sendTime < other.delivery.sendTime; });
+            m_Pending.insert(position, pending);
+        }
+
+        if (++m_ScriptPosition == m_Script.size())
+        {
+            m_ScriptPosition = 0;
+            if (--m_RepeatsLeft == 0)
+            {
+                break;
+            }
+        }
+
+        m_NextEventTime += std::chrono::duration_cast<std::chrono::nanoseconds>(m_Script[m_ScriptPosition].delay / m_Speed);
+    }
+
+    if (m_ScriptPlaying && m_RepeatsLeft == 0 && m_Pending.empty())
+    {
+        m_ScriptPlaying = false;
+        m_Changed.notify_all();
+    }
+}
+
+void FakeFlicd::SendButtonEvent(PendingEvent& pending)
+{
+    if (pending.delivery.clickType == FlicClientProtocol::ButtonDown || pending.delivery.clickType == FlicClientProtocol::ButtonUp)
+    {
+        Send<EVT_BUTTON_UP_OR_DOWN_OPCODE>(pending.event);
+    }
+    else
+    {
+        Send<EVT_BUTTON_CLICK_OR_HOLD_OPCODE>(pending.event);
+    }
+
+    ++m_Statistics.eventsSent;
+    if (m_RecordSendTimes)
+    {
+        // Flushed straight after, so this is when it was written to within a few microseconds
+        pending.delivery.sendTime = std::chrono::steady_clock::now();
+        m_Deliveries.push_back(pending.delivery);
+    }
+}
+
+void FakeFlicd::Flush()
+{
+    if (m_ClientHandle < 0 || m_Outgoing.empty())
+    {
+        return;
+    }
+
+    ssize_t const sent = send(m_ClientHandle, m_Outgoing.data(), m_Outgoing.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent > 0)
+    {
+        m_Outgoing.erase(0, static_cast<size_t>(sent));
+    }
+    else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+    {
+        CloseClient();
+    }
+}
+
+template<uint8_t Opcode>
+void FakeFlicd::Send(typename Flic::Codec::Event<Opcode>::Type const& event)
+{
+    uint8_t buffer[Flic::Codec::c_EncodedEventSize<Opcode>];
+    size_t const length = Flic::Codec::EncodeEvent<Opcode>(event, buffer);
+    m_Outgoing.append(reinterpret_cast<char const*>(buffer), length);
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../FlicChannelTable.h"
+#include "../FlicCodec.h"
+#include "../FlicPacketReader.h"
+
+// A stand-in for flicd that speaks the client protocol from client_protocol_packets.h over TCP on 127.0.0.1. It
+// accepts one client at a time, answers the commands DoorbellPi sends (connection channels, battery listeners, pings,
+// mode changes, get info) the way flicd does, and replays scripted button event streams across the client's channels
+// at whatever rate is asked for. Each event can be held back by a delay that depends on its channel's latency mode,
+// standing in for the Bluetooth link. Everything runs on a thread of its own; the public methods are all thread safe
+class FakeFlicd
+{
+public:
+    struct ScriptEvent
+    {
+        // Since the previous event
+        std::chrono::microseconds delay;
+        // Index into the client's channels, in the order they were created, wrapping around
+        size_t channel;
+        FlicClientProtocol::ClickType clickType;
+        uint32_t timeDiff;
+    };
+
+    using Script = std::vector<ScriptEvent>;
+
+    struct Statistics
+    {
+        uint64_t clientsAccepted;
+        uint64_t commandsReceived;
+        uint64_t channelsCreated;
+        uint64_t eventsSent;
+        uint64_t latencyModeChanges;
+    };
+
+    // A scripted event: when its button was pressed, when it was written to the socket after the delay for its mode
+    struct Delivery
+    {
+        std::chrono::steady_clock::time_point pressTime;
+        std::chrono::steady_clock::time_point sendTime;
+        Flic::ConnectionId connectionId;
+        FlicClientProtocol::LatencyMode latencyMode;
+        FlicClientProtocol::ClickType clickType;
+    };
+
+    // One "<delay ms> <channel> <down|up|click|hold> [time_diff]" per line, # starts a comment
+    static bool LoadScript(std::string const& path, Script& script);
+
+    // A button down and up on each channel in turn, pressesPerSecond apart. Zero is as fast as possible
+    static Script Presses(size_t const presses, double const pressesPerSecond);
+
+    FakeFlicd();
+    ~FakeFlicd();
+
+    FakeFlicd(FakeFlicd const&) = delete;
+    FakeFlicd& operator=(FakeFlicd const&) = delete;
+
+    // Zero picks a free port
+    bool Start(uint16_t const port);
+    void Stop();
+    uint16_t Port() const;
+
+    // Waits until the current client has at least count channels
+    bool WaitForChannels(size_t const count, std::chrono::milliseconds const timeout);
+
+    // Replays the script repeats times, with its delays divided by speed. Replaces any script still playing
+    void Play(Script script, double const speed = 1.0, size_t const repeats = 1);
+    bool WaitForScript(std::chrono::milliseconds const timeout);
+
+    // Closes the client's connection, as flicd restarting would, and returns once it's closed
+    void DropClient();
+
+    // Removes every one of the client's channels, as flicd does when another client force disconnects a button, and
+    // returns once the removals have been sent. The connection stays up
+    void RemoveChannels(FlicClientProtocol::RemovedReason const reason);
+
+    // Stops answering the client or sending it anything, as a wedged flicd would, while leaving the connection open.
+    // The next client to connect is served normally
+    void HangClient();
+
+    // Reports the Bluetooth controller changing state, and answers CmdGetInfo with it from then on. Going back to
+    // Attached reports every channel ready again
+    void SetControllerState(FlicClientProtocol::BluetoothControllerState const state);
+
+    // How long a channel's events are held back while it is in the given mode. All zero until set
+    void SetLatencyModeDelay(FlicClientProtocol::LatencyMode const latencyMode, std::chrono::microseconds const delay);
+    // As the client last asked for it, or NormalLatency for a channel it doesn't have
+    FlicClientProtocol::LatencyMode GetLatencyMode(Flic::ConnectionId const connectionId) const;
+
+    // Keeps a Delivery for every scripted event written to the socket, for latency measurements
+    void SetRecordSendTimes(bool const record);
+    std::vector<std::chrono::steady_clock::time_point> SendTimes() const;
+    std::vector<Delivery> Deliveries() const;
+
+    Statistics GetStatistics() const;
+
+private:
+    struct Channel
+    {
+        Flic::ConnectionId connectionId;
+        uint8_t buttonAddress[6];
+        FlicClientProtocol::LatencyMode latencyMode;
+    };
+
+    struct PendingEvent
+    {
+        Delivery delivery;
+        FlicClientProtocol::EvtButtonEvent event;
+    };
+
+    void Run();
+    void Wake();
+    void AcceptClient();
+    void CloseClient();
+    void ReadClient();
+    void HandleCommand(Flic::PacketView const& packet);
+    void SendDueEvents(std::chrono::steady_clock::time_point const now);
+    void SendButtonEvent(PendingEvent& pending);
+    void Flush();
+
+    template<uint8_t Opcode>
+    void Send(typename Flic::Codec::Event<Opcode>::Type const& event);
+
+    int m_ListenHandle = -1;
+    int m_WakeHandle = -1;
+    uint16_t m_Port = 0;
+    std::thread m_Thread;
+
+    // Shared with the callers' threads
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    bool m_Running = false;
+    bool m_DropRequested = false;
+    bool m_RemoveRequested = false;
+    FlicClientProtocol::RemovedReason m_RemoveReason = FlicClientProtocol::ForceDisconnectedByOtherClient;
+    bool m_ClientHung = false;
+    FlicClientProtocol::BluetoothControllerState m_ControllerState = FlicClientProtocol::Attached;
+    bool m_ControllerStateChanged = false;
+    bool m_ScriptPending = false;
+    bool m_RecordSendTimes = false;
+    std::array<std::chrono::microseconds, Flic::Codec::c_LatencyModeCount> m_LatencyModeDelays = {};
+    Script m_NextScript;
+    double m_NextSpeed = 1.0;
+    size_t m_NextRepeats = 1;
+    std::vector<Channel> m_Channels;
+    bool m_ScriptPlaying = false;
+    std::vector<Delivery> m_Deliveries;
+    Statistics m_Statistics = {};
+
+    // Only used on the fake's own thread
+    int m_ClientHandle = -1;
+    Flic::PacketReader m_PacketReader;
+    std::string m_Outgoing;
+    Script m_Script;
+    double m_Speed = 1.0;
+    size_t m_RepeatsLeft = 0;
+    size_t m_ScriptPosition = 0;
+    std::chrono::steady_clock::time_point m_NextEventTime;
+    // Events held back by their mode's delay, in the order they're due
+    std::deque<PendingEvent> m_Pending;
+};
@@ -0,0 +1,126 @@
+// Runs FakeFlicd on its own, for pointing a DoorbellPi daemon (normally doorbellpi-mock) at. Every time a client has
+// created its channels the script is replayed across them, then the statistics are printed.
+// Usage: fake-flicd [--port N] [--channels N] [--script file | --presses N] [--rate presses/s] [--speed x] [--repeat N]
+//            [--low-ms N] [--normal-ms N] [--high-ms N]
+
+#include "FakeFlicd.h"
+
+#include <atomic>
+#include <errno.h>
+#include <iostream>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+namespace
+{
+    std::atomic<bool> s_Stopping{ false };
+
+    void OnSignal(int)
+    {
+        s_Stopping = true;
+    }
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: fake-flicd [--port N] [--channels N] [--script file | --presses N] [--rate presses/s] [--speed x] [--repeat N]"
+            " [--low-ms N] [--normal-ms N] [--high-ms N]" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t port = 5551;
+    size_t channels = 1;
+    std::string scriptPath;
+    size_t presses = 10;
+    double rate = 1.0;
+    double speed = 1.0;
+    size_t repeats = 1;
+    // How long events are held back in each latency mode, as the Bluetooth link would
+    unsigned long modeDelays[Flic::Codec::c_LatencyModeCount] = {};
+
+    for (int argument = 1; argument < argc; ++argument)
+    {
+        std::string const name = argv[argument];
+        if (argument + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        char const* const value = argv[++argument];
+        if (name == "--port") { port = static_cast<uint16_t>(atoi(value)); }
+        else if (name == "--channels") { channels = strtoul(value, nullptr, 10); }
+        else if (name == "--script") { scriptPath = value; }
+        else if (name == "--presses") { presses = strtoul(value, nullptr, 10); }
+        else if (name == "--rate") { rate = atof(value); }
+        else if (name == "--speed") { speed = atof(value); }
+        else if (name == "--repeat") { repeats = strtoul(value, nullptr, 10); }
+        else if (name == "--normal-ms") { modeDelays[FlicClientProtocol::NormalLatency] = strtoul(value, nullptr, 10); }
+        else if (name == "--low-ms") { modeDelays[FlicClientProtocol::LowLatency] = strtoul(value, nullptr, 10); }
+        else if (name == "--high-ms") { modeDelays[FlicClientProtocol::HighLatency] = strtoul(value, nullptr, 10); }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    FakeFlicd::Script script;
+    if (scriptPath.empty())
+    {
+        script = FakeFlicd::Presses(presses, rate);
+    }
+    else if (!FakeFlicd::LoadScript(scriptPath, script))
+    {
+        std::cerr << "Failed to load script '" << scriptPath << "'" << std::endl;
+        return 1;
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    FakeFlicd fake;
+    for (size_t mode = 0; mode < Flic::Codec::c_LatencyModeCount; ++mode)
+    {
+        fake.SetLatencyModeDelay(static_cast<FlicClientProtocol::LatencyMode>(mode), std::chrono::milliseconds(modeDelays[mode]));
+    }
+    if (!fake.Start(port))
+    {
+        std::cerr << "Failed to listen on port " << port << " [" << strerror(errno) << "]" << std::endl;
+        return 1;
+    }
+    std::cout << "Listening on 127.0.0.1:" << fake.Port() << ", " << script.size() << " scripted events" << std::endl;
+
+    while (!s_Stopping)
+    {
+        if (!fake.WaitForChannels(channels, std::chrono::milliseconds(200)))
+        {
+            continue;
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        fake.Play(script, speed, repeats);
+        while (!s_Stopping && !fake.WaitForScript(std::chrono::milliseconds(200)))
+        {
+        }
+        double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        FakeFlicd::Statistics const statistics = fake.GetStatistics();
+        std::cout << "Sent " << statistics.eventsSent << " events in " << seconds << " s; " << statistics.clientsAccepted
+            << " clients, " << statistics.commandsReceived << " commands, " << statistics.channelsCreated << " channels created, "
+            << statistics.latencyModeChanges << " latency mode changes" << std::endl;
+
+        // Once per client: wait for the next one before starting again
+        while (!s_Stopping && fake.GetStatistics().clientsAccepted == statistics.clientsAccepted)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+
+    fake.Stop();
+    return 0;
+}
@@ -0,0 +1,311 @@
+// Answers questions from the press journal: how often each button was pressed and what came of it, at what times of
+// day, how quickly the rings started, or every record as CSV for anything else. Reads the daemon's journal and its
+// rotated files, oldest first, unless given files of its own. Safe to run while the daemon is writing.
+// Usage: doorbellpi-journal [--journal path] [--since "YYYY-MM-DD[ HH:MM]"] [--until "YYYY-MM-DD[ HH:MM]"]
+//            [--button XX:XX:XX:XX:XX:XX] count|hours|latency|csv [file...]
+
+#include "../Config.h"
+#include "../FlicButtonAddress.h"
+#include "../Journal.h"
+
+#include <inttypes.h>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+namespace
+{
+    // More than the daemon would ever be configured to keep
+    size_t const c_MaxFiles = 100;
+    // Upper bounds of the latency histogram's buckets, in microseconds
+    uint32_t const c_LatencyBuckets[] = { 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 100000 };
+    size_t const c_LatencyBucketCount = sizeof(c_LatencyBuckets) / sizeof(c_LatencyBuckets[0]) + 1;
+
+    char const* const c_OutcomeNames[] = { "rang", "escalated", "cooldown", "busy" };
+
+    struct Filter
+    {
+        int64_t since = std::numeric_limits<int64_t>::min();
+        int64_t until = std::numeric_limits<int64_t>::max();
+        bool anyButton = true;
+        Flic::ButtonAddress button;
+    };
+
+    struct ButtonCounts
+    {
+        uint64_t presses = 0;
+        uint64_t counts[sizeof(c_OutcomeNames) / sizeof(c_OutcomeNames[0])] = {};
+    };
+
+    void PrintUsage()
+    {
+        std::cerr << "Usage: doorbellpi-journal [--journal path] [--since \"YYYY-MM-DD[ HH:MM]\"] [--until \"YYYY-MM-DD[ HH:MM]\"]"
+            " [--button XX:XX:XX:XX:XX:XX] count|hours|latency|csv [file...]" << std::endl;
+    }
+
+    // Local time, to the microsecond
+    bool ParseTime(char const* text, int64_t& time)
+    {
+        struct tm fields = {};
+        char const* end = strptime(text, "%Y-%m-%d %H:%M", &fields);
+        if (end == nullptr)
+        {
+            fields = {};
+            end = strptime(text, "%Y-%m-%d", &fields);
+        }
+        if (end == nullptr || *end != '\0')
+        {
+            return false;
+        }
+
+        fields.tm_isdst = -1;
+        time = static_cast<int64_t>(mktime(&fields)) * 1000000;
+        return true;
+    }
+
+    // Displayed big endian, stored little endian
+    bool ParseAddress(char const* text, Flic::ButtonAddress& address)
+    {
+        unsigned int bytes[Flic::ButtonAddress::c_AddressLength];
+        char extra = 0;
+        if (sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[5], &bytes[4], &bytes[3], &bytes[2], &bytes[1], &bytes[0], &extra) != 6)
+        {
+            return false;
+        }
+
+        for (int index = 0; index < Flic::ButtonAddress::c_AddressLength; ++index)
+        {
+            address.addr[index] = static_cast<uint8_t>(bytes[index]);
+        }
+        return true;
+    }
+
+    std::string FormatAddress(uint8_t const* address)
+    {
+        char text[3 * Flic::ButtonAddress::c_AddressLength];
+        snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", address[5], address[4], address[3], address[2], address[1], address[0]);
+        return text;
+    }
+
+    std::string FormatTime(int64_t const time)
+    {
+        time_t const seconds = static_cast<time_t>(time / 1000000);
+        struct tm fields;
+        localtime_r(&seconds, &fields);
+        char text[40];
+        size_t const length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &fields);
+        snprintf(text + length, sizeof(text) - length, ".%06d", static_cast<int>(time % 1000000));
+        return text;
+    }
+
+    std::string OutcomeName(Journal::Outcome const outcome)
+    {
+        size_t const index = static_cast<size_t>(outcome);
+        return index < sizeof(c_OutcomeNames) / sizeof(c_OutcomeNames[0]) ? c_OutcomeNames[index] : std::to_string(index);
+    }
+
+    size_t LatencyBucket(uint32_t const nanoseconds)
+    {
+        size_t bucket = 0;
+        while (bucket + 1 < c_LatencyBucketCount && nanoseconds >= c_LatencyBuckets[bucket] * 1000)
+        {
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    void PrintBar(uint64_t const count, uint64_t const largest)
+    {
+        size_t const c_Width = 50;
+        size_t const length = largest > 0 ? static_cast<size_t>((count * c_Width + largest - 1) / largest) : 0;
+        std::cout << std::string(length, '#');
+    }
+
+    void PrintLatencies(char const* name, uint64_t const (&buckets)[c_LatencyBucketCount])
+    {
+        uint64_t largest = 0;
+        for (uint64_t const count : buckets)
+        {
+            largest = count > largest ? count : largest;
+        }
+
+        std::cout << name << std::endl;
+        for (size_t bucket = 0; bucket < c_LatencyBucketCount; ++bucket)
+        {
+            char label[32];
+            if (bucket + 1 < c_LatencyBucketCount)
+            {
+                snprintf(label, sizeof(label), "  < %6" PRIu32 " us", c_LatencyBuckets[bucket]);
+            }
+            else
+            {
+                snprintf(label, sizeof(label), "  >=%6" PRIu32 " us", c_LatencyBuckets[bucket - 1]);
+            }
+            std::cout << label << " " << buckets[bucket] << "\t";
+            PrintBar(buckets[bucket], largest);
+            std::cout << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string journalPath = Config::Settings().journalPath;
+    Filter filter;
+    int argument = 1;
+    for (; argument < argc && strncmp(argv[argument], "--", 2) == 0; ++argument)
+    {
+        std::string const name = argv[argument];
+        if (argument + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        char const* const value = argv[++argument];
+        bool valid = true;
+        if (name == "--journal") { journalPath = value; }
+        else if (name == "--since") { valid = ParseTime(value, filter.since); }
+        else if (name == "--until") { valid = ParseTime(value, filter.until); }
+        else if (name == "--button") { valid = ParseAddress(value, filter.button); filter.anyButton = false; }
+        else { valid = false; }
+
+        if (!valid)
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (argument >= argc)
+    {
+        PrintUsage();
+        return 1;
+    }
+    std::string const command = argv[argument++];
+    if (command != "count" && command != "hours" && command != "latency" && command != "csv")
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<std::string> files(argv + argument, argv + argc);
+    if (files.empty())
+    {
+        files = Journal::Files(journalPath, c_MaxFiles);
+    }
+    if (files.empty())
+    {
+        std::cerr << "No journal at '" << journalPath << "'" << std::endl;
+        return 1;
+    }
+
+    // Ordered, so the output comes out in the same order every time
+    std::map<std::string, ButtonCounts> buttons;
+    uint64_t hours[24] = {};
+    uint64_t decodeLatencies[c_LatencyBucketCount] = {};
+    uint64_t ringLatencies[c_LatencyBucketCount] = {};
+    if (command == "csv")
+    {
+        std::cout << "time,button,click_type,outcome,presses,time_diff_s,decode_latency_us,ring_latency_us,pattern" << std::endl;
+    }
+
+    int result = 0;
+    for (std::string const& path : files)
+    {
+        Journal::Reader reader;
+        if (!reader.Open(path))
+        {
+            std::cerr << "Failed to read journal '" << path << "'" << std::endl;
+            result = 1;
+            continue;
+        }
+
+        size_t const size = reader.Size();
+        for (size_t index = 0; index < size; ++index)
+        {
+            Journal::Record const& record = reader[index];
+            if (record.time < filter.since || record.time >= filter.until
+                || (!filter.anyButton && memcmp(record.buttonAddress, filter.button.addr, sizeof(record.buttonAddress)) != 0))
+            {
+                continue;
+            }
+
+            // An escalation follows a ring rather than being a press of its own
+            bool const isPress = record.outcome != Journal::Outcome::Escalated;
+            if (command == "count")
+            {
+                ButtonCounts& counts = buttons[FormatAddress(record.buttonAddress)];
+                counts.presses += isPress ? record.presses : 0;
+                size_t const outcome = static_cast<size_t>(record.outcome);
+                if (outcome < sizeof(counts.counts) / sizeof(counts.counts[0]))
+                {
+                    ++counts.counts[outcome];
+                }
+            }
+            else if (command == "hours")
+            {
+                time_t const seconds = static_cast<time_t>(record.time / 1000000);
+                struct tm fields;
+                localtime_r(&seconds, &fields);
+                hours[fields.tm_hour] += isPress ? record.presses : 0;
+            }
+            else if (command == "latency")
+            {
+                if (isPress)
+                {
+                    ++decodeLatencies[LatencyBucket(record.decodeLatency)];
+                }
+                if (record.outcome == Journal::Outcome::Rang)
+                {
+                    ++ringLatencies[LatencyBucket(record.ringLatency)];
+                }
+            }
+            else
+            {
+                std::string const pattern(record.pattern, strnlen(record.pattern, sizeof(record.pattern)));
+                std::cout << FormatTime(record.time) << "," << FormatAddress(record.buttonAddress) << "," << static_cast<int>(record.clickType)
+                    << "," << OutcomeName(record.outcome) << "," << record.presses << "," << record.timeDiff << ","
+                    << record.decodeLatency / 1000.0 << "," << record.ringLatency / 1000.0 << "," << pattern << "\n";
+            }
+        }
+    }
+
+    if (command == "count")
+    {
+        std::cout << "button\t\t\tpresses\trang\tescalated\tcooldown\tbusy" << std::endl;
+        for (auto const& button : buttons)
+        {
+            ButtonCounts const& counts = button.second;
+            std::cout << button.first << "\t" << counts.presses << "\t" << counts.counts[0] << "\t" << counts.counts[1] << "\t\t"
+                << counts.counts[2] << "\t\t" << counts.counts[3] << std::endl;
+        }
+    }
+    else if (command == "hours")
+    {
+        uint64_t largest = 0;
+        for (uint64_t const count : hours)
+        {
+            largest = count > largest ? count : largest;
+        }
+        for (int hour = 0; hour < 24; ++hour)
+        {
+            char label[16];
+            snprintf(label, sizeof(label), "%02d:00", hour);
+            std::cout << label << " " << hours[hour] << "\t";
+            PrintBar(hours[hour], largest);
+            std::cout << std::endl;
+        }
+    }
+    else if (command == "latency")
+    {
+        PrintLatencies("Decode latency, readable to decoded", decodeLatencies);
+        PrintLatencies("Ring latency, readable to ring scheduled", ringLatencies);
+    }
+    return result;
+}